@@ -0,0 +1,83 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// summarize() at each simd_level against a loop calling has_value() and
+// value(), on columns where a fifth of the elements have no value. Each
+// column fits in L2 and is summarized repeatedly.
+// Usage: bench_aggregate [elements]
+
+#include "../include/ak_toolkit/markable_aggregate.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace ak_toolkit;
+
+volatile double sink;
+
+template <typename F>
+double ns_per_element(F f, std::size_t n)
+{
+  const std::size_t repeats = std::max<std::size_t>(1, (std::size_t(1) << 26) / n);
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t r = 0; r != repeats; ++r)
+    f();
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / double(n * repeats);
+}
+
+template <typename MP, typename Sum>
+void run(const char* name, std::size_t n)
+{
+  typedef typename MP::representation_type rep_t;
+  typedef markable<MP> opt_t;
+
+  std::vector<opt_t> column;
+  std::uint64_t seed = 12345;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    column.push_back((seed >> 40) % 5 == 0 ? opt_t() : opt_t(rep_t(std::int32_t(seed >> 33))));
+  }
+
+  std::printf("%-7s loop %6.3f", name, ns_per_element([&] {
+    std::size_t count = 0;
+    Sum sum = 0;
+    rep_t mn = std::numeric_limits<rep_t>::max(), mx = std::numeric_limits<rep_t>::lowest();
+    for (const opt_t& o : column)
+      if (o.has_value())
+      {
+        ++count;
+        sum += o.value();
+        mn = o.value() < mn ? o.value() : mn;
+        mx = mx < o.value() ? o.value() : mx;
+      }
+    sink = double(sum) + double(count) + double(mn) + double(mx);
+  }, n));
+
+  const simd_level levels[] = { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 };
+  const char* level_names[] = { "scalar", "sse2", "avx2", "avx512" };
+  for (int l = 0; l != 4; ++l)
+    std::printf("   %s %6.3f", level_names[l], ns_per_element([&] {
+      sink = double(summarize(column.data(), n, levels[l]).sum);
+    }, n));
+  std::printf("  ns/elem\n");
+}
+
+int main(int argc, char** argv)
+{
+  const std::size_t n = argc > 1 ? std::size_t(std::atoll(argv[1])) : std::size_t(1) << 16;
+  std::printf("simd levels above %d are run as the detected level\n", int(detected_simd_level()));
+  run<mark_int<std::int32_t, -1>, std::int64_t>("int32", n);
+  run<mark_int<std::uint32_t, 0>, std::uint64_t>("uint32", n);
+  run<mark_int<std::int64_t, -1>, std::int64_t>("int64", n);
+  run<mark_int<std::int16_t, -1>, std::int64_t>("int16", n);
+  run<mark_fp_nan<float>, float>("float", n);
+  run<mark_fp_nan<double>, double>("double", n);
+}
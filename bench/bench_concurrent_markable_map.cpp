@@ -0,0 +1,91 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Deduplication throughput of concurrent_markable_map against a sharded
+// std::unordered_map guarded by mutexes, from 1 to N threads.
+// Usage: bench_concurrent_markable_map [max_threads]
+
+#include "../include/ak_toolkit/concurrent_markable_map.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int_range<std::uint64_t, ~std::uint64_t(0) - 2, ~std::uint64_t(0)> mark_key;
+
+const std::uint64_t operations = 1 << 22;
+const std::uint64_t distinct_keys = 1 << 20; // every key is seen 4 times on average
+
+std::uint64_t key_at(std::uint64_t i)
+{
+  std::uint64_t x = i * 0x9E3779B97F4A7C15ull;
+  return (x ^ (x >> 29)) % distinct_keys;
+}
+
+class sharded_map
+{
+  static const int shards = 64;
+  struct shard
+  {
+    std::mutex mutex;
+    std::unordered_map<std::uint64_t, std::uint64_t> map;
+  };
+  shard _shards[shards];
+
+public:
+  bool insert(std::uint64_t k, std::uint64_t v)
+  {
+    shard& s = _shards[k % shards];
+    std::lock_guard<std::mutex> lock (s.mutex);
+    return s.map.emplace(k, v).second;
+  }
+};
+
+template <typename Map>
+double million_ops_per_second(int threads)
+{
+  Map m;
+  std::atomic<std::uint64_t> inserted (0);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int t = 0; t != threads; ++t)
+    workers.emplace_back([&, t] {
+      std::uint64_t mine = 0;
+      for (std::uint64_t i = std::uint64_t(t); i < operations; i += std::uint64_t(threads))
+        mine += m.insert(key_at(i), i);
+      inserted += mine;
+    });
+  for (std::thread& w : workers)
+    w.join();
+
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+  if (inserted.load() == 0)
+    std::abort();
+  return double(operations) / d.count() / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : int(std::thread::hardware_concurrency());
+  if (max_threads < 1)
+    max_threads = 1;
+
+  std::printf("threads   concurrent_markable_map   sharded unordered_map   (Mops/s)\n");
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    double c = million_ops_per_second<concurrent_markable_map<mark_key, std::uint64_t>>(threads);
+    double s = million_ops_per_second<sharded_map>(threads);
+    std::printf("%7d   %23.2f   %21.2f\n", threads, c, s);
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Hashing a column of keys: a loop calling hash_by_representation and each
+// hash of markable_hash.hpp, against hash_batch() at each simd_level. Each
+// column fits in L2 and is hashed repeatedly.
+// Usage: bench_hash [elements]
+
+#include "../include/ak_toolkit/markable_hash.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace ak_toolkit;
+
+volatile std::uint64_t sink;
+
+template <typename F>
+double ns_per_element(F f, std::size_t n)
+{
+  const std::size_t repeats = std::max<std::size_t>(1, (std::size_t(1) << 26) / n);
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t r = 0; r != repeats; ++r)
+    f();
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / double(n * repeats);
+}
+
+template <typename MP, typename Hash>
+void run_hash(const char* type, const char* hash, const std::vector<typename MP::representation_type>& v, std::vector<std::uint64_t>& out)
+{
+  const std::size_t n = v.size();
+  const double loop = ns_per_element([&] {
+    for (std::size_t i = 0; i != n; ++i)
+      out[i] = Hash()(markable<MP>(with_representation, v[i]));
+    sink = out[n / 2];
+  }, n);
+  std::printf("%-6s %-22s loop %6.3f ns", type, hash, loop);
+
+  const simd_level levels[] = { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 };
+  const char* names[] = { "scalar", "sse2", "avx2", "avx512" };
+  for (int l = 0; l != 4 && levels[l] <= detected_simd_level(); ++l)
+    std::printf("  %s %6.3f ns", names[l], ns_per_element([&] {
+      hash_batch<MP>(v.data(), n, out.data(), Hash(), levels[l]);
+      sink = out[n / 2];
+    }, n));
+  std::printf("\n");
+}
+
+template <typename MP>
+void run(const char* type, std::size_t n)
+{
+  typedef typename MP::representation_type rep_t;
+  std::vector<rep_t> v (n);
+  std::uint32_t seed = 1;
+  for (rep_t& e : v)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    e = (seed >> 8) % 5 == 0 ? MP::marked_value() : rep_t(seed >> 4);
+  }
+  std::vector<std::uint64_t> out (n);
+
+  run_hash<MP, hash_by_representation>(type, "hash_by_representation", v, out);
+  run_hash<MP, fibonacci_hash>(type, "fibonacci_hash", v, out);
+  run_hash<MP, wy_hash>(type, "wy_hash", v, out);
+  run_hash<MP, crc32c_hash>(type, "crc32c_hash", v, out);
+}
+
+int main(int argc, char** argv)
+{
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+  run<mark_int<std::int32_t, -1>>("int32", n);
+  run<mark_int<std::int64_t, -1>>("int64", n);
+}
@@ -0,0 +1,125 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Group-by of an int32 key column, and its join with a column of distinct
+// keys (like a foreign key and a primary key), where a tenth of the keys have
+// no value, against std::unordered_map keyed by the values. The numbers of
+// distinct keys range from cache-resident to much larger than the cache.
+// Usage: bench_hash_join [rows]
+
+#include "../include/ak_toolkit/markable_hash_join.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::int32_t, -1> MP;
+typedef markable<MP> opt_key;
+
+volatile std::size_t sink;
+
+template <typename F>
+double ns_per_row(F f, std::size_t n)
+{
+  double best = 1e300;
+  for (int r = 0; r != 3; ++r)
+  {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    best = d.count() < best ? d.count() : best;
+  }
+  return best / double(n);
+}
+
+std::vector<std::int32_t> make_keys(std::size_t n, std::uint32_t distinct, std::uint32_t seed)
+{
+  std::vector<std::int32_t> v (n);
+  for (std::int32_t& k : v)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    k = (seed >> 8) % 10 == 0 ? -1 : std::int32_t((seed >> 4) % distinct);
+  }
+  return v;
+}
+
+void run(std::size_t n, std::uint32_t distinct)
+{
+  const std::vector<std::int32_t> keys = make_keys(n, distinct, 1);
+  const std::vector<std::int32_t> probes = make_keys(n, distinct, 2);
+  std::vector<std::int32_t> primary (distinct);
+  for (std::uint32_t j = 0; j != distinct; ++j)
+    primary[j] = j % 10 == 3 ? -1 : std::int32_t(std::uint64_t(j) * 2654435761u % distinct); // a permutation: 2654435761 is a prime
+  std::vector<std::uint32_t> ids (n);
+
+  const double map_group = ns_per_row([&] {
+    std::unordered_map<std::int32_t, std::uint32_t> groups;
+    std::uint32_t null_group = std::uint32_t(-1);
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const opt_key k (keys[i]);
+      if (!k.has_value())
+        ids[i] = null_group == std::uint32_t(-1) ? (null_group = std::uint32_t(groups.size())) : null_group;
+      else
+        ids[i] = groups.insert(std::make_pair(k.value(), std::uint32_t(groups.size() + (null_group != std::uint32_t(-1))))).first->second;
+    }
+    sink = groups.size();
+  }, n);
+
+  const double group = ns_per_row([&] {
+    markable_hash_group_by<MP> groups;
+    groups.group(const_markable_span<MP>(keys.data(), n), ids.data());
+    sink = groups.group_count();
+  }, n);
+
+  std::unordered_multimap<std::int32_t, std::uint32_t> map_build;
+  for (std::size_t j = 0; j != primary.size(); ++j)
+    if (opt_key(primary[j]).has_value())
+      map_build.insert(std::make_pair(primary[j], std::uint32_t(j)));
+  std::vector<std::uint32_t> probe_rows, build_rows;
+  probe_rows.reserve(n);
+  build_rows.reserve(n);
+
+  const double map_probe = ns_per_row([&] {
+    probe_rows.clear();
+    build_rows.clear();
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const opt_key k (probes[i]);
+      if (!k.has_value())
+        continue;
+      const auto range = map_build.equal_range(k.value());
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        probe_rows.push_back(std::uint32_t(i));
+        build_rows.push_back(it->second);
+      }
+    }
+    sink = probe_rows.size();
+  }, n);
+
+  markable_hash_join<MP> join (const_markable_span<MP>(primary.data(), primary.size()));
+  const double probe = ns_per_row([&] {
+    probe_rows.clear();
+    build_rows.clear();
+    sink = join.probe(const_markable_span<MP>(probes.data(), n), probe_rows, build_rows);
+  }, n);
+
+  std::printf("%9u keys  group-by: unordered_map %6.2f ns/row  markable_hash_group_by %6.2f ns/row   "
+              "join probe: unordered_multimap %6.2f ns/row  markable_hash_join %6.2f ns/row\n",
+              distinct, map_group, group, map_probe, probe);
+}
+
+int main(int argc, char** argv)
+{
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t(1) << 22;
+  for (std::uint32_t distinct : { 101u, 10001u, 1000001u, 16000001u })
+    run(n, distinct);
+}
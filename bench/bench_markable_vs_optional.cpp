@@ -0,0 +1,286 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// markable against std::optional (and boost::optional, when available) for
+// every mark_* policy: vector fill, has_value() scan, sort, hash, element-wise
+// copy and move, and lookups in a std::unordered_map, on vectors from L1 size
+// to DRAM size. Reports ns/element, bytes/element and, where the kernel allows
+// perf_event_open(), last-level cache misses/element.
+// Usage: bench_markable_vs_optional [max_elements]
+
+#include "../include/ak_toolkit/markable.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#if defined __has_include
+# if __has_include(<boost/optional.hpp>)
+#  include <boost/optional.hpp>
+#  define AK_BENCH_HAS_BOOST_OPTIONAL
+# endif
+#endif
+
+#if defined __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+using namespace ak_toolkit;
+
+// a type with an invariant (lo <= hi), stored via dual_storage
+
+struct range
+{
+  int lo, hi;
+  friend bool operator< (const range& l, const range& r) { return l.lo < r.lo || (l.lo == r.lo && l.hi < r.hi); }
+  friend bool operator==(const range& l, const range& r) { return l.lo == r.lo && l.hi == r.hi; }
+};
+
+struct range_rep { int lo, hi; };
+
+struct mark_range : markable_dual_storage_type<mark_range, range, range_rep>
+{
+  static range_rep marked_value() noexcept { return range_rep{1, 0}; }
+  static bool is_marked_value(const range_rep& r) noexcept { return r.hi < r.lo; }
+};
+
+enum class color : int { red, green, blue, black };
+
+namespace std
+{
+  template <> struct hash<range>
+  {
+    typedef std::size_t result_type;
+    typedef range argument_type;
+    std::size_t operator()(const range& r) const noexcept { return std::size_t(r.lo) * 31 + std::size_t(r.hi); }
+  };
+}
+
+// values for element i and their contribution to a scan
+
+template <typename T> T value_at(std::uint32_t x);
+template <> int value_at<int>(std::uint32_t x) { return int(x >> 1); }
+template <> double value_at<double>(std::uint32_t x) { return double(x >> 1); }
+template <> bool value_at<bool>(std::uint32_t x) { return (x >> 7) & 1; }
+template <> color value_at<color>(std::uint32_t x) { return color((x >> 7) % 4); }
+template <> range value_at<range>(std::uint32_t x) { return range{int(x >> 2), int(x >> 2) + int(x & 3)}; }
+
+long long as_number(int v) { return v; }
+long long as_number(double v) { return (long long)v; }
+long long as_number(bool v) { return v; }
+long long as_number(color v) { return int(v); }
+long long as_number(const range& v) { return v.hi - v.lo; }
+
+template <typename M> struct hasher : std::hash<M> {};
+
+#ifdef AK_BENCH_HAS_BOOST_OPTIONAL
+template <typename T> struct hasher<boost::optional<T>>
+{
+  std::size_t operator()(const boost::optional<T>& o) const { return o ? std::hash<T>{}(*o) : 0; }
+};
+#endif
+
+std::uint32_t next_random(std::uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed;
+}
+
+// a third of the elements have no value
+template <typename M, typename T>
+M element_at(std::uint32_t x)
+{
+  return (x >> 24) % 3 == 0 ? M() : M(value_at<T>(x));
+}
+
+volatile long long sink;
+
+class cache_miss_counter
+{
+  int _fd;
+
+public:
+  cache_miss_counter() : _fd(-1)
+  {
+#if defined __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof attr;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+  }
+  ~cache_miss_counter()
+  {
+#if defined __linux__
+    if (_fd >= 0)
+      close(_fd);
+#endif
+  }
+  cache_miss_counter(const cache_miss_counter&) = delete;
+  cache_miss_counter& operator=(const cache_miss_counter&) = delete;
+
+  bool available() const { return _fd >= 0; }
+
+  long long read_count() const
+  {
+    long long count = 0;
+#if defined __linux__
+    if (_fd >= 0 && ::read(_fd, &count, sizeof count) != sizeof count)
+      count = 0;
+#endif
+    return count;
+  }
+};
+
+cache_miss_counter misses;
+
+struct sample
+{
+  double ns;
+  double misses;
+};
+
+// Runs prepare() untimed and run() timed, until about 2^24 elements have been processed.
+template <typename Prepare, typename Run>
+sample measure(std::size_t n, Prepare prepare, Run run)
+{
+  const std::size_t repeats = std::max<std::size_t>(1, (std::size_t(1) << 24) / n);
+  double ns = 0;
+  long long miss_count = 0;
+  for (std::size_t r = 0; r != repeats; ++r)
+  {
+    prepare();
+    long long m0 = misses.read_count();
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    miss_count += misses.read_count() - m0;
+    ns += d.count();
+  }
+  return sample{ ns / double(n * repeats), double(miss_count) / double(n * repeats) };
+}
+
+template <typename M, typename T>
+void run(const char* policy, const char* impl, std::size_t n)
+{
+  std::vector<M> v (n), w (n);
+  std::uint32_t seed = 12345;
+  std::vector<std::uint32_t> xs (n);
+  for (std::uint32_t& x : xs)
+    x = next_random(seed);
+
+  sample s[7];
+
+  s[0] = measure(n, []{}, [&] {
+    for (std::size_t i = 0; i != n; ++i)
+      v[i] = element_at<M, T>(xs[i]);
+  });
+
+  s[1] = measure(n, []{}, [&] {
+    long long count = 0, sum = 0;
+    for (const M& m : v)
+      if (m.has_value())
+      {
+        ++count;
+        sum += as_number(m.value());
+      }
+    sink = count + sum;
+  });
+
+  s[2] = measure(n, [&] { w = v; }, [&] {
+    std::sort(w.begin(), w.end());
+  });
+
+  s[3] = measure(n, []{}, [&] {
+    std::size_t h = 0;
+    for (const M& m : v)
+      h += hasher<M>{}(m);
+    sink = (long long)h;
+  });
+
+  s[4] = measure(n, []{}, [&] {
+    std::copy(v.begin(), v.end(), w.begin());
+  });
+
+  s[5] = measure(n, []{}, [&] {
+    std::move(v.begin(), v.end(), w.begin());
+  });
+
+  // the map holds at most 2^20 elements; every element of v is looked up
+  const std::uint32_t keys = std::uint32_t(std::min<std::size_t>(n, std::size_t(1) << 20));
+  std::unordered_map<std::uint32_t, M> map;
+  for (std::uint32_t k = 0; k != keys; ++k)
+    map.emplace(k, v[k]);
+
+  s[6] = measure(n, []{}, [&] {
+    long long found = 0;
+    for (std::uint32_t x : xs)
+    {
+      auto it = map.find(x % keys);
+      found += it != map.end() && it->second.has_value();
+    }
+    sink = found;
+  });
+
+  std::printf("%-7s %-16s %4zu %9zu %9zu", policy, impl, sizeof(M), n, n * sizeof(M) / 1024);
+  for (const sample& x : s)
+    std::printf(" %7.2f", x.ns);
+  std::printf("\n");
+
+  if (misses.available())
+  {
+    std::printf("%-7s %-16s %34s", "", "  misses/elem", "");
+    for (const sample& x : s)
+      std::printf(" %7.3f", x.misses);
+    std::printf("\n");
+  }
+}
+
+template <typename MP>
+void run_policy(const char* policy, std::size_t n)
+{
+  typedef typename MP::value_type T;
+  run<markable<MP, order_by_value>, T>(policy, "markable", n);
+  run<std::optional<T>, T>(policy, "std::optional", n);
+#ifdef AK_BENCH_HAS_BOOST_OPTIONAL
+  run<boost::optional<T>, T>(policy, "boost::optional", n);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+  // 8 KiB, 256 KiB, 4 MiB and 32 MiB of 4-byte markables
+  const std::size_t sizes[] = { 1 << 11, 1 << 16, 1 << 20, 1 << 23 };
+  const std::size_t max_elements = argc > 1 ? std::size_t(std::atoll(argv[1])) : sizes[3];
+
+  std::printf("ns/elem; a third of the elements have no value%s\n",
+              misses.available() ? "" : "; cache misses: n/a (perf_event_open unavailable)");
+  std::printf("%-7s %-16s %4s %9s %9s %7s %7s %7s %7s %7s %7s %7s\n",
+              "policy", "type", "B/el", "elements", "KiB", "fill", "scan", "sort", "hash", "copy", "move", "map");
+
+  for (std::size_t n : sizes)
+  {
+    if (n > max_elements)
+      break;
+    run_policy<mark_int<int, -1>>("int", n);
+    run_policy<mark_fp_nan<double>>("double", n);
+    run_policy<mark_bool>("bool", n);
+    run_policy<mark_enum<color, -1>>("enum", n);
+    run_policy<mark_range>("dual", n);
+  }
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// The algorithms of markable_parallel.hpp on columns much larger than the
+// cache, with 1 to N threads, where a fifth of the elements have no value.
+// Prints the throughput and the speedup over one thread.
+// Usage: bench_parallel [elements] [max threads]
+
+#include "../include/ak_toolkit/markable_parallel.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace ak_toolkit;
+
+volatile double sink;
+
+template <typename F>
+double seconds(F f)
+{
+  const int repeats = 5;
+  double best = 1e9;
+  for (int r = 0; r != repeats; ++r)
+  {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    best = d.count() < best ? d.count() : best;
+  }
+  return best;
+}
+
+template <typename F>
+void row(const char* name, unsigned threads, std::size_t bytes, double& base, F f)
+{
+  const double s = seconds(f);
+  if (threads == 1)
+    base = s;
+  std::printf("%-22s %3u threads  %7.2f GB/s  x%.2f\n", name, threads, double(bytes) / s * 1e-9, base / s);
+}
+
+int main(int argc, char** argv)
+{
+  const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : std::size_t(1) << 25;
+  const unsigned max_threads = argc > 2 ? unsigned(std::atoi(argv[2])) : markable_thread_pool::default_thread_count();
+
+  typedef mark_int<std::int32_t, -1> IP;
+  typedef mark_fp_nan<double> DP;
+  std::vector<std::int32_t> ints (n);
+  std::vector<double> doubles (n);
+  std::uint32_t seed = 1;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    const bool has = (seed >> 8) % 5 != 0;
+    ints[i] = has ? std::int32_t(seed >> 12) : -1;
+    doubles[i] = has ? double(seed >> 12) : std::numeric_limits<double>::quiet_NaN();
+  }
+  std::vector<std::int32_t> dense (n);
+  std::vector<double> scaled (n);
+
+  std::vector<unsigned> thread_counts;
+  for (unsigned t = 1; t < max_threads; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  double base[6] = {};
+  for (unsigned t : thread_counts)
+  {
+    markable_thread_pool pool (t);
+    row("summarize int32", t, n * 4, base[0], [&] { sink = double(parallel_summarize<IP>(pool, ints.data(), n).sum); });
+    row("summarize double", t, n * 8, base[1], [&] { sink = parallel_summarize<DP>(pool, doubles.data(), n).sum; });
+    row("count_values double", t, n * 8, base[2], [&] { sink = double(parallel_count_values<DP>(pool, doubles.data(), n)); });
+    row("fill double", t, n * 8, base[3], [&] { parallel_fill<DP>(pool, scaled.data(), n, 1.0); sink = scaled[n / 2]; });
+    row("transform int32>double", t, n * 12, base[4], [&] {
+      parallel_transform(pool, const_markable_span<IP>(ints.data(), n), markable_span<DP>(scaled.data(), n),
+                         [](markable_cref<IP> r) { return r.has_value() ? markable<DP>(r.value() * 0.5) : markable<DP>(); });
+      sink = scaled[n / 2];
+    });
+    row("compact_values int32", t, n * 8, base[5], [&] { sink = double(parallel_compact_values<IP>(pool, ints.data(), n, dense.data())); });
+  }
+}
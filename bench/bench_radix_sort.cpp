@@ -0,0 +1,63 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// radix_sort() and stable_radix_sort() against std::sort with less_by_value,
+// on columns where a fifth of the elements have no value.
+// Usage: bench_radix_sort [elements]
+
+#include "../include/ak_toolkit/markable_sort.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace ak_toolkit;
+
+template <typename F>
+double ns_per_element(F f, std::size_t n)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / double(n);
+}
+
+template <typename MP>
+void run(const char* name, std::size_t n)
+{
+  typedef typename MP::representation_type rep_t;
+  typedef markable<MP, order_by_value> opt_t;
+
+  std::vector<rep_t> column;
+  std::uint64_t seed = 12345;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    column.push_back((seed >> 40) % 5 == 0 ? MP::marked_value() : rep_t(seed >> 20));
+  }
+
+  std::vector<opt_t> objects;
+  for (rep_t r : column)
+    objects.push_back(opt_t(with_representation, r));
+  std::vector<rep_t> a = column, b = column;
+
+  double t_std = ns_per_element([&] { std::sort(objects.begin(), objects.end(), less_by_value{}); }, n);
+  double t_radix = ns_per_element([&] { radix_sort<MP>(a.data(), n); }, n);
+  double t_stable = ns_per_element([&] { stable_radix_sort<MP>(b.data(), n); }, n);
+
+  std::printf("%-8s std::sort %7.2f ns/elem   radix_sort %7.2f ns/elem   stable_radix_sort %7.2f ns/elem\n",
+              name, t_std, t_radix, t_stable);
+}
+
+int main(int argc, char** argv)
+{
+  const std::size_t n = argc > 1 ? std::size_t(std::atoll(argv[1])) : std::size_t(1) << 24;
+  run<mark_int<std::uint32_t, 0xFFFFFFFFu>>("uint32", n);
+  run<mark_int<std::int64_t, -1>>("int64", n);
+  run<mark_fp_nan<double>>("double", n);
+}
@@ -0,0 +1,93 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares value_or() against a branch on has_value() for columns with
+// different null patterns. A branch-free value_or() takes the same time
+// regardless of the pattern; a branch suffers on randomly null data.
+
+#include "../include/ak_toolkit/markable.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef markable<mark_int<int, -1>> opt_int;
+typedef markable<mark_fp_nan<double>> opt_double;
+
+template <typename M>
+std::vector<M> make_column(std::size_t n, unsigned null_percent)
+{
+  std::vector<M> v;
+  std::uint32_t seed = 12345;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    if ((seed >> 8) % 100 < null_percent)
+      v.push_back(M());
+    else
+      v.push_back(M(typename M::value_type(i % 1000)));
+  }
+  return v;
+}
+
+template <typename M, typename V>
+__attribute__((noinline)) V sum_value_or(const std::vector<M>& v, V d)
+{
+  V s = 0;
+  for (const M& m : v)
+    s += m.value_or(d);
+  return s;
+}
+
+template <typename M, typename V>
+__attribute__((noinline)) V sum_branch(const std::vector<M>& v, V d)
+{
+  V s = 0;
+  for (const M& m : v)
+  {
+    // the empty asm statements keep the compiler from if-converting the branch
+    if (m.has_value())
+      { s += m.value(); __asm__ volatile(""); }
+    else
+      { s += d; __asm__ volatile(""); }
+  }
+  return s;
+}
+
+template <typename F>
+double ns_per_element(F f, std::size_t n)
+{
+  const int repeats = 20;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r != repeats; ++r)
+    f();
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / (double(n) * repeats);
+}
+
+template <typename M>
+void run(const char* name)
+{
+  typedef typename M::value_type V;
+  const std::size_t n = 1 << 22;
+  volatile V sink = 0;
+
+  for (unsigned null_percent : {0u, 50u, 100u})
+  {
+    std::vector<M> v = make_column<M>(n, null_percent);
+    double t_or = ns_per_element([&] { sink = sink + sum_value_or(v, V(7)); }, n);
+    double t_br = ns_per_element([&] { sink = sink + sum_branch(v, V(7)); }, n);
+    std::printf("%-8s nulls %3u%%:  value_or %6.3f ns/elem   branch %6.3f ns/elem\n", name, null_percent, t_or, t_br);
+  }
+}
+
+int main()
+{
+  run<opt_int>("int");
+  run<opt_double>("double");
+}
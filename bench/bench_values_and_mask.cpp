@@ -0,0 +1,63 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Throughput of to_values_and_mask() and from_values_and_mask() at every
+// SIMD level, on columns where a third of the elements have no value.
+
+#include "../include/ak_toolkit/markable_mask.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace ak_toolkit;
+
+template <typename F>
+double ns_per_element(F f, std::size_t n)
+{
+  const int repeats = 20;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r != repeats; ++r)
+    f();
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / (double(n) * repeats);
+}
+
+template <typename MP>
+void run(const char* name)
+{
+  typedef typename MP::representation_type rep_t;
+  const std::size_t n = 1 << 22;
+  const char* level_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+  std::vector<rep_t> column;
+  std::uint32_t seed = 12345;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    column.push_back((seed >> 8) % 3 == 0 ? MP::marked_value() : rep_t(i % 2));
+  }
+  std::vector<rep_t> values (n), back (n);
+  std::vector<std::uint64_t> mask ((n + 63) / 64);
+
+  for (simd_level level : { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 })
+  {
+    if (level > detected_simd_level())
+      break;
+    double t_to = ns_per_element([&] { to_values_and_mask<MP>(column.data(), n, values.data(), mask.data(), rep_t(), level); }, n);
+    double t_from = ns_per_element([&] { from_values_and_mask<MP>(values.data(), mask.data(), n, back.data(), level); }, n);
+    std::printf("%-8s %-7s to_values_and_mask %6.3f ns/elem   from_values_and_mask %6.3f ns/elem\n",
+                name, level_names[int(level)], t_to, t_from);
+  }
+}
+
+int main()
+{
+  run<mark_bool>("bool");
+  run<mark_int<std::int16_t, -1>>("int16");
+  run<mark_int<int, -1>>("int32");
+  run<mark_fp_nan<double>>("double");
+}
@@ -0,0 +1,154 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_ATOMIC_MARKABLE_HEADER_GUARD_
+#define AK_TOOLBOX_ATOMIC_MARKABLE_HEADER_GUARD_
+
+#include "markable.hpp"
+#include <atomic>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// An atomic_markable<MP, OP> is an std::atomic<MP::representation_type>
+// observed as a markable<MP, OP>. The marked value is an ordinary state of
+// the atomic word, so a slot can be claimed with a single CAS.
+
+namespace detail_ {
+
+template <typename T>
+struct is_lock_free_representation : ::std::integral_constant<bool,
+  ::std::is_trivially_copyable<T>::value &&
+  (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+#if defined __cpp_lib_atomic_is_always_lock_free
+  && ::std::atomic<T>::is_always_lock_free
+#endif
+  >
+{
+};
+
+} // namespace detail_
+
+template <typename MP, typename OP = order_none>
+class atomic_markable
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "atomic_markable requires storage_type to be the same as representation_type");
+  static_assert (detail_::is_lock_free_representation<typename MP::representation_type>::value,
+                 "atomic_markable requires a representation_type with a lock-free std::atomic");
+public:
+  typedef typename MP::value_type value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef markable<MP, OP> optional_type;
+
+private:
+  std::atomic<representation_type> _rep;
+
+  static representation_type rep_of(const value_type& v) { return representation_type(MP::store_value(v)); }
+
+public:
+  atomic_markable() AK_TOOLKIT_NOEXCEPT : _rep(MP::marked_value()) {}
+  explicit atomic_markable(const optional_type& m) AK_TOOLKIT_NOEXCEPT : _rep(m.representation_value()) {}
+  atomic_markable(const atomic_markable&) = delete;
+  atomic_markable& operator=(const atomic_markable&) = delete;
+
+  bool is_lock_free() const AK_TOOLKIT_NOEXCEPT { return _rep.is_lock_free(); }
+
+  optional_type load(std::memory_order mo = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+    { return optional_type(with_representation, _rep.load(mo)); }
+
+  bool has_value(std::memory_order mo = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+    { return !MP::is_marked_value(_rep.load(mo)); }
+
+  void store(const optional_type& m, std::memory_order mo = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+    { _rep.store(m.representation_value(), mo); }
+
+  void clear(std::memory_order mo = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+    { _rep.store(MP::marked_value(), mo); }
+
+  optional_type exchange(const optional_type& m, std::memory_order mo = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+    { return optional_type(with_representation, _rep.exchange(m.representation_value(), mo)); }
+
+  // On failure, expected is updated with the current state, as in std::atomic.
+  // The representations are compared bitwise.
+
+  bool compare_exchange_weak(optional_type& expected, const optional_type& desired,
+                             std::memory_order success, std::memory_order failure) AK_TOOLKIT_NOEXCEPT
+  {
+    representation_type r = expected.representation_value();
+    const bool ans = _rep.compare_exchange_weak(r, desired.representation_value(), success, failure);
+    expected.assign_representation(r);
+    return ans;
+  }
+
+  bool compare_exchange_weak(optional_type& expected, const optional_type& desired,
+                             std::memory_order mo = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    representation_type r = expected.representation_value();
+    const bool ans = _rep.compare_exchange_weak(r, desired.representation_value(), mo);
+    expected.assign_representation(r);
+    return ans;
+  }
+
+  bool compare_exchange_strong(optional_type& expected, const optional_type& desired,
+                               std::memory_order success, std::memory_order failure) AK_TOOLKIT_NOEXCEPT
+  {
+    representation_type r = expected.representation_value();
+    const bool ans = _rep.compare_exchange_strong(r, desired.representation_value(), success, failure);
+    expected.assign_representation(r);
+    return ans;
+  }
+
+  bool compare_exchange_strong(optional_type& expected, const optional_type& desired,
+                               std::memory_order mo = std::memory_order_seq_cst) AK_TOOLKIT_NOEXCEPT
+  {
+    representation_type r = expected.representation_value();
+    const bool ans = _rep.compare_exchange_strong(r, desired.representation_value(), mo);
+    expected.assign_representation(r);
+    return ans;
+  }
+
+  // Stores v only if there is currently no value (any marked value, for
+  // multi-marked policies). Returns true if this call stored v.
+  bool try_claim(const value_type& v, std::memory_order success = std::memory_order_seq_cst,
+                 std::memory_order failure = std::memory_order_relaxed)
+  {
+    const representation_type desired = rep_of(v);
+    representation_type current = _rep.load(failure);
+    while (MP::is_marked_value(current))
+      if (_rep.compare_exchange_weak(current, desired, success, failure))
+        return true;
+    return false;
+  }
+
+#if defined __cpp_lib_atomic_wait
+  // Blocks while the state is bitwise equal to old.
+  void wait(const optional_type& old, std::memory_order mo = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+    { _rep.wait(old.representation_value(), mo); }
+
+  // Blocks until there is a value, i.e., until the marked -> value transition.
+  optional_type wait_for_value(std::memory_order mo = std::memory_order_seq_cst) const AK_TOOLKIT_NOEXCEPT
+  {
+    representation_type current = _rep.load(mo);
+    while (MP::is_marked_value(current))
+    {
+      _rep.wait(current, mo);
+      current = _rep.load(mo);
+    }
+    return optional_type(with_representation, current);
+  }
+
+  void notify_one() AK_TOOLKIT_NOEXCEPT { _rep.notify_one(); }
+  void notify_all() AK_TOOLKIT_NOEXCEPT { _rep.notify_all(); }
+#endif
+};
+
+} // namespace markable_ns
+
+using markable_ns::atomic_markable;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_ATOMIC_MARKABLE_HEADER_GUARD_
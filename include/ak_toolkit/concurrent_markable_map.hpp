@@ -0,0 +1,502 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_CONCURRENT_MARKABLE_MAP_HEADER_GUARD_
+#define AK_TOOLBOX_CONCURRENT_MARKABLE_MAP_HEADER_GUARD_
+
+#include "atomic_markable.hpp"
+#include "markable_hash.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// A concurrent hash map with open addressing and linear probing. Each bucket
+// is a pair of atomic words: the key and the value representations. The key
+// policy reserves three values:
+//   marked_value(0): an empty bucket,
+//   marked_value(1): an erased key (a tombstone),
+//   marked_value(2): a bucket that has been migrated to a bigger table.
+// A key word only changes: empty -> key -> tombstone, and any -> migrated.
+// The value is published after the key is claimed; the marked value of VMP
+// means "not published yet". Once published, a value never changes.
+//
+// When a table becomes 3/4 full, all threads that modify it cooperatively
+// migrate it, chunk by chunk, to a new table. A key is copied after its
+// bucket is frozen, so before freezing it the migrating thread announces the
+// key and its bucket in a per-chunk record. find() never waits: it reads a
+// frozen key that is announced from the old bucket, and otherwise looks in
+// the new table, where an unannounced key has already been copied. insert()
+// and erase() are not lock-free: when they meet a migration they wait until
+// every chunk has been migrated, so a thread descheduled in the middle of a
+// chunk delays them.
+//
+// Migrated tables are reclaimed with epochs. Each operation registers in the
+// counter of the current epoch. A table retired in epoch e is freed once the
+// epoch reaches e + 2: the epoch only advances from e to e + 1 when no
+// operation of epoch e - 1 is running, so by then no operation that could
+// have seen the table is left.
+
+namespace detail_ {
+
+template <typename KR, typename VR>
+struct concurrent_slot
+{
+  std::atomic<KR> key;
+  std::atomic<VR> value;
+};
+
+// The live key that the thread migrating a chunk has frozen or is about to
+// freeze, and its bucket. The key is empty when there is none.
+template <typename KR>
+struct migrating_key
+{
+  std::atomic<KR> key;
+  std::atomic<std::size_t> index;
+};
+
+template <typename KR, typename VR>
+struct concurrent_table
+{
+  typedef concurrent_slot<KR, VR> slot_type;
+  static const std::size_t chunk_size = 1024;
+
+  const std::size_t capacity;             // a power of two
+  const unsigned shift;                   // 64 - log2(capacity)
+  std::unique_ptr<slot_type[]> slots;
+  std::atomic<std::size_t> claimed;       // non-empty buckets, including tombstones
+  std::atomic<concurrent_table*> next;    // the table we migrate to
+  std::atomic<std::size_t> next_chunk;    // the next chunk to be migrated
+  std::atomic<std::size_t> done_chunks;
+  std::unique_ptr<migrating_key<KR>[]> migrating; // one per chunk
+  concurrent_table* retired_next;         // the list of retired tables
+  std::size_t retired_epoch;
+
+  static unsigned shift_for(std::size_t cap)
+  {
+    unsigned s = 64;
+    while (cap > 1) { cap /= 2; --s; }
+    return s;
+  }
+
+  concurrent_table(std::size_t cap, KR empty, VR none)
+    : capacity(cap), shift(shift_for(cap)), slots(new slot_type[cap]),
+      claimed(0), next(nullptr), next_chunk(0), done_chunks(0),
+      migrating(new migrating_key<KR>[chunk_count()]), retired_next(nullptr), retired_epoch(0)
+  {
+    for (std::size_t i = 0; i != cap; ++i)
+    {
+      slots[i].key.store(empty, std::memory_order_relaxed);
+      slots[i].value.store(none, std::memory_order_relaxed);
+    }
+    for (std::size_t c = 0; c != chunk_count(); ++c)
+    {
+      migrating[c].key.store(empty, std::memory_order_relaxed);
+      migrating[c].index.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::size_t chunk_count() const AK_TOOLKIT_NOEXCEPT { return (capacity + chunk_size - 1) / chunk_size; }
+  std::size_t next_index(std::size_t i) const AK_TOOLKIT_NOEXCEPT { return (i + 1) & (capacity - 1); }
+  bool too_full() const AK_TOOLKIT_NOEXCEPT { return claimed.load(std::memory_order_relaxed) >= capacity - capacity / 4; }
+};
+
+} // namespace detail_
+
+template <typename MP, typename V, typename VMP = typename default_mark_policy<V>::type, typename Hash = hash_by_representation>
+class concurrent_markable_map
+{
+  static_assert (is_multi_mark_policy<MP>::value && MP::marked_value_count() >= 3,
+                 "concurrent_markable_map requires a key policy with at least three marked values");
+  static_assert (is_columnar_mark_policy<MP>::value && is_columnar_mark_policy<VMP>::value,
+                 "concurrent_markable_map requires storage_type to be the same as representation_type");
+  static_assert (detail_::is_lock_free_representation<typename MP::representation_type>::value &&
+                 detail_::is_lock_free_representation<typename VMP::representation_type>::value,
+                 "concurrent_markable_map requires representations with a lock-free std::atomic");
+public:
+  typedef typename MP::value_type key_type;
+  typedef typename VMP::value_type mapped_type;
+  typedef markable<VMP> optional_mapped_type;
+  typedef std::size_t size_type;
+
+private:
+  typedef typename MP::representation_type key_rep;
+  typedef typename VMP::representation_type value_rep;
+  typedef detail_::concurrent_table<key_rep, value_rep> table_type;
+  typedef typename table_type::slot_type slot_type;
+
+  mutable std::atomic<table_type*> _current;   // replaced by help_migrate()
+  mutable std::atomic<table_type*> _retired;   // migrated tables not yet freed
+  mutable std::atomic<std::size_t> _epoch;
+  mutable std::atomic<std::size_t> _active[2]; // running operations, by the parity of their epoch
+  std::atomic<std::ptrdiff_t> _size;
+  Hash _hash;
+
+  // registers an operation for its duration, so that the tables it sees are not freed
+  class operation_guard
+  {
+    const concurrent_markable_map& _map;
+    std::size_t _epoch;
+
+  public:
+    explicit operation_guard(const concurrent_markable_map& m) : _map(m), _epoch(m.enter()) {}
+    ~operation_guard() { _map.leave(_epoch); }
+    operation_guard(const operation_guard&) = delete;
+    operation_guard& operator=(const operation_guard&) = delete;
+  };
+
+  std::size_t enter() const AK_TOOLKIT_NOEXCEPT
+  {
+    for (;;)
+    {
+      const std::size_t e = _epoch.load(std::memory_order_seq_cst);
+      _active[e & 1].fetch_add(1, std::memory_order_seq_cst);
+      if (_epoch.load(std::memory_order_seq_cst) == e)
+        return e;
+      _active[e & 1].fetch_sub(1, std::memory_order_seq_cst);
+    }
+  }
+
+  void leave(std::size_t e) const AK_TOOLKIT_NOEXCEPT
+  {
+    _active[e & 1].fetch_sub(1, std::memory_order_seq_cst);
+    if (_retired.load(std::memory_order_relaxed) != nullptr)
+      reclaim();
+  }
+
+  // Called by the one thread that replaced t with t->next in _current. An
+  // operation that loaded t from _current entered no later than this epoch.
+  void retire(table_type* t) const AK_TOOLKIT_NOEXCEPT
+  {
+    t->retired_epoch = _epoch.load(std::memory_order_seq_cst);
+    push_retired(t);
+  }
+
+  void push_retired(table_type* t) const AK_TOOLKIT_NOEXCEPT
+  {
+    t->retired_next = _retired.load(std::memory_order_relaxed);
+    while (!_retired.compare_exchange_weak(t->retired_next, t, std::memory_order_release, std::memory_order_relaxed))
+      {}
+  }
+
+  // advances the epoch if no operation of the previous one is running, and
+  // frees the tables retired two epochs ago
+  void reclaim() const AK_TOOLKIT_NOEXCEPT
+  {
+    std::size_t e = _epoch.load(std::memory_order_seq_cst);
+    if (_active[(e + 1) & 1].load(std::memory_order_seq_cst) == 0 &&
+        _epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst))
+      ++e;
+
+    table_type* t = _retired.exchange(nullptr, std::memory_order_acquire);
+    while (t != nullptr)
+    {
+      table_type* r = t->retired_next;
+      if (t->retired_epoch + 2 <= e)
+        delete t;
+      else
+        push_retired(t);
+      t = r;
+    }
+  }
+
+  static key_rep empty_key() { return MP::marked_value(std::size_t(0)); }
+  static key_rep erased_key() { return MP::marked_value(std::size_t(1)); }
+  static key_rep moved_key() { return MP::marked_value(std::size_t(2)); }
+
+  static table_type* new_table(size_type cap) { return new table_type(cap, empty_key(), VMP::marked_value()); }
+
+  size_type home(const table_type* t, key_rep k) const
+  {
+    return size_type(fibonacci_hash::hash_bits(std::uint64_t(_hash(markable<MP>(with_representation, k)))) >> t->shift);
+  }
+
+  // Finishes the migration of t, helping other threads. Afterwards t->next
+  // holds every key that t held.
+  void help_migrate(table_type* t) const
+  {
+    table_type* n = t->next.load(std::memory_order_acquire);
+    if (n == nullptr)
+    {
+      // the new table is bigger, unless most buckets are tombstones
+      const std::ptrdiff_t live = _size.load(std::memory_order_relaxed);
+      const size_type cap = std::size_t(live) < t->capacity / 4 ? t->capacity : t->capacity * 2;
+      std::unique_ptr<table_type> candidate (new_table(cap));
+      if (t->next.compare_exchange_strong(n, candidate.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+        n = candidate.release();
+    }
+
+    const size_type chunks = t->chunk_count();
+    for (size_type c; (c = t->next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks; )
+    {
+      migrate_chunk(t, n, c);
+      t->done_chunks.fetch_add(1, std::memory_order_acq_rel);
+    }
+    while (t->done_chunks.load(std::memory_order_acquire) < chunks)
+      std::this_thread::yield();
+
+    table_type* expected = t;
+    if (_current.compare_exchange_strong(expected, n, std::memory_order_seq_cst, std::memory_order_acquire))
+      retire(t);
+  }
+
+  void migrate_chunk(table_type* t, table_type* n, size_type c) const
+  {
+    detail_::migrating_key<key_rep>& m = t->migrating[c];
+    const size_type end = (c + 1) * table_type::chunk_size < t->capacity ? (c + 1) * table_type::chunk_size : t->capacity;
+    for (size_type i = c * table_type::chunk_size; i != end; ++i)
+    {
+      slot_type& s = t->slots[i];
+      key_rep k = s.key.load(std::memory_order_acquire);
+      for (;;)
+      {
+        const bool live = !MP::is_marked_value(k);
+        if (live)
+        {
+          m.index.store(i, std::memory_order_seq_cst);
+          m.key.store(k, std::memory_order_seq_cst);
+        }
+        // freeze the key: a value published before this point is seen below
+        if (s.key.compare_exchange_strong(k, moved_key(), std::memory_order_seq_cst, std::memory_order_acquire))
+          break;
+        // erased concurrently: withdraw the announcement before the tombstone is frozen
+        if (live)
+          m.key.store(empty_key(), std::memory_order_seq_cst);
+      }
+      if (!MP::is_marked_value(k))
+      {
+        copy_into(n, k, s.value.load(std::memory_order_seq_cst));
+        m.key.store(empty_key(), std::memory_order_seq_cst);
+      }
+    }
+  }
+
+  // Whether the frozen bucket i of t held k. If the bucket was frozen with k,
+  // k is announced until it has been copied; if it was frozen with another
+  // key word, the announcement of k (if any) was withdrawn before that.
+  bool is_migrating(const table_type* t, size_type i, key_rep k) const
+  {
+    const detail_::migrating_key<key_rep>& m = t->migrating[i / table_type::chunk_size];
+    return m.key.load(std::memory_order_seq_cst) == k &&
+           m.index.load(std::memory_order_seq_cst) == i &&
+           m.key.load(std::memory_order_seq_cst) == k;
+  }
+
+  // only called during migration: n contains neither k nor migrated buckets
+  void copy_into(table_type* n, key_rep k, value_rep v) const
+  {
+    for (size_type i = home(n, k); ; i = n->next_index(i))
+    {
+      key_rep cur = empty_key();
+      if (n->slots[i].key.compare_exchange_strong(cur, k, std::memory_order_acq_rel, std::memory_order_acquire))
+      {
+        n->claimed.fetch_add(1, std::memory_order_relaxed);
+        value_rep none = VMP::marked_value();
+        n->slots[i].value.compare_exchange_strong(none, v, std::memory_order_acq_rel, std::memory_order_acquire);
+        return;
+      }
+    }
+  }
+
+  // Finds the bucket holding k, following migrations. Returns nullptr if k is absent.
+  slot_type* locate(table_type*& t, key_rep k) const
+  {
+    for (;;)
+    {
+      bool moved = false;
+      size_type i = home(t, k);
+      for (size_type probes = 0; probes != t->capacity; ++probes, i = t->next_index(i))
+      {
+        const key_rep cur = t->slots[i].key.load(std::memory_order_acquire);
+        if (cur == k)
+          return &t->slots[i];
+        if (cur == empty_key())
+          return nullptr;
+        if (cur == moved_key())
+        {
+          moved = true;
+          break;
+        }
+      }
+      if (!moved)
+        return nullptr;
+      help_migrate(t);
+      t = t->next.load(std::memory_order_acquire);
+    }
+  }
+
+  // Stores the value of a freshly claimed key. If the bucket got migrated
+  // in the meantime, the value is also stored in the new table.
+  void publish(table_type* t, slot_type* s, key_rep k, value_rep v) const
+  {
+    s->value.store(v, std::memory_order_seq_cst);
+    while (s->key.load(std::memory_order_seq_cst) == moved_key())
+    {
+      help_migrate(t);
+      t = t->next.load(std::memory_order_acquire);
+      s = locate(t, k);
+      if (s == nullptr)
+        return; // erased in the meantime
+      value_rep none = VMP::marked_value();
+      s->value.compare_exchange_strong(none, v, std::memory_order_seq_cst, std::memory_order_acquire);
+    }
+  }
+
+public:
+  explicit concurrent_markable_map(size_type initial_capacity = 16, const Hash& hash = Hash())
+    : _current(nullptr), _retired(nullptr), _epoch(0), _size(0), _hash(hash)
+  {
+    _active[0].store(0, std::memory_order_relaxed);
+    _active[1].store(0, std::memory_order_relaxed);
+    size_type cap = 16;
+    while (cap - cap / 4 <= initial_capacity)
+      cap *= 2;
+    _current.store(new_table(cap), std::memory_order_release);
+  }
+
+  concurrent_markable_map(const concurrent_markable_map&) = delete;
+  concurrent_markable_map& operator=(const concurrent_markable_map&) = delete;
+
+  ~concurrent_markable_map()
+  {
+    for (table_type* t = _retired.load(std::memory_order_relaxed); t != nullptr; )
+    {
+      table_type* r = t->retired_next;
+      delete t;
+      t = r;
+    }
+    for (table_type* t = _current.load(std::memory_order_relaxed); t != nullptr; )
+    {
+      table_type* n = t->next.load(std::memory_order_relaxed);
+      delete t;
+      t = n;
+    }
+  }
+
+  // The number of keys; only exact when no modification is in progress.
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return size_type(_size.load(std::memory_order_relaxed)); }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return size() == 0; }
+  size_type bucket_count() const AK_TOOLKIT_NOEXCEPT
+  {
+    operation_guard g (*this);
+    return _current.load(std::memory_order_seq_cst)->capacity;
+  }
+
+  // Inserts (k, v) unless k is already present. Returns true if this call inserted k.
+  bool insert(const key_type& key, const mapped_type& val)
+  {
+    const key_rep k = MP::store_value(key);
+    const value_rep v = VMP::store_value(val);
+    AK_TOOLKIT_ASSERT(!MP::is_marked_value(k));
+    AK_TOOLKIT_ASSERT(!VMP::is_marked_value(v));
+
+    operation_guard g (*this);
+    table_type* t = _current.load(std::memory_order_seq_cst); // ordered after enter(): see retire()
+    for (;;)
+    {
+      bool help = t->too_full();
+      size_type i = home(t, k);
+      for (size_type probes = 0; !help; ++probes, i = t->next_index(i))
+      {
+        if (probes == t->capacity)
+        {
+          help = true;
+          break;
+        }
+        slot_type& s = t->slots[i];
+        key_rep cur = s.key.load(std::memory_order_acquire);
+        if (cur == empty_key() && s.key.compare_exchange_strong(cur, k, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+          t->claimed.fetch_add(1, std::memory_order_relaxed);
+          publish(t, &s, k, v);
+          _size.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+        if (cur == k)
+          return false;
+        if (cur == moved_key())
+          help = true;
+      }
+      help_migrate(t);
+      t = t->next.load(std::memory_order_acquire);
+    }
+  }
+
+  // Has no value if k is absent or if its insertion has not yet been completed.
+  // Does not wait for migrations: frozen buckets are skipped, unless they are
+  // announced to hold k, and k is looked for in the new table afterwards.
+  optional_mapped_type find(const key_type& key) const
+  {
+    const key_rep k = MP::store_value(key);
+    operation_guard g (*this);
+    table_type* t = _current.load(std::memory_order_seq_cst); // ordered after enter(): see retire()
+    for (;;)
+    {
+      bool moved = false;
+      size_type i = home(t, k);
+      for (size_type probes = 0; probes != t->capacity; ++probes, i = t->next_index(i))
+      {
+        slot_type& s = t->slots[i];
+        key_rep cur = s.key.load(std::memory_order_seq_cst);
+        if (cur == k)
+        {
+          const value_rep v = s.value.load(std::memory_order_seq_cst);
+          if (!VMP::is_marked_value(v) || (cur = s.key.load(std::memory_order_seq_cst)) != moved_key())
+            return optional_mapped_type(with_representation, v);
+        }
+        if (cur == empty_key())
+          break;
+        if (cur == moved_key())
+        {
+          moved = true;
+          if (is_migrating(t, i, k))
+            return optional_mapped_type(with_representation, s.value.load(std::memory_order_seq_cst));
+        }
+      }
+      if (!moved)
+        return optional_mapped_type();
+      t = t->next.load(std::memory_order_acquire);
+    }
+  }
+
+  bool contains(const key_type& key) const { return find(key).has_value(); }
+
+  // Returns the number of erased keys (0 or 1).
+  size_type erase(const key_type& key)
+  {
+    const key_rep k = MP::store_value(key);
+    operation_guard g (*this);
+    table_type* t = _current.load(std::memory_order_seq_cst); // ordered after enter(): see retire()
+    for (;;)
+    {
+      slot_type* s = locate(t, k);
+      if (s == nullptr)
+        return 0;
+      key_rep cur = k;
+      if (s->key.compare_exchange_strong(cur, erased_key(), std::memory_order_acq_rel, std::memory_order_acquire))
+      {
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        return 1;
+      }
+      if (cur != moved_key())
+        return 0; // erased concurrently
+      help_migrate(t);
+      t = t->next.load(std::memory_order_acquire);
+    }
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::concurrent_markable_map;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_CONCURRENT_MARKABLE_MAP_HEADER_GUARD_
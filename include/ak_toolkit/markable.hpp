@@ -8,9 +8,13 @@
 #define AK_TOOLBOX_COMPACT_OPTIONAL_HEADER_GUARD_
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <utility>
 #include <limits>
+#include <memory>
 #include <new>
 #include <type_traits>
 #include <limits>
@@ -26,6 +30,8 @@
 #  define AK_TOOLKIT_CONSTEXPR_OR_CONST const
 #  define AK_TOOLKIT_EXPLICIT_CONV
 #  define AK_TOOLKIT_NOEXCEPT_AS(E)
+#  define AK_TOOLKIT_NOEXCEPT_IF(C)
+#  define AK_TOOLKIT_CONSTEXPR_NOCONST
 #else
 #  define AK_TOOLKIT_NOEXCEPT noexcept
 #  define AK_TOOLKIT_IS_NOEXCEPT(E) noexcept(E)
@@ -33,7 +39,21 @@
 #  define AK_TOOLKIT_CONSTEXPR_OR_CONST constexpr
 #  define AK_TOOLKIT_EXPLICIT_CONV explicit
 #  define AK_TOOLKIT_NOEXCEPT_AS(E) noexcept(noexcept(E))
-#  define AK_TOOLKIT_CONSTEXPR_NOCONST // fix in the future
+#  define AK_TOOLKIT_NOEXCEPT_IF(C) noexcept(C)
+#  if defined __cpp_constexpr && __cpp_constexpr >= 201304
+#    define AK_TOOLKIT_CONSTEXPR_NOCONST constexpr
+#  else
+#    define AK_TOOLKIT_CONSTEXPR_NOCONST
+#  endif
+#endif
+
+// In C++20 dual_storage can change the active member of its union during
+// constant evaluation (with std::construct_at and std::destroy_at).
+#if !defined AK_TOOLBOX_NO_ARVANCED_CXX11 && defined __cpp_lib_constexpr_dynamic_alloc && defined __cpp_lib_is_constant_evaluated
+#  define AK_TOOLKIT_CONSTEXPR_DUAL_STORAGE
+#  define AK_TOOLKIT_CONSTEXPR_CXX20 constexpr
+#else
+#  define AK_TOOLKIT_CONSTEXPR_CXX20
 #endif
 
 #ifndef AK_TOOLKIT_LIKELY
@@ -103,6 +123,19 @@ concept mark_policy =
       -> ::std::convertible_to<typename MP::storage_type>;
   };
 
+template <typename MP>
+concept multi_mark_policy =
+  mark_policy<MP> &&
+  requires(const typename MP::representation_type & cr, std::size_t i)
+  {
+    { MP::marked_value_count() }
+      -> ::std::convertible_to<std::size_t>;
+    { MP::marked_value(i) }
+      -> ::std::convertible_to<typename MP::representation_type>;
+    { MP::marked_index(cr) }
+      -> ::std::convertible_to<std::size_t>;
+  };
+
 # define AK_TOOLKIT_MARK_POLICY mark_policy
 # else
 # define AK_TOOLKIT_MARK_POLICY typename
@@ -119,12 +152,12 @@ struct markable_type
   typedef STOR storage_type;        // the type we use for storage
 
 
-  static AK_TOOLKIT_CONSTEXPR reference_type access_value(const storage_type& v) { return reference_type(v); }
-  static AK_TOOLKIT_CONSTEXPR const representation_type& representation(const storage_type& v) { return v; }
-  static AK_TOOLKIT_CONSTEXPR const storage_type& store_value(const value_type& v) { return v; }
-  static AK_TOOLKIT_CONSTEXPR storage_type&& store_value(value_type&& v) { return std::move(v); }
-  static AK_TOOLKIT_CONSTEXPR const storage_type& store_representation(const representation_type& v) { return v; }
-  static AK_TOOLKIT_CONSTEXPR storage_type&& store_representation(representation_type&& v) { return std::move(v); }
+  static AK_TOOLKIT_CONSTEXPR reference_type access_value(const storage_type& v) AK_TOOLKIT_NOEXCEPT_AS(reference_type(v)) { return reference_type(v); }
+  static AK_TOOLKIT_CONSTEXPR const representation_type& representation(const storage_type& v) AK_TOOLKIT_NOEXCEPT { return v; }
+  static AK_TOOLKIT_CONSTEXPR const storage_type& store_value(const value_type& v) AK_TOOLKIT_NOEXCEPT { return v; }
+  static AK_TOOLKIT_CONSTEXPR storage_type&& store_value(value_type&& v) AK_TOOLKIT_NOEXCEPT { return std::move(v); }
+  static AK_TOOLKIT_CONSTEXPR const storage_type& store_representation(const representation_type& v) AK_TOOLKIT_NOEXCEPT { return v; }
+  static AK_TOOLKIT_CONSTEXPR storage_type&& store_representation(representation_type&& v) AK_TOOLKIT_NOEXCEPT { return std::move(v); }
 };
 
 
@@ -135,6 +168,74 @@ struct mark_int : markable_type<T>
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT { return v == Val; }
 };
 
+namespace detail_ {
+
+template <typename T, T... Vals>
+struct value_list;
+
+template <typename T>
+struct value_list<T>
+{
+  static AK_TOOLKIT_CONSTEXPR bool contains(T) AK_TOOLKIT_NOEXCEPT { return false; }
+  static AK_TOOLKIT_CONSTEXPR std::size_t index_of(T) AK_TOOLKIT_NOEXCEPT { return 0; }
+  static AK_TOOLKIT_CONSTEXPR T at(std::size_t) AK_TOOLKIT_NOEXCEPT { return T(); }
+};
+
+template <typename T, T Head, T... Tail>
+struct value_list<T, Head, Tail...>
+{
+  typedef value_list<T, Tail...> tail;
+  static AK_TOOLKIT_CONSTEXPR bool contains(T v) AK_TOOLKIT_NOEXCEPT { return v == Head || tail::contains(v); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t index_of(T v) AK_TOOLKIT_NOEXCEPT { return v == Head ? 0 : 1 + tail::index_of(v); }
+  static AK_TOOLKIT_CONSTEXPR T at(std::size_t i) AK_TOOLKIT_NOEXCEPT { return i == 0 ? Head : tail::at(i - 1); }
+};
+
+inline unsigned popcount64(std::uint64_t w)
+{
+#if defined __GNUC__
+  return unsigned(__builtin_popcountll(w));
+#else
+  w = w - ((w >> 1) & 0x5555555555555555ull);
+  w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+  w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+  return unsigned((w * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+} // namespace detail_
+
+// Multi-marked policies reserve more than one value: marked_value(i) for i in
+// [0, marked_value_count()). marked_value() is the same as marked_value(0).
+
+template <typename T, T Val, T... Vals>
+struct mark_int_multi : markable_type<T>
+{
+  typedef detail_::value_list<T, Val, Vals...> values;
+
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_value_count() AK_TOOLKIT_NOEXCEPT { return 1 + sizeof...(Vals); }
+  static AK_TOOLKIT_CONSTEXPR T marked_value() AK_TOOLKIT_NOEXCEPT { return Val; }
+  static AK_TOOLKIT_CONSTEXPR T marked_value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(i < marked_value_count(), values::at(i)); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT { return values::contains(v); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_index(T v) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(is_marked_value(v), values::index_of(v)); }
+};
+
+// Offsets from Lo are computed in the unsigned type: Hi - Lo may not fit in T.
+template <typename T, T Lo, T Hi>
+struct mark_int_range : markable_type<T>
+{
+  typedef typename std::make_unsigned<T>::type offset_type;
+
+  static_assert(Lo <= Hi, "mark_int_range requires Lo <= Hi");
+  static_assert(offset_type(offset_type(Hi) - offset_type(Lo)) < std::numeric_limits<std::size_t>::max(),
+                "mark_int_range requires the number of marked values to fit in std::size_t");
+
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_value_count() AK_TOOLKIT_NOEXCEPT { return std::size_t(offset_type(offset_type(Hi) - offset_type(Lo))) + 1; }
+  static AK_TOOLKIT_CONSTEXPR T marked_value() AK_TOOLKIT_NOEXCEPT { return Lo; }
+  static AK_TOOLKIT_CONSTEXPR T marked_value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(i < marked_value_count(), T(offset_type(offset_type(Lo) + offset_type(i)))); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(T v) AK_TOOLKIT_NOEXCEPT { return Lo <= v && v <= Hi; }
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_index(T v) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(is_marked_value(v), std::size_t(offset_type(offset_type(v) - offset_type(Lo)))); }
+};
+
 template <typename FPT>
 struct mark_fp_nan : markable_type<FPT>
 {
@@ -175,8 +276,8 @@ struct mark_bool : markable_type<bool, char, bool>
   static AK_TOOLKIT_CONSTEXPR char marked_value() AK_TOOLKIT_NOEXCEPT { return char(2); }
   static AK_TOOLKIT_CONSTEXPR bool is_marked_value(char v) AK_TOOLKIT_NOEXCEPT { return v == 2; }
 
-  static AK_TOOLKIT_CONSTEXPR bool access_value(const char& v) { return bool(v); }
-  static AK_TOOLKIT_CONSTEXPR char store_value(const bool& v) { return v; }
+  static AK_TOOLKIT_CONSTEXPR bool access_value(const char& v) AK_TOOLKIT_NOEXCEPT { return bool(v); }
+  static AK_TOOLKIT_CONSTEXPR char store_value(const bool& v) AK_TOOLKIT_NOEXCEPT { return v; }
 };
 
 
@@ -206,9 +307,105 @@ struct mark_enum : markable_type<Enum, int, Enum>
 
 namespace detail_ {
 
+template <typename Ptr, std::uintptr_t Addr>
+struct pointer_at_address
+{
+  static Ptr get() AK_TOOLKIT_NOEXCEPT { return reinterpret_cast<Ptr>(Addr); }
+};
+
+template <typename Ptr>
+struct pointer_at_address<Ptr, 0>
+{
+  static AK_TOOLKIT_CONSTEXPR Ptr get() AK_TOOLKIT_NOEXCEPT { return nullptr; }
+};
+
+// Whether the Bits low bits of every T* are zero. Pointers to void are trusted.
+template <typename T, unsigned Bits, bool = ::std::is_void<T>::value>
+struct has_spare_low_bits : ::std::integral_constant<bool, (::std::alignment_of<T>::value >> Bits) != 0> {};
+
+template <typename T, unsigned Bits>
+struct has_spare_low_bits<T, Bits, true> : ::std::true_type {};
+
+} // namespace detail_
+
+// A pointer that has no value when it is equal to address Addr: nullptr by default.
+template <typename Ptr, std::uintptr_t Addr = 0>
+struct mark_ptr : markable_type<Ptr>
+{
+  static_assert(std::is_pointer<Ptr>::value, "mark_ptr only works with pointer types");
+
+  static AK_TOOLKIT_CONSTEXPR Ptr marked_value() AK_TOOLKIT_NOEXCEPT { return detail_::pointer_at_address<Ptr, Addr>::get(); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(Ptr v) AK_TOOLKIT_NOEXCEPT { return v == marked_value(); }
+};
+
+// A pointer stored as an integer, where every representation with any of the
+// Bits low bits set is marked. Thus nullptr is a valid value, and there are
+// 2^Bits - 1 marked values. The pointee must be aligned to at least 2^Bits.
+template <typename Ptr, unsigned Bits>
+struct mark_aligned_ptr : markable_type<Ptr, std::uintptr_t, Ptr>
+{
+  static_assert(std::is_pointer<Ptr>::value, "mark_aligned_ptr only works with pointer types");
+  static_assert(Bits >= 1 && Bits < 8, "mark_aligned_ptr requires 1 <= Bits < 8");
+
+  static AK_TOOLKIT_CONSTEXPR std::uintptr_t low_bits() AK_TOOLKIT_NOEXCEPT { return (std::uintptr_t(1) << Bits) - 1; }
+
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_value_count() AK_TOOLKIT_NOEXCEPT { return std::size_t(low_bits()); }
+  static AK_TOOLKIT_CONSTEXPR std::uintptr_t marked_value() AK_TOOLKIT_NOEXCEPT { return 1; }
+  static AK_TOOLKIT_CONSTEXPR std::uintptr_t marked_value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(i < marked_value_count(), std::uintptr_t(i) + 1); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(std::uintptr_t v) AK_TOOLKIT_NOEXCEPT { return (v & low_bits()) != 0; }
+  static AK_TOOLKIT_CONSTEXPR std::size_t marked_index(std::uintptr_t v) AK_TOOLKIT_NOEXCEPT { return AK_TOOLKIT_ASSERTED_EXPRESSION(is_marked_value(v), std::size_t(v & low_bits()) - 1); }
+
+  static Ptr access_value(const std::uintptr_t& v) AK_TOOLKIT_NOEXCEPT { return reinterpret_cast<Ptr>(v); }
+  static std::uintptr_t store_value(const Ptr& p) AK_TOOLKIT_NOEXCEPT
+  {
+    static_assert(detail_::has_spare_low_bits<typename std::remove_pointer<Ptr>::type, Bits>::value, "the pointee is not aligned enough for mark_aligned_ptr");
+    return AK_TOOLKIT_ASSERTED_EXPRESSION((reinterpret_cast<std::uintptr_t>(p) & low_bits()) == 0, reinterpret_cast<std::uintptr_t>(p));
+  }
+};
+
+namespace detail_ {
+
+namespace swap_ns {
+
+using std::swap;
+
+template <typename T>
+struct is_nothrow_swappable : ::std::integral_constant<bool, AK_TOOLKIT_IS_NOEXCEPT(swap(::std::declval<T&>(), ::std::declval<T&>()))>
+{
+};
+
+} // namespace swap_ns
+
+using swap_ns::is_nothrow_swappable;
+
 struct _init_nothing_tag {};
 
+template <typename T, typename... Args>
+AK_TOOLKIT_CONSTEXPR_CXX20 void construct_at(T* p, Args&&... args)
+{
+#if defined AK_TOOLKIT_CONSTEXPR_DUAL_STORAGE
+  ::std::construct_at(p, ::std::forward<Args>(args)...);
+#else
+  ::new (static_cast<void*>(p)) T(::std::forward<Args>(args)...);
+#endif
+}
+
+template <typename T>
+AK_TOOLKIT_CONSTEXPR_CXX20 void destroy_at(T* p) AK_TOOLKIT_NOEXCEPT
+{
+  p->~T();
+}
+
+// dual_storage is trivially copyable and trivially destructible whenever
+// both value_type and representation_type are.
 template <typename MP>
+struct is_trivial_dual_storage : ::std::integral_constant<bool,
+  ::std::is_trivially_copyable<typename MP::value_type>::value &&
+  ::std::is_trivially_copyable<typename MP::representation_type>::value>
+{
+};
+
+template <typename MP, bool = is_trivial_dual_storage<MP>::value>
 union dual_storage_union
 {
   typedef typename MP::value_type value_type;
@@ -230,7 +427,30 @@ union dual_storage_union
   constexpr explicit dual_storage_union(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(value_type(std::move(v)))
     : _value(v) {}
 
-  ~dual_storage_union() {/* nothing here; will be properly destroyed by the owner */}
+  AK_TOOLKIT_CONSTEXPR_CXX20 ~dual_storage_union() {/* nothing here; will be properly destroyed by the owner */}
+};
+
+template <typename MP>
+union dual_storage_union<MP, true> // no user-provided destructor: stays trivial
+{
+  typedef typename MP::value_type value_type;
+  typedef typename MP::representation_type representation_type;
+
+  char         _nothing;
+  value_type   _value;
+  representation_type _marking;
+
+  constexpr explicit dual_storage_union(_init_nothing_tag) AK_TOOLKIT_NOEXCEPT
+    : _nothing() {}
+
+  constexpr explicit dual_storage_union(representation_type && v) AK_TOOLKIT_NOEXCEPT_AS(representation_type(std::move(v)))
+    : _marking(std::move(v)) {}
+
+  constexpr explicit dual_storage_union(value_type && v) AK_TOOLKIT_NOEXCEPT_AS(value_type(std::move(v)))
+    : _value(std::move(v)) {}
+
+  constexpr explicit dual_storage_union(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(value_type(std::move(v)))
+    : _value(v) {}
 };
 
 template <typename MVP, typename = void>
@@ -244,29 +464,51 @@ struct check_safe_dual_storage_exception_safety<MVP, typename MVP::is_safe_dual_
 
 } // namespace detail_
 
+template <typename MP, typename = void>
+struct is_multi_mark_policy : ::std::false_type {};
+
+template <typename MP>
+struct is_multi_mark_policy<MP, decltype(void(MP::marked_index(MP::marked_value(std::size_t(0)))))> : ::std::true_type {};
+
+namespace detail_ {
+
+template <typename MP, typename R>
+bool is_canonical_marked_value(const R& r, ::std::false_type)
+{
+  return r == MP::marked_value();
+}
+
+template <typename MP, typename R>
+bool is_canonical_marked_value(const R& r, ::std::true_type)
+{
+  return MP::is_marked_value(r) && r == MP::marked_value(MP::marked_index(r));
+}
+
+} // namespace detail_
+
 template <typename T>
 struct representation_of
 {
   static_assert(sizeof(T) == 0, "class template representation_of<T> needs to be specialized for your type");
 };
 
+namespace detail_ {
+
 template <typename MP>
-struct dual_storage
+struct dual_storage_base
 {
   typedef typename MP::value_type value_type;
   typedef typename MP::representation_type representation_type;
-  typedef typename MP::reference_type reference_type;
 
-private:
-  typedef detail_::dual_storage_union<MP> union_type;
+protected:
+  typedef dual_storage_union<MP> union_type;
   union_type value_;
 
-private:
-  void* address() { return static_cast<void*>(std::addressof(value_)); }
-  void construct_value(const value_type& v) { ::new (address()) value_type(v); }
-  void construct_value(value_type&& v) { ::new (address()) value_type(std::move(v)); }
+protected:
+  AK_TOOLKIT_CONSTEXPR_CXX20 void construct_value(const value_type& v) { detail_::construct_at(std::addressof(value_._value), v); }
+  AK_TOOLKIT_CONSTEXPR_CXX20 void construct_value(value_type&& v) { detail_::construct_at(std::addressof(value_._value), std::move(v)); }
 
-  void change_to_value(const value_type& v)
+  AK_TOOLKIT_CONSTEXPR_CXX20 void change_to_value(const value_type& v)
     try {
       destroy_storage();
       construct_value(v);
@@ -277,7 +519,7 @@ private:
       throw;
     }
 
-  void change_to_value(value_type&& v)
+  AK_TOOLKIT_CONSTEXPR_CXX20 void change_to_value(value_type&& v)
     try {
       destroy_storage();
       construct_value(std::move(v));
@@ -288,111 +530,203 @@ private:
       throw;
     }
 
-  void construct_storage() { ::new (address()) representation_type(MP::marked_value()); }
-  void construct_storage_checked() AK_TOOLKIT_NOEXCEPT { construct_storage(); }  // std::terminate() if MP::marked_value() throws
+  AK_TOOLKIT_CONSTEXPR_CXX20 void construct_storage() { detail_::construct_at(std::addressof(value_._marking), MP::marked_value()); }
+  AK_TOOLKIT_CONSTEXPR_CXX20 void construct_storage_checked() AK_TOOLKIT_NOEXCEPT { construct_storage(); }  // std::terminate() if MP::marked_value() throws
 
-  void destroy_value() AK_TOOLKIT_NOEXCEPT { as_value().value_type::~value_type(); }
-  void destroy_storage() AK_TOOLKIT_NOEXCEPT { representation().representation_type::~representation_type(); }
+  AK_TOOLKIT_CONSTEXPR_CXX20 void destroy_value() AK_TOOLKIT_NOEXCEPT { detail_::destroy_at(std::addressof(value_._value)); }
+  AK_TOOLKIT_CONSTEXPR_CXX20 void destroy_storage() AK_TOOLKIT_NOEXCEPT { detail_::destroy_at(std::addressof(value_._marking)); }
+
+  // Nothing to destroy if both members are trivially destructible. This also
+  // avoids reading the representation, which during constant evaluation is
+  // only allowed if it is the active member of the union.
+  AK_TOOLKIT_CONSTEXPR_CXX20 void destroy(::std::true_type) AK_TOOLKIT_NOEXCEPT {}
+  AK_TOOLKIT_CONSTEXPR_CXX20 void destroy(::std::false_type) AK_TOOLKIT_NOEXCEPT
+  {
+    if (has_value())
+      destroy_value();
+    else
+      destroy_storage();
+  }
 
 public:
-  void clear_value() AK_TOOLKIT_NOEXCEPT { destroy_value(); construct_storage(); } // std::terminate() if MP::marked_value() throws
-  bool has_value() const AK_TOOLKIT_NOEXCEPT { return !MP::is_marked_value(representation()); }
+  AK_TOOLKIT_CONSTEXPR_CXX20 void clear_value() AK_TOOLKIT_NOEXCEPT { destroy_value(); construct_storage(); } // std::terminate() if MP::marked_value() throws
+  AK_TOOLKIT_CONSTEXPR bool has_value() const AK_TOOLKIT_NOEXCEPT { return !MP::is_marked_value(representation()); }
 
-  value_type& as_value() { return value_._value; }
-  const value_type& as_value() const { return value_._value; }
+  AK_TOOLKIT_CONSTEXPR_NOCONST value_type& as_value() AK_TOOLKIT_NOEXCEPT { return value_._value; }
+  AK_TOOLKIT_CONSTEXPR const value_type& as_value() const AK_TOOLKIT_NOEXCEPT { return value_._value; }
 
-public:
+  AK_TOOLKIT_CONSTEXPR_NOCONST representation_type& representation() AK_TOOLKIT_NOEXCEPT { return value_._marking; }
+  AK_TOOLKIT_CONSTEXPR const representation_type& representation() const AK_TOOLKIT_NOEXCEPT { return value_._marking; }
 
-  representation_type& representation() AK_TOOLKIT_NOEXCEPT { return value_._marking; }
-  const representation_type& representation() const AK_TOOLKIT_NOEXCEPT { return value_._marking; }
+  constexpr explicit dual_storage_base(_init_nothing_tag t) AK_TOOLKIT_NOEXCEPT
+    : value_(t) {}
 
-  constexpr explicit dual_storage(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(mv)))
+  constexpr explicit dual_storage_base(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(mv)))
     : value_(std::move(mv)) {}
 
-  constexpr explicit dual_storage(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(union_type(v))
+  constexpr explicit dual_storage_base(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(union_type(v))
     : value_(v) {}
 
-  constexpr explicit dual_storage(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(v)))
+  constexpr explicit dual_storage_base(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(union_type(std::move(v)))
     : value_(std::move(v)) {}
 
-  dual_storage(const dual_storage& rhs) // TODO: add noexcept
-    : value_(detail_::_init_nothing_tag{})
+  static constexpr bool nothrow_marked_value = AK_TOOLKIT_IS_NOEXCEPT(representation_type(MP::marked_value()));
+  static constexpr bool nothrow_copy = ::std::is_nothrow_copy_constructible<value_type>::value;
+  static constexpr bool nothrow_move = ::std::is_nothrow_move_constructible<value_type>::value;
+};
+
+// Copy, move and destruction: user-provided unless both members are trivial.
+template <typename MP, bool = is_trivial_dual_storage<MP>::value>
+struct dual_storage_lifetime : dual_storage_base<MP>
+{
+  typedef dual_storage_base<MP> base;
+  typedef typename base::value_type value_type;
+  typedef typename base::representation_type representation_type;
+
+  constexpr explicit dual_storage_lifetime(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(mv)))
+    : base(std::move(mv)) {}
+
+  constexpr explicit dual_storage_lifetime(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(base(v))
+    : base(v) {}
+
+  constexpr explicit dual_storage_lifetime(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(v)))
+    : base(std::move(v)) {}
+
+  AK_TOOLKIT_CONSTEXPR_CXX20 dual_storage_lifetime(const dual_storage_lifetime& rhs) AK_TOOLKIT_NOEXCEPT_IF(base::nothrow_copy && base::nothrow_marked_value)
+    : base(_init_nothing_tag{})
     {
       if (rhs.has_value())
-        construct_value(rhs.as_value());
+        this->construct_value(rhs.as_value());
       else
-        construct_storage();
+        this->construct_storage();
     }
 
-  dual_storage(dual_storage&& rhs) // TODO: add noexcept
-    : value_(detail_::_init_nothing_tag{})
+  AK_TOOLKIT_CONSTEXPR_CXX20 dual_storage_lifetime(dual_storage_lifetime&& rhs) AK_TOOLKIT_NOEXCEPT_IF(base::nothrow_move && base::nothrow_marked_value)
+    : base(_init_nothing_tag{})
     {
       if (rhs.has_value())
-        construct_value(std::move(rhs.as_value()));
+        this->construct_value(std::move(rhs.as_value()));
       else
-        construct_storage();
+        this->construct_storage();
     }
 
-  void operator=(const dual_storage& rhs)
+  // clear_value() is noexcept: only operations on value_type can throw
+  AK_TOOLKIT_CONSTEXPR_CXX20 void operator=(const dual_storage_lifetime& rhs)
+      AK_TOOLKIT_NOEXCEPT_IF(base::nothrow_copy && ::std::is_nothrow_copy_assignable<value_type>::value)
     {
-      if (has_value() && rhs.has_value())
+      if (this->has_value() && rhs.has_value())
       {
-        as_value() = rhs.as_value();
+        this->as_value() = rhs.as_value();
       }
-      else if (has_value() && !rhs.has_value())
+      else if (this->has_value() && !rhs.has_value())
       {
-        clear_value();
+        this->clear_value();
       }
-      else if (!has_value() && rhs.has_value())
+      else if (!this->has_value() && rhs.has_value())
       {
-        change_to_value(rhs.as_value());
+        this->change_to_value(rhs.as_value());
       }
     }
 
-  void operator=(dual_storage&& rhs) // TODO: add noexcept
+  AK_TOOLKIT_CONSTEXPR_CXX20 void operator=(dual_storage_lifetime&& rhs)
+      AK_TOOLKIT_NOEXCEPT_IF(base::nothrow_move && ::std::is_nothrow_move_assignable<value_type>::value)
     {
-      if (has_value() && rhs.has_value())
+      if (this->has_value() && rhs.has_value())
       {
-        as_value() = std::move(rhs.as_value());
+        this->as_value() = std::move(rhs.as_value());
       }
-      else if (has_value() && !rhs.has_value())
+      else if (this->has_value() && !rhs.has_value())
       {
-        clear_value();
+        this->clear_value();
       }
-      else if (!has_value() && rhs.has_value())
+      else if (!this->has_value() && rhs.has_value())
       {
-        change_to_value(std::move(rhs.as_value()));
+        this->change_to_value(std::move(rhs.as_value()));
       }
     }
 
-  void swap_impl(dual_storage& rhs)
+  AK_TOOLKIT_CONSTEXPR_CXX20 ~dual_storage_lifetime()
+  {
+    this->destroy(::std::integral_constant<bool, ::std::is_trivially_destructible<value_type>::value &&
+                                                 ::std::is_trivially_destructible<representation_type>::value>{});
+  }
+};
+
+template <typename MP>
+struct dual_storage_lifetime<MP, true> : dual_storage_base<MP>
+{
+  typedef dual_storage_base<MP> base;
+  typedef typename base::value_type value_type;
+  typedef typename base::representation_type representation_type;
+
+  constexpr explicit dual_storage_lifetime(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(mv)))
+    : base(std::move(mv)) {}
+
+  constexpr explicit dual_storage_lifetime(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(base(v))
+    : base(v) {}
+
+  constexpr explicit dual_storage_lifetime(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(v)))
+    : base(std::move(v)) {}
+};
+
+} // namespace detail_
+
+template <typename MP>
+struct dual_storage : detail_::dual_storage_lifetime<MP>
+{
+  typedef typename MP::value_type value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef typename MP::reference_type reference_type;
+
+private:
+  typedef detail_::dual_storage_lifetime<MP> base;
+
+public:
+  constexpr explicit dual_storage(representation_type&& mv) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(mv)))
+    : base(std::move(mv)) {}
+
+  constexpr explicit dual_storage(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(base(v))
+    : base(v) {}
+
+  constexpr explicit dual_storage(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(base(std::move(v)))
+    : base(std::move(v)) {}
+
+private:
+  // trivially copyable: swap whole objects, whichever members are active
+  AK_TOOLKIT_CONSTEXPR_CXX20 void swap_storage(dual_storage& rhs, ::std::true_type) AK_TOOLKIT_NOEXCEPT
+  {
+    dual_storage tmp = rhs;
+    rhs = *this;
+    *this = tmp;
+  }
+
+  AK_TOOLKIT_CONSTEXPR_CXX20 void swap_storage(dual_storage& rhs, ::std::false_type)
   {
     using namespace std;
-    if (has_value() && rhs.has_value())
+    if (this->has_value() && rhs.has_value())
     {
-      swap(as_value(), rhs.as_value());
+      swap(this->as_value(), rhs.as_value());
     }
-    else if (has_value() && !rhs.has_value())
+    else if (this->has_value() && !rhs.has_value())
     {
-      rhs.change_to_value(std::move(as_value()));
-      clear_value();
+      rhs.change_to_value(std::move(this->as_value()));
+      this->clear_value();
     }
-    else if (!has_value() && rhs.has_value())
+    else if (!this->has_value() && rhs.has_value())
     {
-      change_to_value(std::move(rhs.as_value()));
+      this->change_to_value(std::move(rhs.as_value()));
       rhs.clear_value();
     }
   }
 
-  friend void swap(dual_storage& lhs, dual_storage& rhs) { lhs.swap_impl(rhs); }
-
-  ~dual_storage()
+public:
+  AK_TOOLKIT_CONSTEXPR_CXX20 void swap_impl(dual_storage& rhs)
+    AK_TOOLKIT_NOEXCEPT_IF(base::nothrow_move && detail_::is_nothrow_swappable<value_type>::value)
   {
-    if (has_value())
-      destroy_value();
-    else
-      destroy_storage();
+    swap_storage(rhs, detail_::is_trivial_dual_storage<MP>{});
   }
+
+  friend AK_TOOLKIT_CONSTEXPR_CXX20 void swap(dual_storage& lhs, dual_storage& rhs) AK_TOOLKIT_NOEXCEPT_AS(lhs.swap_impl(rhs)) { lhs.swap_impl(rhs); }
 };
 
 template <typename MPT, typename T, typename REP_T = typename representation_of<T>::type>
@@ -412,17 +746,17 @@ struct markable_dual_storage_type_unsafe
   typedef const T& reference_type;
   typedef dual_storage<MPT> storage_type;
 
-  static  reference_type access_value(const storage_type& v)
+  static AK_TOOLKIT_CONSTEXPR reference_type access_value(const storage_type& v) AK_TOOLKIT_NOEXCEPT
   { return v.as_value(); }
-  static  const representation_type& representation(const storage_type& v)
+  static AK_TOOLKIT_CONSTEXPR const representation_type& representation(const storage_type& v) AK_TOOLKIT_NOEXCEPT
   { return v.representation(); }
-  static  storage_type store_value(const value_type& v)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_value(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(storage_type(v))
   { return storage_type(v); }
-  static  storage_type store_value(value_type&& v)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_value(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(storage_type(std::move(v)))
   { return storage_type(std::move(v)); }
-  static  storage_type store_representation(const representation_type& r)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_representation(const representation_type& r)
   { return storage_type(r); }
-  static  storage_type store_representation(representation_type&& r)
+  static AK_TOOLKIT_CONSTEXPR storage_type store_representation(representation_type&& r) AK_TOOLKIT_NOEXCEPT_AS(storage_type(std::move(r)))
   { return storage_type(std::move(r)); }
 };
 
@@ -441,13 +775,59 @@ class order_none {};
 template <AK_TOOLKIT_MARK_POLICY MP, typename OP = order_none>
 class markable;
 
+template <typename T, typename = void>
+struct default_mark_policy;
+
+// Policies where the storage is the representation (mark_int, mark_fp_nan,
+// mark_enum, mark_bool): markables can be stored as bare representations.
+template <typename MP>
+struct is_columnar_mark_policy
+  : std::is_same<typename MP::storage_type, typename MP::representation_type> {};
+
+namespace detail_ {
+
+// Policies whose storage is a scalar representation: value_or() selects
+// between two representations without a branch.
+template <typename MP>
+struct is_select_friendly_policy : ::std::integral_constant<bool,
+  is_columnar_mark_policy<MP>::value &&
+  ::std::is_arithmetic<typename MP::representation_type>::value &&
+  ::std::is_trivially_copyable<typename MP::value_type>::value>
+{
+};
+
+template <typename T>
+AK_TOOLKIT_CONSTEXPR T select_mask(bool c) AK_TOOLKIT_NOEXCEPT { return T(-T(c)); }
+
+// integral types: a mask, so that no branch is possible
+template <typename T>
+AK_TOOLKIT_CONSTEXPR T select(bool c, T a, T b, ::std::true_type) AK_TOOLKIT_NOEXCEPT
+{
+  return T(b ^ ((a ^ b) & select_mask<T>(c)));
+}
+
+// floating-point types: both operands are already evaluated, compilers emit a blend
+template <typename T>
+AK_TOOLKIT_CONSTEXPR T select(bool c, T a, T b, ::std::false_type) AK_TOOLKIT_NOEXCEPT
+{
+  return c ? a : b;
+}
+
+template <typename T>
+AK_TOOLKIT_CONSTEXPR T select(bool c, T a, T b) AK_TOOLKIT_NOEXCEPT
+{
+  return select(c, a, b, ::std::integral_constant<bool, ::std::is_integral<T>::value>{});
+}
+
+} // namespace detail_
+
 
 template <typename MP, typename OP>
 static bool unique_marked_value(const markable<MP, OP>& mk)
 {
   // returns false if mk has no value but its storage is different
-  // than the MP::marked_value().
-  return mk.has_value() || mk.representation_value() == MP::marked_value();
+  // than the MP::marked_value() (or than any MP::marked_value(i) for multi-marked policies).
+  return mk.has_value() || detail_::is_canonical_marked_value<MP>(mk.representation_value(), is_multi_mark_policy<MP>{});
 }
 
 class order_by_representation
@@ -568,6 +948,22 @@ struct with_representation_t
 AK_TOOLKIT_CONSTEXPR_OR_CONST with_representation_t with_representation {};
 
 
+namespace detail_ {
+
+template <typename MP, typename OP, typename R>
+struct transform_result
+{
+  typedef markable<typename default_mark_policy<R>::type, order_by_value> type;
+};
+
+template <typename MP, typename OP>
+struct transform_result<MP, OP, typename MP::value_type>
+{
+  typedef markable<MP, OP> type;
+};
+
+} // namespace detail_
+
 template <AK_TOOLKIT_MARK_POLICY MP, typename OP>
 class markable
 {
@@ -583,22 +979,23 @@ public:
   typedef typename MP::reference_type reference_type;
 
 private:
-  typename MP::storage_type _storage;
+  typedef typename MP::storage_type storage_type;
+  storage_type _storage;
 
 public:
-  AK_TOOLKIT_CONSTEXPR markable() AK_TOOLKIT_NOEXCEPT_AS(MP::marked_value())
+  AK_TOOLKIT_CONSTEXPR markable() AK_TOOLKIT_NOEXCEPT_AS(storage_type(MP::store_representation(MP::marked_value())))
     : _storage(MP::store_representation(MP::marked_value())) {}
 
-  AK_TOOLKIT_CONSTEXPR explicit markable(const value_type& v)
+  AK_TOOLKIT_CONSTEXPR explicit markable(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(storage_type(MP::store_value(v)))
     : _storage(MP::store_value(v)) {}
 
-  AK_TOOLKIT_CONSTEXPR explicit markable(value_type&& v)
+  AK_TOOLKIT_CONSTEXPR explicit markable(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(storage_type(MP::store_value(std::move(v))))
     : _storage(MP::store_value(std::move(v))) {}
 
-  AK_TOOLKIT_CONSTEXPR explicit markable(with_representation_t, const representation_type& r)
+  AK_TOOLKIT_CONSTEXPR explicit markable(with_representation_t, const representation_type& r) AK_TOOLKIT_NOEXCEPT_AS(storage_type(MP::store_representation(r)))
     : _storage(MP::store_representation(r)) {}
 
-  AK_TOOLKIT_CONSTEXPR explicit markable(with_representation_t, representation_type&& r)
+  AK_TOOLKIT_CONSTEXPR explicit markable(with_representation_t, representation_type&& r) AK_TOOLKIT_NOEXCEPT_AS(storage_type(MP::store_representation(::std::move(r))))
     : _storage(MP::store_representation(::std::move(r))) {}
 
   AK_TOOLKIT_CONSTEXPR bool has_value() const {
@@ -611,13 +1008,75 @@ public:
     return MP::representation(_storage);
   }
 
-  void assign(value_type&& v) { _storage = MP::store_value(std::move(v)); }
-  void assign(const value_type& v) { _storage = MP::store_value(v); }
+private:
+  template <typename U>
+  AK_TOOLKIT_CONSTEXPR value_type value_or_(U&& d, ::std::true_type) const {
+    return MP::access_value(detail_::select(has_value(), representation_value(), representation_type(MP::store_value(value_type(std::forward<U>(d))))));
+  }
+
+  template <typename U>
+  AK_TOOLKIT_CONSTEXPR value_type value_or_(U&& d, ::std::false_type) const {
+    return has_value() ? value_type(value()) : value_type(std::forward<U>(d));
+  }
 
-  void assign_representation(representation_type&& s) { _storage = MP::store_representation(std::move(s)); }
-  void assign_representation(representation_type const& s) { _storage = MP::store_representation(s); }
+public:
+  // For scalar policies, like mark_int, mark_fp_nan and mark_enum, this is a select, not a branch
+  template <typename U>
+  AK_TOOLKIT_CONSTEXPR value_type value_or(U&& d) const {
+    return value_or_(std::forward<U>(d), detail_::is_select_friendly_policy<MP>{});
+  }
+
+  // The result is a markable<MP, OP> if f returns value_type, otherwise a default_markable.
+  // If f returns the marked value, the result has no value.
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto transform(F&& f) const
+    -> typename detail_::transform_result<MP, OP, typename ::std::decay<decltype(f(::std::declval<reference_type>()))>::type>::type
+  {
+    typedef typename detail_::transform_result<MP, OP, typename ::std::decay<decltype(f(::std::declval<reference_type>()))>::type>::type result;
+    return has_value() ? result(std::forward<F>(f)(value())) : result();
+  }
+
+  // The same, but with an explicitly specified type of the result
+  template <typename RMP, typename ROP = order_none, typename F>
+  AK_TOOLKIT_CONSTEXPR markable<RMP, ROP> transform(F&& f) const
+  {
+    return has_value() ? markable<RMP, ROP>(std::forward<F>(f)(value())) : markable<RMP, ROP>();
+  }
 
-  friend void swap(markable& lhs, markable& rhs) {
+  // f returns a markable
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR auto and_then(F&& f) const
+    -> typename ::std::decay<decltype(f(::std::declval<reference_type>()))>::type
+  {
+    typedef typename ::std::decay<decltype(f(::std::declval<reference_type>()))>::type result;
+    return has_value() ? result(std::forward<F>(f)(value())) : result();
+  }
+
+  // f returns something convertible to markable
+  template <typename F>
+  AK_TOOLKIT_CONSTEXPR markable or_else(F&& f) const
+  {
+    return has_value() ? *this : markable(std::forward<F>(f)());
+  }
+
+  AK_TOOLKIT_CONSTEXPR_NOCONST void assign(value_type&& v) AK_TOOLKIT_NOEXCEPT_AS(::std::declval<storage_type&>() = MP::store_value(std::move(v)))
+    { _storage = MP::store_value(std::move(v)); }
+  AK_TOOLKIT_CONSTEXPR_NOCONST void assign(const value_type& v) AK_TOOLKIT_NOEXCEPT_AS(::std::declval<storage_type&>() = MP::store_value(v))
+    { _storage = MP::store_value(v); }
+
+  AK_TOOLKIT_CONSTEXPR_NOCONST void assign_representation(representation_type&& s) AK_TOOLKIT_NOEXCEPT_AS(::std::declval<storage_type&>() = MP::store_representation(std::move(s)))
+    { _storage = MP::store_representation(std::move(s)); }
+  AK_TOOLKIT_CONSTEXPR_NOCONST void assign_representation(representation_type const& s) AK_TOOLKIT_NOEXCEPT_AS(::std::declval<storage_type&>() = MP::store_representation(s))
+    { _storage = MP::store_representation(s); }
+
+  // only for multi-marked policies
+  AK_TOOLKIT_CONSTEXPR std::size_t marked_index() const {
+    return AK_TOOLKIT_ASSERT(!has_value()), MP::marked_index(MP::representation(_storage));
+  }
+
+  AK_TOOLKIT_CONSTEXPR_NOCONST void assign_marked(std::size_t i) { _storage = MP::store_representation(MP::marked_value(i)); }
+
+  friend AK_TOOLKIT_CONSTEXPR_CXX20 void swap(markable& lhs, markable& rhs) AK_TOOLKIT_NOEXCEPT_IF(detail_::is_nothrow_swappable<storage_type>::value) {
     using std::swap; swap(lhs._storage, rhs._storage);
   }
 };
@@ -666,10 +1125,126 @@ template <typename MP, typename OP>
 }
 
 
+// Relocation: move-constructing an object into new storage and destroying the
+// original. For trivially relocatable types this is equivalent to memmove.
+// This is a customization point: users can specialize it for their types,
+// e.g., for value_type and representation_type used with dual_storage.
+
+template <typename T>
+struct is_trivially_relocatable : ::std::is_trivially_copyable<T> {};
+
+template <typename MP>
+struct is_trivially_relocatable<dual_storage<MP>> : ::std::integral_constant<bool,
+  is_trivially_relocatable<typename MP::value_type>::value &&
+  is_trivially_relocatable<typename MP::representation_type>::value>
+{
+};
+
+template <typename MP, typename OP>
+struct is_trivially_relocatable<markable<MP, OP>> : is_trivially_relocatable<typename MP::storage_type> {};
+
+namespace detail_ {
+
+template <typename T>
+T* relocate_n(T* first, std::size_t n, T* d_first, ::std::true_type) AK_TOOLKIT_NOEXCEPT
+{
+  if (n != 0)
+    ::std::memmove(static_cast<void*>(d_first), static_cast<const void*>(first), n * sizeof(T));
+  return d_first + n;
+}
+
+template <typename T>
+T* relocate_n(T* first, std::size_t n, T* d_first, ::std::false_type)
+  AK_TOOLKIT_NOEXCEPT_IF(::std::is_nothrow_move_constructible<T>::value)
+{
+  for (; n != 0; --n, ++first, ++d_first)
+  {
+    ::new (static_cast<void*>(d_first)) T(std::move(*first));
+    first->~T();
+  }
+  return d_first;
+}
+
+} // namespace detail_
+
+// Relocates objects [first, first + n) into uninitialized storage starting at d_first.
+// Afterwards the source range is uninitialized storage. Returns d_first + n.
+// The ranges can only overlap if T is trivially relocatable.
+template <typename T>
+T* relocate_n(T* first, std::size_t n, T* d_first)
+  AK_TOOLKIT_NOEXCEPT_IF(is_trivially_relocatable<T>::value || ::std::is_nothrow_move_constructible<T>::value)
+{
+  return detail_::relocate_n(first, n, d_first, ::std::integral_constant<bool, is_trivially_relocatable<T>::value>{});
+}
+
+
+// ### Niches
+
+// niche_of<MP> lists the representations that are never held by a markable<MP>
+// nested in mark_nested: value(i) for i in [0, count()). mark_nested uses them
+// to mark the absence of the outer value. It can be specialized for user-defined
+// policies with spare representations.
+
+template <typename MP, typename = void>
+struct niche_of
+{
+  static AK_TOOLKIT_CONSTEXPR std::size_t count() AK_TOOLKIT_NOEXCEPT { return 0; }
+};
+
+// the marked values other than marked_value(0)
+template <typename MP>
+struct niche_of<MP, typename std::enable_if<is_multi_mark_policy<MP>::value>::type>
+{
+  typedef typename MP::representation_type representation_type;
+  static AK_TOOLKIT_CONSTEXPR std::size_t count() AK_TOOLKIT_NOEXCEPT { return MP::marked_value_count() - 1; }
+  static AK_TOOLKIT_CONSTEXPR representation_type value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return MP::marked_value(i + 1); }
+};
+
+// chars 3 to 127: never stored for a bool, whatever the signedness of char
+template <>
+struct niche_of<mark_bool, void>
+{
+  static AK_TOOLKIT_CONSTEXPR std::size_t count() AK_TOOLKIT_NOEXCEPT { return 125; }
+  static AK_TOOLKIT_CONSTEXPR char value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return char(3 + i); }
+};
+
+template <typename M>
+struct mark_nested;
+
+// Stores markable<MP, OP> as its bare representation, using the first niche of
+// MP as the marked value. An inner markable with no value is stored as
+// MP::marked_value(). The remaining niches are available to a further level.
+template <typename MP, typename OP>
+struct mark_nested<markable<MP, OP>>
+  : markable_type<markable<MP, OP>, typename MP::representation_type, markable<MP, OP>>
+{
+  static_assert(niche_of<MP>::count() > 0, "mark_nested requires a policy with a spare representation: see niche_of");
+  static_assert(is_columnar_mark_policy<MP>::value, "mark_nested requires storage_type to be the same as representation_type");
+
+  typedef markable<MP, OP> value_type;
+  typedef typename MP::representation_type representation_type;
+
+  static AK_TOOLKIT_CONSTEXPR representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return niche_of<MP>::value(0); }
+  static AK_TOOLKIT_CONSTEXPR bool is_marked_value(const representation_type& v) AK_TOOLKIT_NOEXCEPT { return v == marked_value(); }
+
+  static AK_TOOLKIT_CONSTEXPR value_type access_value(const representation_type& v) AK_TOOLKIT_NOEXCEPT { return value_type(with_representation, v); }
+  static AK_TOOLKIT_CONSTEXPR representation_type store_value(const value_type& v) AK_TOOLKIT_NOEXCEPT
+  { return v.has_value() ? v.representation_value() : MP::marked_value(); }
+};
+
+template <typename MP, typename OP>
+struct niche_of<mark_nested<markable<MP, OP>>, void>
+{
+  typedef typename MP::representation_type representation_type;
+  static AK_TOOLKIT_CONSTEXPR std::size_t count() AK_TOOLKIT_NOEXCEPT { return niche_of<MP>::count() - 1; }
+  static AK_TOOLKIT_CONSTEXPR representation_type value(std::size_t i) AK_TOOLKIT_NOEXCEPT { return niche_of<MP>::value(i + 1); }
+};
+
+
 // This defines a customization point for selecting the default makred value
 // policy for a given type
 
-template <typename T, typename = void>
+template <typename T, typename>
 struct default_mark_policy
 {
   using type = mark_value_init<T>;
@@ -687,6 +1262,12 @@ struct default_mark_policy<T, typename std::enable_if<std::is_floating_point<T>:
   using type = mark_fp_nan<T>;
 };
 
+template <typename T>
+struct default_mark_policy<T, typename std::enable_if<std::is_pointer<T>::value>::type>
+{
+  using type = mark_ptr<T>;
+};
+
 template <>
 struct default_mark_policy<bool, void>
 {
@@ -724,11 +1305,19 @@ using markable_ns::markable_dual_storage_type;
 using markable_ns::markable_dual_storage_type_unsafe;
 using markable_ns::mark_bool;
 using markable_ns::mark_int;
+using markable_ns::mark_int_multi;
+using markable_ns::mark_int_range;
+using markable_ns::is_multi_mark_policy;
+using markable_ns::is_columnar_mark_policy;
 using markable_ns::mark_fp_nan;
 using markable_ns::mark_value_init;
 using markable_ns::mark_optional;
 using markable_ns::mark_stl_empty;
 using markable_ns::mark_enum;
+using markable_ns::mark_ptr;
+using markable_ns::mark_aligned_ptr;
+using markable_ns::mark_nested;
+using markable_ns::niche_of;
 using markable_ns::order_none;
 using markable_ns::order_by_representation;
 using markable_ns::order_by_value;
@@ -741,15 +1330,24 @@ using markable_ns::hash_by_value;
 using markable_ns::default_markable;
 using markable_ns::with_representation;
 using markable_ns::with_representation_t;
+using markable_ns::is_trivially_relocatable;
+using markable_ns::relocate_n;
 
 # if defined AK_TOOLKIT_WITH_CONCEPTS
 
 using markable_ns::mark_policy;
+using markable_ns::multi_mark_policy;
 
 static_assert(mark_policy<mark_bool>, "mark_policy test failed");
+static_assert(multi_mark_policy<mark_int_multi<int, -1, -2>>, "multi_mark_policy test failed");
+static_assert(multi_mark_policy<mark_int_range<int, -9, -1>>, "multi_mark_policy test failed");
+static_assert(!multi_mark_policy<mark_int<int, 0>>, "multi_mark_policy test failed");
 static_assert(mark_policy<mark_int<int, 0>>, "mark_policy test failed");
 static_assert(mark_policy<mark_fp_nan<float>>, "mark_policy test failed");
 static_assert(mark_policy<mark_value_init<int>>, "mark_policy test failed");
+static_assert(mark_policy<mark_ptr<int*>>, "mark_policy test failed");
+static_assert(multi_mark_policy<mark_aligned_ptr<int*, 2>>, "multi_mark_policy test failed");
+static_assert(mark_policy<mark_nested<markable<mark_bool>>>, "mark_policy test failed");
 
 # endif
 
@@ -0,0 +1,936 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_AGGREGATE_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_AGGREGATE_HEADER_GUARD_
+
+#include "markable_mask.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Hides the value of a floating-point variable (or vector) from the optimizer.
+// With -ffast-math, the compensation (t - sum) - y of Kahan summation would
+// otherwise be reassociated to zero, turning it into simple summation.
+#if defined __GNUC__ && defined __SSE2__ && (defined __x86_64__ || defined __i386__)
+#  define AK_TOOLKIT_OPAQUE_FP(v) __asm__ volatile ("" : "+x"(v))
+#  define AK_TOOLKIT_OPAQUE_ZMM(v) __asm__ volatile ("" : "+v"(v))
+#else
+#  define AK_TOOLKIT_OPAQUE_FP(v) ((void)0)
+#  define AK_TOOLKIT_OPAQUE_ZMM(v) ((void)0)
+#endif
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// The result of a single pass over a column: the number of values, their sum,
+// the smallest and the largest one. Marked elements are skipped.
+// If count == 0, min and max are meaningless.
+
+template <typename FPT>
+struct fp_summary
+{
+  std::size_t count;
+  FPT sum;
+  FPT min;
+  FPT max;
+};
+
+// The same for integral representations. The sum is exact: it is computed
+// with 128 bits and `overflow` is set if it does not fit in sum_type, in which
+// case `sum` holds its low 64 bits. If count == 0, min and max are meaningless.
+
+template <typename T>
+struct int_summary
+{
+  typedef typename std::conditional<std::is_signed<T>::value, std::int64_t, std::uint64_t>::type sum_type;
+
+  std::size_t count;
+  sum_type sum;
+  bool overflow;
+  T min;
+  T max;
+};
+
+// How sums of floating-point values are accumulated:
+// simple   -- one accumulator per SIMD lane,
+// pairwise -- simple sums of blocks of 1024 elements, added pairwise,
+// kahan    -- compensated (Kahan) summation in each lane.
+
+enum class summation { simple, pairwise, kahan };
+
+namespace detail_ {
+
+template <typename MP, typename Tag = typename kernel_tag<MP>::type>
+struct summary_of { typedef void type; };
+
+template <typename MP>
+struct summary_of<MP, sentinel_kernel_tag> { typedef int_summary<typename MP::representation_type> type; };
+
+template <typename MP>
+struct summary_of<MP, nan_kernel_tag> { typedef fp_summary<typename MP::representation_type> type; };
+
+template <typename FPT>
+fp_summary<FPT> empty_fp_summary()
+{
+  fp_summary<FPT> ans = { 0, FPT(0), std::numeric_limits<FPT>::infinity(), -std::numeric_limits<FPT>::infinity() };
+  return ans;
+}
+
+// Neumaier's variant of Kahan summation: `comp` collects the low-order bits
+// lost by the additions to `sum`; the result is sum + comp.
+template <typename FPT>
+void compensated_add(FPT& sum, FPT& comp, FPT v)
+{
+  const bool sum_larger = (sum < 0 ? -sum : sum) >= (v < 0 ? -v : v);
+  const FPT large = sum_larger ? sum : v;
+  const FPT small = sum_larger ? v : sum;
+  FPT t = sum + v;
+  AK_TOOLKIT_OPAQUE_FP(t);
+  FPT d = large - t;
+  AK_TOOLKIT_OPAQUE_FP(d);
+  comp += d + small;
+  sum = t;
+}
+
+// Once a sum overflows, its compensation is computed from differences of
+// infinities and is meaningless: the sum is then returned as it is.
+template <typename FPT>
+FPT compensated_total(FPT sum, FPT comp)
+{
+  const bool finite = (as_uint(sum) & as_uint(std::numeric_limits<FPT>::infinity())) != as_uint(std::numeric_limits<FPT>::infinity());
+  return finite ? sum + comp : sum;
+}
+
+template <bool Compensated, typename FPT>
+void summarize_scalar(const FPT* p, std::size_t n, fp_summary<FPT>& r, FPT& comp)
+{
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    // selects rather than branches
+    const bool has = !is_nan_bits(p[i]);
+    const FPT v = p[i];
+    r.count += has;
+    if (Compensated)
+      compensated_add(r.sum, comp, has ? v : FPT(0));
+    else
+      r.sum += has ? v : FPT(0);
+    r.min = (has && v < r.min) ? v : r.min;
+    r.max = (has && r.max < v) ? v : r.max;
+  }
+}
+
+// A compensated lane holds sum - comp
+template <bool Compensated, typename FPT>
+void merge_summary_lanes(const FPT* sums, const FPT* comps, const FPT* mins, const FPT* maxs, unsigned lanes, fp_summary<FPT>& r, FPT& comp)
+{
+  for (unsigned j = 0; j != lanes; ++j)
+  {
+    if (Compensated)
+    {
+      compensated_add(r.sum, comp, sums[j]);
+      compensated_add(r.sum, comp, -comps[j]);
+    }
+    else
+      r.sum += sums[j];
+    r.min = mins[j] < r.min ? mins[j] : r.min;
+    r.max = r.max < maxs[j] ? maxs[j] : r.max;
+  }
+}
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+// Each kernel processes the leading elements whose number is a multiple of the
+// vector width and returns this number. Marked lanes are neutralized with the
+// mask from the ordered comparison of a vector with itself. In compensated
+// kernels, `c` holds the error of each lane's sum.
+
+// The number of set bits in a mask of at most 4 bits. SSE2 has no popcnt
+// instruction, and __builtin_popcount would be a library call.
+inline unsigned popcount4(int mask) { return unsigned(0x4332322132212110ull >> (4 * mask)) & 0xF; }
+
+inline void kahan_add_sse2(__m128& sum, __m128& c, __m128 v)
+{
+  const __m128 y = _mm_sub_ps(v, c);
+  __m128 t = _mm_add_ps(sum, y);
+  AK_TOOLKIT_OPAQUE_FP(t);
+  __m128 d = _mm_sub_ps(t, sum);
+  AK_TOOLKIT_OPAQUE_FP(d);
+  c = _mm_sub_ps(d, y);
+  sum = t;
+}
+
+inline void kahan_add_sse2(__m128d& sum, __m128d& c, __m128d v)
+{
+  const __m128d y = _mm_sub_pd(v, c);
+  __m128d t = _mm_add_pd(sum, y);
+  AK_TOOLKIT_OPAQUE_FP(t);
+  __m128d d = _mm_sub_pd(t, sum);
+  AK_TOOLKIT_OPAQUE_FP(d);
+  c = _mm_sub_pd(d, y);
+  sum = t;
+}
+
+template <bool Compensated>
+inline std::size_t summarize_sse2(const float* p, std::size_t n, fp_summary<float>& r, float& comp)
+{
+  const std::size_t m = n - n % 4;
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 ninf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+  __m128 sum = _mm_setzero_ps(), c = _mm_setzero_ps(), mn = inf, mx = ninf;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 4)
+  {
+    const __m128 v = _mm_loadu_ps(p + i);
+    const __m128 ord = _mm_cmpord_ps(v, v);
+    if (Compensated)
+      kahan_add_sse2(sum, c, _mm_and_ps(ord, v));
+    else
+      sum = _mm_add_ps(sum, _mm_and_ps(ord, v));
+    mn = _mm_min_ps(mn, _mm_or_ps(_mm_and_ps(ord, v), _mm_andnot_ps(ord, inf)));
+    mx = _mm_max_ps(mx, _mm_or_ps(_mm_and_ps(ord, v), _mm_andnot_ps(ord, ninf)));
+    count += popcount4(_mm_movemask_ps(ord));
+  }
+  float sums[4], comps[4], mins[4], maxs[4];
+  _mm_storeu_ps(sums, sum); _mm_storeu_ps(comps, c); _mm_storeu_ps(mins, mn); _mm_storeu_ps(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 4, r, comp);
+  r.count += count;
+  return m;
+}
+
+template <bool Compensated>
+inline std::size_t summarize_sse2(const double* p, std::size_t n, fp_summary<double>& r, double& comp)
+{
+  const std::size_t m = n - n % 2;
+  const __m128d inf = _mm_set1_pd(std::numeric_limits<double>::infinity());
+  const __m128d ninf = _mm_set1_pd(-std::numeric_limits<double>::infinity());
+  __m128d sum = _mm_setzero_pd(), c = _mm_setzero_pd(), mn = inf, mx = ninf;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 2)
+  {
+    const __m128d v = _mm_loadu_pd(p + i);
+    const __m128d ord = _mm_cmpord_pd(v, v);
+    if (Compensated)
+      kahan_add_sse2(sum, c, _mm_and_pd(ord, v));
+    else
+      sum = _mm_add_pd(sum, _mm_and_pd(ord, v));
+    mn = _mm_min_pd(mn, _mm_or_pd(_mm_and_pd(ord, v), _mm_andnot_pd(ord, inf)));
+    mx = _mm_max_pd(mx, _mm_or_pd(_mm_and_pd(ord, v), _mm_andnot_pd(ord, ninf)));
+    count += popcount4(_mm_movemask_pd(ord));
+  }
+  double sums[2], comps[2], mins[2], maxs[2];
+  _mm_storeu_pd(sums, sum); _mm_storeu_pd(comps, c); _mm_storeu_pd(mins, mn); _mm_storeu_pd(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 2, r, comp);
+  r.count += count;
+  return m;
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void kahan_add_avx2(__m256& sum, __m256& c, __m256 v)
+{
+  const __m256 y = _mm256_sub_ps(v, c);
+  __m256 t = _mm256_add_ps(sum, y);
+  AK_TOOLKIT_OPAQUE_FP(t);
+  __m256 d = _mm256_sub_ps(t, sum);
+  AK_TOOLKIT_OPAQUE_FP(d);
+  c = _mm256_sub_ps(d, y);
+  sum = t;
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void kahan_add_avx2(__m256d& sum, __m256d& c, __m256d v)
+{
+  const __m256d y = _mm256_sub_pd(v, c);
+  __m256d t = _mm256_add_pd(sum, y);
+  AK_TOOLKIT_OPAQUE_FP(t);
+  __m256d d = _mm256_sub_pd(t, sum);
+  AK_TOOLKIT_OPAQUE_FP(d);
+  c = _mm256_sub_pd(d, y);
+  sum = t;
+}
+
+template <bool Compensated>
+AK_TOOLKIT_TARGET("avx2")
+inline std::size_t summarize_avx2(const float* p, std::size_t n, fp_summary<float>& r, float& comp)
+{
+  const std::size_t m = n - n % 8;
+  const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 ninf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  __m256 sum = _mm256_setzero_ps(), c = _mm256_setzero_ps(), mn = inf, mx = ninf;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 8)
+  {
+    const __m256 v = _mm256_loadu_ps(p + i);
+    const __m256 ord = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+    if (Compensated)
+      kahan_add_avx2(sum, c, _mm256_and_ps(ord, v));
+    else
+      sum = _mm256_add_ps(sum, _mm256_and_ps(ord, v));
+    mn = _mm256_min_ps(mn, _mm256_blendv_ps(inf, v, ord));
+    mx = _mm256_max_ps(mx, _mm256_blendv_ps(ninf, v, ord));
+    count += __builtin_popcount(unsigned(_mm256_movemask_ps(ord)));
+  }
+  float sums[8], comps[8], mins[8], maxs[8];
+  _mm256_storeu_ps(sums, sum); _mm256_storeu_ps(comps, c); _mm256_storeu_ps(mins, mn); _mm256_storeu_ps(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 8, r, comp);
+  r.count += count;
+  return m;
+}
+
+template <bool Compensated>
+AK_TOOLKIT_TARGET("avx2")
+inline std::size_t summarize_avx2(const double* p, std::size_t n, fp_summary<double>& r, double& comp)
+{
+  const std::size_t m = n - n % 4;
+  const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+  const __m256d ninf = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+  __m256d sum = _mm256_setzero_pd(), c = _mm256_setzero_pd(), mn = inf, mx = ninf;
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 4)
+  {
+    const __m256d v = _mm256_loadu_pd(p + i);
+    const __m256d ord = _mm256_cmp_pd(v, v, _CMP_ORD_Q);
+    if (Compensated)
+      kahan_add_avx2(sum, c, _mm256_and_pd(ord, v));
+    else
+      sum = _mm256_add_pd(sum, _mm256_and_pd(ord, v));
+    mn = _mm256_min_pd(mn, _mm256_blendv_pd(inf, v, ord));
+    mx = _mm256_max_pd(mx, _mm256_blendv_pd(ninf, v, ord));
+    count += __builtin_popcount(unsigned(_mm256_movemask_pd(ord)));
+  }
+  double sums[4], comps[4], mins[4], maxs[4];
+  _mm256_storeu_pd(sums, sum); _mm256_storeu_pd(comps, c); _mm256_storeu_pd(mins, mn); _mm256_storeu_pd(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 4, r, comp);
+  r.count += count;
+  return m;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void kahan_add_avx512(__m512& sum, __m512& c, __m512 v)
+{
+  const __m512 y = _mm512_sub_ps(v, c);
+  __m512 t = _mm512_add_ps(sum, y);
+  AK_TOOLKIT_OPAQUE_ZMM(t);
+  __m512 d = _mm512_sub_ps(t, sum);
+  AK_TOOLKIT_OPAQUE_ZMM(d);
+  c = _mm512_sub_ps(d, y);
+  sum = t;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void kahan_add_avx512(__m512d& sum, __m512d& c, __m512d v)
+{
+  const __m512d y = _mm512_sub_pd(v, c);
+  __m512d t = _mm512_add_pd(sum, y);
+  AK_TOOLKIT_OPAQUE_ZMM(t);
+  __m512d d = _mm512_sub_pd(t, sum);
+  AK_TOOLKIT_OPAQUE_ZMM(d);
+  c = _mm512_sub_pd(d, y);
+  sum = t;
+}
+
+template <bool Compensated>
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline std::size_t summarize_avx512(const float* p, std::size_t n, fp_summary<float>& r, float& comp)
+{
+  const std::size_t m = n - n % 16;
+  __m512 sum = _mm512_setzero_ps(), c = _mm512_setzero_ps();
+  __m512 mn = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+  __m512 mx = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 16)
+  {
+    const __m512 v = _mm512_loadu_ps(p + i);
+    const __mmask16 ord = _mm512_cmp_ps_mask(v, v, _CMP_ORD_Q);
+    if (Compensated)
+      kahan_add_avx512(sum, c, _mm512_maskz_mov_ps(ord, v));
+    else
+      sum = _mm512_mask_add_ps(sum, ord, sum, v);
+    mn = _mm512_mask_min_ps(mn, ord, mn, v);
+    mx = _mm512_mask_max_ps(mx, ord, mx, v);
+    count += __builtin_popcount(unsigned(ord));
+  }
+  float sums[16], comps[16], mins[16], maxs[16];
+  _mm512_storeu_ps(sums, sum); _mm512_storeu_ps(comps, c); _mm512_storeu_ps(mins, mn); _mm512_storeu_ps(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 16, r, comp);
+  r.count += count;
+  return m;
+}
+
+template <bool Compensated>
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline std::size_t summarize_avx512(const double* p, std::size_t n, fp_summary<double>& r, double& comp)
+{
+  const std::size_t m = n - n % 8;
+  __m512d sum = _mm512_setzero_pd(), c = _mm512_setzero_pd();
+  __m512d mn = _mm512_set1_pd(std::numeric_limits<double>::infinity());
+  __m512d mx = _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 8)
+  {
+    const __m512d v = _mm512_loadu_pd(p + i);
+    const __mmask8 ord = _mm512_cmp_pd_mask(v, v, _CMP_ORD_Q);
+    if (Compensated)
+      kahan_add_avx512(sum, c, _mm512_maskz_mov_pd(ord, v));
+    else
+      sum = _mm512_mask_add_pd(sum, ord, sum, v);
+    mn = _mm512_mask_min_pd(mn, ord, mn, v);
+    mx = _mm512_mask_max_pd(mx, ord, mx, v);
+    count += __builtin_popcount(unsigned(ord));
+  }
+  double sums[8], comps[8], mins[8], maxs[8];
+  _mm512_storeu_pd(sums, sum); _mm512_storeu_pd(comps, c); _mm512_storeu_pd(mins, mn); _mm512_storeu_pd(maxs, mx);
+  merge_summary_lanes<Compensated>(sums, comps, mins, maxs, 8, r, comp);
+  r.count += count;
+  return m;
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+template <bool Compensated, typename FPT>
+std::size_t summarize_simd(const FPT* p, std::size_t n, fp_summary<FPT>& r, FPT& comp, simd_level level)
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  switch (level)
+  {
+    case simd_level::avx512: return summarize_avx512<Compensated>(p, n, r, comp);
+    case simd_level::avx2:   return summarize_avx2<Compensated>(p, n, r, comp);
+    case simd_level::sse2:   return summarize_sse2<Compensated>(p, n, r, comp);
+    case simd_level::scalar: break;
+  }
+#else
+  (void)p; (void)n; (void)r; (void)comp; (void)level;
+#endif
+  return 0;
+}
+
+template <bool Compensated, typename FPT>
+fp_summary<FPT> summarize_fp(const FPT* p, std::size_t n, simd_level level)
+{
+  fp_summary<FPT> ans = empty_fp_summary<FPT>();
+  FPT comp = 0;
+  const std::size_t done = summarize_simd<Compensated>(p, n, ans, comp, level);
+  summarize_scalar<Compensated>(p + done, n - done, ans, comp);
+  if (Compensated)
+    ans.sum = compensated_total(ans.sum, comp);
+  return ans;
+}
+
+template <typename FPT>
+fp_summary<FPT> summarize_pairwise(const FPT* p, std::size_t n, simd_level level)
+{
+  const std::size_t block = 1024;
+  if (n <= block)
+    return summarize_fp<false>(p, n, level);
+
+  const std::size_t half = (n / 2 + block - 1) / block * block;
+  const fp_summary<FPT> l = summarize_pairwise(p, half, level);
+  const fp_summary<FPT> r = summarize_pairwise(p + half, n - half, level);
+  fp_summary<FPT> ans = { l.count + r.count, l.sum + r.sum, r.min < l.min ? r.min : l.min, l.max < r.max ? r.max : l.max };
+  return ans;
+}
+
+template <typename MP>
+fp_summary<typename MP::representation_type>
+summarize_column(const typename MP::representation_type* p, std::size_t n, simd_level level, summation method, nan_kernel_tag)
+{
+  typedef typename MP::representation_type FPT;
+  const FPT inf = std::numeric_limits<FPT>::infinity();
+  fp_summary<FPT> ans;
+
+  switch (method)
+  {
+    case summation::pairwise:
+      return summarize_pairwise(p, n, level);
+    case summation::kahan:
+      ans = summarize_fp<true>(p, n, level);
+      // compensations of infinite sums are NaNs: the sum is that of the infinities
+      if (ans.count && (ans.min == -inf || ans.max == inf))
+        ans.sum = ans.min == -inf && ans.max == inf ? (ans.max + ans.min) : (ans.max == inf ? inf : -inf);
+      // a SIMD lane whose sum of finite values overflows ends up with a NaN
+      // sum; such columns are rare and summed again without compensation
+      else if (is_nan_bits(ans.sum))
+        ans.sum = summarize_fp<false>(p, n, level).sum;
+      return ans;
+    case summation::simple:
+      break;
+  }
+  return summarize_fp<false>(p, n, level);
+}
+
+
+// The exact sum of integers, as a 128-bit two's complement number
+struct wide_sum
+{
+  std::uint64_t lo;
+  std::int64_t hi;
+
+  void add_bits(std::uint64_t l, std::int64_t h) AK_TOOLKIT_NOEXCEPT
+  {
+    const std::uint64_t s = lo + l;
+    hi += h + std::int64_t(s < lo);
+    lo = s;
+  }
+  void add(std::int64_t v) AK_TOOLKIT_NOEXCEPT { add_bits(std::uint64_t(v), v < 0 ? -1 : 0); }
+  void add(std::uint64_t v) AK_TOOLKIT_NOEXCEPT { add_bits(v, 0); }
+
+  // adds v * 2^shift, for 0 < shift < 64
+  void add_shifted(std::uint64_t v, unsigned shift) AK_TOOLKIT_NOEXCEPT { add_bits(v << shift, std::int64_t(v >> (64 - shift))); }
+
+  bool fits(std::int64_t) const AK_TOOLKIT_NOEXCEPT { return hi == (std::int64_t(lo) < 0 ? -1 : 0); }
+  bool fits(std::uint64_t) const AK_TOOLKIT_NOEXCEPT { return hi == 0; }
+
+  double to_double() const AK_TOOLKIT_NOEXCEPT { return double(hi) * 18446744073709551616.0 + double(lo); }
+};
+
+// The integer kernels work on 32- and 64-bit lanes compared as signed. For
+// unsigned columns, values are biased by flipping the top bit: `min`, `max`
+// and `sum` are of the biased values, and the caller corrects them.
+
+template <typename I>
+struct int_partial
+{
+  std::size_t count;
+  wide_sum sum;
+  I min;
+  I max;
+};
+
+template <typename I>
+void merge_minmax_lanes(const I* mins, const I* maxs, unsigned lanes, int_partial<I>& r)
+{
+  for (unsigned j = 0; j != lanes; ++j)
+  {
+    r.min = mins[j] < r.min ? mins[j] : r.min;
+    r.max = r.max < maxs[j] ? maxs[j] : r.max;
+  }
+}
+
+template <typename I>
+void merge_int_lanes(const std::int64_t* sums, unsigned sum_lanes, const I* mins, const I* maxs, unsigned lanes, int_partial<I>& r)
+{
+  for (unsigned j = 0; j != sum_lanes; ++j)
+    r.sum.add(sums[j]);
+  merge_minmax_lanes(mins, maxs, lanes, r);
+}
+
+inline void merge_int_lanes(const std::uint64_t* los, const std::int64_t* his, const std::int64_t* mins, const std::int64_t* maxs, unsigned lanes, int_partial<std::int64_t>& r)
+{
+  for (unsigned j = 0; j != lanes; ++j)
+    r.sum.add_bits(los[j], his[j]);
+  merge_minmax_lanes(mins, maxs, lanes, r);
+}
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+// Marked lanes contribute 0 to the sum, the largest value to the minimum and
+// the smallest to the maximum. 32-bit lanes are summed in 64-bit lanes: the
+// caller passes at most 2^31 elements. 64-bit lanes are summed in two lanes,
+// with the carries and sign extensions in the high one.
+
+inline std::size_t summarize_sse2(const std::uint32_t* p, std::size_t n, std::uint32_t s, std::uint32_t bias, int_partial<std::int32_t>& r)
+{
+  const std::size_t m = n - n % 4;
+  const __m128i sv = _mm_set1_epi32(int(s)), bv = _mm_set1_epi32(int(bias)), zero = _mm_setzero_si128();
+  const __m128i largest = _mm_set1_epi32(std::numeric_limits<std::int32_t>::max());
+  const __m128i smallest = _mm_set1_epi32(std::numeric_limits<std::int32_t>::min());
+  __m128i sum = zero, mn = largest, mx = smallest;
+  std::size_t marked = 0;
+  for (std::size_t i = 0; i != m; i += 4)
+  {
+    const __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    const __m128i eq = _mm_cmpeq_epi32(u, sv);
+    const __m128i x = _mm_andnot_si128(eq, _mm_xor_si128(u, bv));
+    const __m128i ext = _mm_cmpgt_epi32(zero, x);
+    sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(x, ext));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(x, ext));
+    const __m128i xmin = _mm_or_si128(_mm_and_si128(eq, largest), x);
+    const __m128i lt = _mm_cmpgt_epi32(mn, xmin);
+    mn = _mm_or_si128(_mm_and_si128(lt, xmin), _mm_andnot_si128(lt, mn));
+    const __m128i xmax = _mm_or_si128(_mm_and_si128(eq, smallest), x);
+    const __m128i gt = _mm_cmpgt_epi32(xmax, mx);
+    mx = _mm_or_si128(_mm_and_si128(gt, xmax), _mm_andnot_si128(gt, mx));
+    marked += popcount4(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+  }
+  std::int64_t sums[2];
+  std::int32_t mins[4], maxs[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(mins), mn);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(maxs), mx);
+  merge_int_lanes(sums, 2, mins, maxs, 4, r);
+  r.count += m - marked;
+  return m;
+}
+
+// Below AVX-512, 64-bit lanes are left to the scalar kernel: without 64-bit
+// min, max and unsigned comparisons, SIMD is no faster.
+inline std::size_t summarize_sse2(const std::uint64_t*, std::size_t, std::uint64_t, std::uint64_t, int_partial<std::int64_t>&)
+{
+  return 0;
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline std::size_t summarize_avx2(const std::uint32_t* p, std::size_t n, std::uint32_t s, std::uint32_t bias, int_partial<std::int32_t>& r)
+{
+  const std::size_t m = n - n % 8;
+  const __m256i sv = _mm256_set1_epi32(int(s)), bv = _mm256_set1_epi32(int(bias));
+  const __m256i largest = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::max());
+  const __m256i smallest = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::min());
+  __m256i sum = _mm256_setzero_si256(), mn = largest, mx = smallest;
+  std::size_t marked = 0;
+  for (std::size_t i = 0; i != m; i += 8)
+  {
+    const __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    const __m256i eq = _mm256_cmpeq_epi32(u, sv);
+    const __m256i x = _mm256_andnot_si256(eq, _mm256_xor_si256(u, bv));
+    sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+    sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    mn = _mm256_min_epi32(mn, _mm256_or_si256(_mm256_and_si256(eq, largest), x));
+    mx = _mm256_max_epi32(mx, _mm256_or_si256(_mm256_and_si256(eq, smallest), x));
+    marked += __builtin_popcount(unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(eq))));
+  }
+  std::int64_t sums[4];
+  std::int32_t mins[8], maxs[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), sum);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(mins), mn);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(maxs), mx);
+  merge_int_lanes(sums, 4, mins, maxs, 8, r);
+  r.count += m - marked;
+  return m;
+}
+
+inline std::size_t summarize_avx2(const std::uint64_t*, std::size_t, std::uint64_t, std::uint64_t, int_partial<std::int64_t>&)
+{
+  return 0;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline std::size_t summarize_avx512(const std::uint32_t* p, std::size_t n, std::uint32_t s, std::uint32_t bias, int_partial<std::int32_t>& r)
+{
+  const std::size_t m = n - n % 16;
+  const __m512i sv = _mm512_set1_epi32(int(s)), bv = _mm512_set1_epi32(int(bias));
+  __m512i sum = _mm512_setzero_si512();
+  __m512i mn = _mm512_set1_epi32(std::numeric_limits<std::int32_t>::max());
+  __m512i mx = _mm512_set1_epi32(std::numeric_limits<std::int32_t>::min());
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 16)
+  {
+    const __m512i u = _mm512_loadu_si512(p + i);
+    const __mmask16 has = _mm512_cmpneq_epi32_mask(u, sv);
+    const __m512i x = _mm512_maskz_xor_epi32(has, u, bv);
+    sum = _mm512_add_epi64(sum, _mm512_maskz_cvtepi32_epi64(0xFF, _mm512_maskz_extracti64x4_epi64(0xF, x, 0)));
+    sum = _mm512_add_epi64(sum, _mm512_maskz_cvtepi32_epi64(0xFF, _mm512_maskz_extracti64x4_epi64(0xF, x, 1)));
+    mn = _mm512_mask_min_epi32(mn, has, mn, x);
+    mx = _mm512_mask_max_epi32(mx, has, mx, x);
+    count += __builtin_popcount(unsigned(has));
+  }
+  std::int64_t sums[8];
+  std::int32_t mins[16], maxs[16];
+  _mm512_storeu_si512(sums, sum); _mm512_storeu_si512(mins, mn); _mm512_storeu_si512(maxs, mx);
+  merge_int_lanes(sums, 8, mins, maxs, 16, r);
+  r.count += count;
+  return m;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline std::size_t summarize_avx512(const std::uint64_t* p, std::size_t n, std::uint64_t s, std::uint64_t bias, int_partial<std::int64_t>& r)
+{
+  const std::size_t m = n - n % 8;
+  const __m512i sv = _mm512_set1_epi64((long long)(s)), bv = _mm512_set1_epi64((long long)(bias));
+  const __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi64(1);
+  __m512i lo = zero, hi = zero;
+  __m512i mn = _mm512_set1_epi64(std::numeric_limits<long long>::max());
+  __m512i mx = _mm512_set1_epi64(std::numeric_limits<long long>::min());
+  std::size_t count = 0;
+  for (std::size_t i = 0; i != m; i += 8)
+  {
+    const __m512i u = _mm512_loadu_si512(p + i);
+    const __mmask8 has = _mm512_cmpneq_epi64_mask(u, sv);
+    const __m512i x = _mm512_maskz_xor_epi64(has, u, bv);
+    const __m512i next = _mm512_add_epi64(lo, x);
+    hi = _mm512_mask_add_epi64(hi, _mm512_cmplt_epu64_mask(next, lo), hi, one);
+    hi = _mm512_mask_sub_epi64(hi, _mm512_cmplt_epi64_mask(x, zero), hi, one);
+    lo = next;
+    mn = _mm512_mask_min_epi64(mn, has, mn, x);
+    mx = _mm512_mask_max_epi64(mx, has, mx, x);
+    count += __builtin_popcount(unsigned(has));
+  }
+  std::uint64_t los[8];
+  std::int64_t his[8], mins[8], maxs[8];
+  _mm512_storeu_si512(los, lo); _mm512_storeu_si512(his, hi); _mm512_storeu_si512(mins, mn); _mm512_storeu_si512(maxs, mx);
+  merge_int_lanes(los, his, mins, maxs, 8, r);
+  r.count += count;
+  return m;
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+template <typename T>
+void summarize_scalar(const T* p, std::size_t n, T s, int_summary<T>& r, wide_sum& sum)
+{
+  typedef typename int_summary<T>::sum_type S;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    const bool has = p[i] != s;
+    const T v = p[i];
+    r.count += has;
+    sum.add(has ? S(v) : S(0));
+    r.min = (has && v < r.min) ? v : r.min;
+    r.max = (has && r.max < v) ? v : r.max;
+  }
+}
+
+// For 8- and 16-bit columns there are no kernels
+template <typename T>
+std::size_t summarize_simd(const T*, std::size_t, T, int_summary<T>&, wide_sum&, simd_level, std::false_type)
+{
+  return 0;
+}
+
+template <typename T>
+std::size_t summarize_simd(const T* p, std::size_t n, T s, int_summary<T>& r, wide_sum& sum, simd_level level, std::true_type)
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  typedef typename uint_of_size<sizeof(T)>::type U;
+  typedef typename std::make_signed<U>::type I;
+  const unsigned top = sizeof(T) * 8 - 1;
+  const U bias = std::is_signed<T>::value ? U(0) : U(U(1) << top);
+  const std::size_t chunk = std::size_t(1) << 31;
+  const U* u = reinterpret_cast<const U*>(p);
+
+  std::size_t done = 0;
+  while (done != n)
+  {
+    const std::size_t m = n - done < chunk ? n - done : chunk;
+    int_partial<I> part = { 0, { 0, 0 }, std::numeric_limits<I>::max(), std::numeric_limits<I>::min() };
+    std::size_t k = 0;
+    switch (level)
+    {
+      case simd_level::avx512: k = summarize_avx512(u + done, m, U(s), bias, part); break;
+      case simd_level::avx2:   k = summarize_avx2(u + done, m, U(s), bias, part);   break;
+      case simd_level::sse2:   k = summarize_sse2(u + done, m, U(s), bias, part);   break;
+      case simd_level::scalar: break;
+    }
+
+    r.count += part.count;
+    sum.add_bits(part.sum.lo, part.sum.hi);
+    if (bias)
+      sum.add_shifted(part.count, top);
+    const T mn = T(U(part.min) ^ bias), mx = T(U(part.max) ^ bias);
+    r.min = mn < r.min ? mn : r.min;
+    r.max = r.max < mx ? mx : r.max;
+
+    done += k;
+    if (k != m)
+      break;
+  }
+  return done;
+#else
+  (void)p; (void)n; (void)s; (void)r; (void)sum; (void)level;
+  return 0;
+#endif
+}
+
+template <typename MP>
+int_summary<typename MP::representation_type>
+summarize_ints(const typename MP::representation_type* p, std::size_t n, simd_level level, wide_sum& sum)
+{
+  typedef typename MP::representation_type T;
+  typedef typename int_summary<T>::sum_type S;
+  const T s = MP::marked_value();
+
+  int_summary<T> ans = { 0, 0, false, std::numeric_limits<T>::max(), std::numeric_limits<T>::min() };
+  sum.lo = 0;
+  sum.hi = 0;
+  const std::size_t done = summarize_simd(p, n, s, ans, sum, level, std::integral_constant<bool, sizeof(T) == 4 || sizeof(T) == 8>{});
+  summarize_scalar(p + done, n - done, s, ans, sum);
+  ans.sum = S(sum.lo);
+  ans.overflow = !sum.fits(S());
+  return ans;
+}
+
+template <typename MP>
+int_summary<typename MP::representation_type>
+summarize_column(const typename MP::representation_type* p, std::size_t n, simd_level level, summation, sentinel_kernel_tag)
+{
+  wide_sum sum;
+  return summarize_ints<MP>(p, n, level, sum);
+}
+
+} // namespace detail_
+
+
+// Summaries of columns of mark_int, mark_enum and mark_bool (int_summary of
+// the representation type) and of mark_fp_nan (fp_summary). `method` only
+// affects floating-point sums.
+
+template <typename MP>
+typename detail_::summary_of<MP>::type
+summarize(const typename MP::representation_type* first, std::size_t n, simd_level level = detected_simd_level(), summation method = summation::simple)
+{
+  static_assert(is_single_sentinel_policy<MP>::value || is_nan_policy<MP>::value, "summarize requires mark_int, mark_enum, mark_bool or mark_fp_nan");
+
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+
+  return detail_::summarize_column<MP>(first, n, level, method, typename detail_::kernel_tag<MP>::type{});
+}
+
+template <typename MP, typename OP>
+typename detail_::summary_of<MP>::type
+summarize(const markable<MP, OP>* first, std::size_t n, simd_level level = detected_simd_level(), summation method = summation::simple)
+{
+  static_assert(sizeof(markable<MP, OP>) == sizeof(typename MP::representation_type), "markable must not add storage");
+  return summarize<MP>(reinterpret_cast<const typename MP::representation_type*>(first), n, level, method);
+}
+
+template <typename MP, typename OP>
+typename detail_::summary_of<MP>::type
+summarize(const markable_vector<MP, OP>& v, simd_level level = detected_simd_level(), summation method = summation::simple)
+{
+  return summarize<MP>(v.data(), v.size(), level, method);
+}
+
+template <typename MP, typename OP>
+typename detail_::summary_of<MP>::type
+summarize(const_markable_span<MP, OP> v, simd_level level = detected_simd_level(), summation method = summation::simple)
+{
+  return summarize<MP>(v.data(), v.size(), level, method);
+}
+
+
+template <typename MP, typename OP>
+std::size_t count_values(const markable<MP, OP>* first, std::size_t n)
+{
+  return summarize(first, n).count;
+}
+
+template <typename FPT, typename OP>
+FPT sum_values(const markable<mark_fp_nan<FPT>, OP>* first, std::size_t n, summation method = summation::simple)
+{
+  return summarize(first, n, detected_simd_level(), method).sum;
+}
+
+// The following return a marked value if there are no values in the input
+
+namespace detail_ {
+
+// Every value of sum_type is a possible sum of integers, so none can be the
+// mark: a sum is stored with a flag, as a minimal optional for mark_optional.
+template <typename S>
+struct optional_sum
+{
+  typedef S value_type;
+
+  S sum;
+  bool valid;
+
+  optional_sum() AK_TOOLKIT_NOEXCEPT : sum(), valid(false) {}
+  optional_sum(S s) AK_TOOLKIT_NOEXCEPT : sum(s), valid(true) {}
+  bool operator!() const AK_TOOLKIT_NOEXCEPT { return !valid; }
+  const S& operator*() const AK_TOOLKIT_NOEXCEPT { return sum; }
+};
+
+template <typename MP, typename OP, typename Tag = typename kernel_tag<MP>::type>
+struct sum_markable
+{
+  typedef markable<MP, OP> type;
+};
+
+template <typename MP, typename OP>
+struct sum_markable<MP, OP, sentinel_kernel_tag>
+{
+  typedef typename int_summary<typename MP::representation_type>::sum_type S;
+  typedef markable<mark_optional<optional_sum<S>>, OP> type;
+};
+
+template <typename MP, typename OP, typename Tag = typename kernel_tag<MP>::type>
+struct mean_markable
+{
+  typedef markable<MP, OP> type;
+};
+
+template <typename MP, typename OP>
+struct mean_markable<MP, OP, sentinel_kernel_tag>
+{
+  typedef markable<mark_fp_nan<double>, OP> type;
+};
+
+// a sum that overflows has no value
+template <typename MP, typename OP>
+typename sum_markable<MP, OP>::type sum_value(const markable<MP, OP>* first, std::size_t n, summation, sentinel_kernel_tag)
+{
+  typedef typename sum_markable<MP, OP>::type R;
+  const int_summary<typename MP::representation_type> s = summarize(first, n);
+  return s.count && !s.overflow ? R(s.sum) : R();
+}
+
+template <typename MP, typename OP>
+typename sum_markable<MP, OP>::type sum_value(const markable<MP, OP>* first, std::size_t n, summation method, nan_kernel_tag)
+{
+  typedef typename sum_markable<MP, OP>::type R;
+  const fp_summary<typename MP::representation_type> s = summarize(first, n, detected_simd_level(), method);
+  return s.count ? R(s.sum) : R();
+}
+
+// the mean of integers is computed from their exact sum
+template <typename MP, typename OP>
+typename mean_markable<MP, OP>::type mean_value(const markable<MP, OP>* first, std::size_t n, summation, sentinel_kernel_tag)
+{
+  typedef typename mean_markable<MP, OP>::type R;
+  wide_sum sum;
+  const int_summary<typename MP::representation_type> s = summarize_ints<MP>(reinterpret_cast<const typename MP::representation_type*>(first), n, detected_simd_level(), sum);
+  return s.count ? R(sum.to_double() / double(s.count)) : R();
+}
+
+template <typename MP, typename OP>
+typename mean_markable<MP, OP>::type mean_value(const markable<MP, OP>* first, std::size_t n, summation method, nan_kernel_tag)
+{
+  typedef typename mean_markable<MP, OP>::type R;
+  typedef typename MP::representation_type FPT;
+  const fp_summary<FPT> s = summarize(first, n, detected_simd_level(), method);
+  return s.count ? R(s.sum / FPT(s.count)) : R();
+}
+
+} // namespace detail_
+
+template <typename MP, typename OP>
+typename detail_::sum_markable<MP, OP>::type sum_value(const markable<MP, OP>* first, std::size_t n, summation method = summation::simple)
+{
+  return detail_::sum_value(first, n, method, typename detail_::kernel_tag<MP>::type{});
+}
+
+template <typename MP, typename OP>
+markable<MP, OP> min_value(const markable<MP, OP>* first, std::size_t n)
+{
+  const typename detail_::summary_of<MP>::type s = summarize(first, n);
+  return s.count ? markable<MP, OP>(with_representation, s.min) : markable<MP, OP>();
+}
+
+template <typename MP, typename OP>
+markable<MP, OP> max_value(const markable<MP, OP>* first, std::size_t n)
+{
+  const typename detail_::summary_of<MP>::type s = summarize(first, n);
+  return s.count ? markable<MP, OP>(with_representation, s.max) : markable<MP, OP>();
+}
+
+// For integral columns the mean is a markable<mark_fp_nan<double>>
+template <typename MP, typename OP>
+typename detail_::mean_markable<MP, OP>::type mean_value(const markable<MP, OP>* first, std::size_t n, summation method = summation::simple)
+{
+  return detail_::mean_value(first, n, method, typename detail_::kernel_tag<MP>::type{});
+}
+
+} // namespace markable_ns
+
+using markable_ns::fp_summary;
+using markable_ns::int_summary;
+using markable_ns::summation;
+using markable_ns::summarize;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_AGGREGATE_HEADER_GUARD_
@@ -0,0 +1,325 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
+
+#include "markable_mask.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdint.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined __BYTE_ORDER__ && defined __ORDER_LITTLE_ENDIAN__
+static_assert (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "markable_arrow.hpp stores validity bitmaps as 64-bit words in the Arrow bit order");
+#endif
+
+// The Arrow C Data Interface structures, as given in the Arrow specification.
+// The guard allows including this header together with other Arrow headers.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+// The Arrow format string of a primitive representation type
+
+template <typename Rep, bool = std::is_integral<Rep>::value>
+struct arrow_format_of
+{
+  static_assert (sizeof(Rep) == 0, "the representation type has no Arrow primitive type");
+};
+
+template <typename Rep>
+struct arrow_format_of<Rep, true>
+{
+  static const char* get()
+  {
+    const bool s = std::is_signed<Rep>::value;
+    switch (sizeof(Rep))
+    {
+      case 1: return s ? "c" : "C";
+      case 2: return s ? "s" : "S";
+      case 4: return s ? "i" : "I";
+      default: return s ? "l" : "L";
+    }
+  }
+};
+
+template <> struct arrow_format_of<float, false>  { static const char* get() { return "f"; } };
+template <> struct arrow_format_of<double, false> { static const char* get() { return "g"; } };
+
+// mark_bool is exported as an Arrow boolean: values are packed into bits
+template <typename MP> struct is_arrow_bool : std::false_type {};
+template <> struct is_arrow_bool<mark_bool> : std::true_type {};
+
+template <typename MP>
+const char* arrow_format()
+{
+  return is_arrow_bool<MP>::value ? "b" : arrow_format_of<typename MP::representation_type>::get();
+}
+
+struct arrow_no_owner {};
+
+// Owns everything an exported array refers to, except the borrowed values.
+template <typename Owner>
+struct arrow_export_data
+{
+  Owner owner;
+  std::vector<std::uint64_t> validity;
+  std::vector<std::uint64_t> packed_values; // only for booleans
+  const void* buffers[2];
+
+  explicit arrow_export_data(Owner&& o) : owner(std::move(o)), validity(), packed_values(), buffers() {}
+};
+
+template <typename Data>
+void release_arrow_array(ArrowArray* array)
+{
+  delete static_cast<Data*>(array->private_data);
+  array->release = nullptr;
+}
+
+inline void release_arrow_schema(ArrowSchema* schema)
+{
+  schema->release = nullptr;
+}
+
+inline void export_arrow_schema(const char* format, ArrowSchema* out)
+{
+  out->format = format;
+  out->name = nullptr;
+  out->metadata = nullptr;
+  out->flags = ARROW_FLAG_NULLABLE;
+  out->n_children = 0;
+  out->children = nullptr;
+  out->dictionary = nullptr;
+  out->release = &release_arrow_schema;
+  out->private_data = nullptr;
+}
+
+// for bools, bit i of the values is set iff the element has value true
+template <typename MP>
+void pack_arrow_values(const typename MP::representation_type* p, std::size_t n, std::vector<std::uint64_t>& out, std::true_type)
+{
+  out.assign(bitmap_words(n), 0);
+  for (std::size_t i = 0; i != n; ++i)
+    out[i / 64] |= std::uint64_t(p[i] == 1) << (i % 64);
+}
+
+template <typename MP>
+void pack_arrow_values(const typename MP::representation_type*, std::size_t, std::vector<std::uint64_t>&, std::false_type)
+{
+}
+
+template <typename MP, typename Owner>
+void export_arrow_array(const typename MP::representation_type* p, std::size_t n, Owner&& owner, ArrowArray* out)
+{
+  typedef arrow_export_data<typename std::decay<Owner>::type> data_type;
+  data_type* d = new data_type(std::move(owner));
+
+  try {
+    d->validity.resize(bitmap_words(n));
+    compute_value_mask<MP>(p, n, d->validity.data());
+    pack_arrow_values<MP>(p, n, d->packed_values, is_arrow_bool<MP>{});
+  }
+  catch (...) {
+    delete d;
+    throw;
+  }
+
+  std::size_t null_count = n;
+  for (std::uint64_t w : d->validity)
+    null_count -= popcount64(w);
+
+  d->buffers[0] = null_count == 0 ? nullptr : d->validity.data(); // no bitmap: all values present
+  d->buffers[1] = is_arrow_bool<MP>::value ? static_cast<const void*>(d->packed_values.data()) : p;
+
+  out->length = std::int64_t(n);
+  out->null_count = std::int64_t(null_count);
+  out->offset = 0;
+  out->n_buffers = 2;
+  out->n_children = 0;
+  out->buffers = d->buffers;
+  out->children = nullptr;
+  out->dictionary = nullptr;
+  out->release = &release_arrow_array<data_type>;
+  out->private_data = d;
+}
+
+// Copies n bits starting at bit `offset` of a byte buffer into 64-bit words.
+inline void copy_arrow_bits(const std::uint8_t* src, std::size_t offset, std::size_t n, std::uint64_t* out)
+{
+  const std::size_t end_byte = (offset + n + 7) / 8;
+  const unsigned shift = unsigned(offset % 8);
+  for (std::size_t w = 0; w != bitmap_words(n); ++w)
+  {
+    const std::size_t first = offset / 8 + w * 8;
+    std::uint64_t word = 0;
+    for (std::size_t k = 0; k != 8 && first + k < end_byte; ++k)
+      word |= std::uint64_t(src[first + k]) << (8 * k);
+    word >>= shift;
+    if (shift != 0 && first + 8 < end_byte)
+      word |= std::uint64_t(src[first + 8]) << (64 - shift);
+    out[w] = word;
+  }
+  if (n % 64 != 0)
+    out[n / 64] &= (std::uint64_t(1) << (n % 64)) - 1;
+}
+
+template <typename MP>
+void import_arrow_values(const ArrowArray* array, std::size_t n, std::size_t offset, typename MP::representation_type* out, std::true_type)
+{
+  std::vector<std::uint64_t> bits (bitmap_words(n));
+  copy_arrow_bits(static_cast<const std::uint8_t*>(array->buffers[1]), offset, n, bits.data());
+  for (std::size_t i = 0; i != n; ++i)
+    out[i] = char((bits[i / 64] >> (i % 64)) & 1);
+}
+
+template <typename MP>
+void import_arrow_values(const ArrowArray* array, std::size_t n, std::size_t offset, typename MP::representation_type* out, std::false_type)
+{
+  const typename MP::representation_type* values = static_cast<const typename MP::representation_type*>(array->buffers[1]);
+  if (n != 0)
+    std::memcpy(out, values + offset, n * sizeof(*out));
+}
+
+} // namespace detail_
+
+
+// Exports a column through the Arrow C Data Interface. The values are not
+// copied (except for mark_bool, which Arrow stores as bits): marked values stay
+// in place under a cleared validity bit. The column must outlive the release
+// of the exported array.
+
+template <typename MP, typename OP>
+void export_arrow(const_markable_span<MP, OP> s, ArrowArray* out_array, ArrowSchema* out_schema)
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "export_arrow requires storage_type to be the same as representation_type");
+  const char* format = detail_::arrow_format<MP>();
+  detail_::export_arrow_array<MP>(s.data(), s.size(), detail_::arrow_no_owner{}, out_array);
+  detail_::export_arrow_schema(format, out_schema);
+}
+
+template <typename MP, typename OP>
+void export_arrow(markable_span<MP, OP> s, ArrowArray* out_array, ArrowSchema* out_schema)
+{
+  export_arrow(const_markable_span<MP, OP>(s), out_array, out_schema);
+}
+
+template <typename MP, typename OP>
+void export_arrow(const markable_vector<MP, OP>& v, ArrowArray* out_array, ArrowSchema* out_schema)
+{
+  export_arrow(const_markable_span<MP, OP>(v), out_array, out_schema);
+}
+
+// The exported array takes over the vector: it is destroyed by the release callback.
+template <typename MP, typename OP>
+void export_arrow(markable_vector<MP, OP>&& v, ArrowArray* out_array, ArrowSchema* out_schema)
+{
+  const char* format = detail_::arrow_format<MP>();
+  markable_vector<MP, OP> owner;
+  swap(owner, v);
+  const typename MP::representation_type* p = owner.data(); // not invalidated by moving the vector
+  const std::size_t n = owner.size();
+  detail_::export_arrow_array<MP>(p, n, std::move(owner), out_array);
+  detail_::export_arrow_schema(format, out_schema);
+}
+
+// Copies an Arrow array into a markable_vector, writing MP::marked_value() for null
+// elements, and releases the array. The schema is only inspected.
+// Throws std::invalid_argument if the array has been released, is not a
+// primitive array of the type that MP would be exported as, or has a valid
+// element that MP cannot hold as a value (like a NaN under mark_fp_nan): such
+// an element would silently become "no value".
+
+template <typename MP, typename OP = order_none>
+markable_vector<MP, OP> import_arrow(ArrowArray* array, const ArrowSchema* schema)
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "import_arrow requires storage_type to be the same as representation_type");
+  if (array->release == nullptr || schema->release == nullptr)
+    throw std::invalid_argument("import_arrow: the array has been released");
+  if (std::strcmp(schema->format, detail_::arrow_format<MP>()) != 0 || schema->n_children != 0 ||
+      array->n_buffers != 2 || array->n_children != 0 || schema->dictionary != nullptr)
+    throw std::invalid_argument("import_arrow: the array type does not match the mark policy");
+
+  const std::size_t n = std::size_t(array->length), offset = std::size_t(array->offset);
+  markable_vector<MP, OP> ans (n);
+  detail_::import_arrow_values<MP>(array, n, offset, ans.data(), detail_::is_arrow_bool<MP>{});
+
+  const bool has_nulls = array->buffers[0] != nullptr && array->null_count != 0;
+  std::vector<std::uint64_t> validity (detail_::bitmap_words(n), ~std::uint64_t(0));
+  if (has_nulls)
+    detail_::copy_arrow_bits(static_cast<const std::uint8_t*>(array->buffers[0]), offset, n, validity.data());
+  else if (n % 64 != 0)
+    validity.back() = (std::uint64_t(1) << (n % 64)) - 1;
+
+  std::vector<std::uint64_t> present (detail_::bitmap_words(n));
+  compute_value_mask<MP>(ans.data(), n, present.data());
+  for (std::size_t w = 0; w != present.size(); ++w)
+    if (validity[w] & ~present[w])
+      throw std::invalid_argument("import_arrow: a valid element is a marked value of the policy");
+
+  if (has_nulls)
+    from_values_and_mask<MP>(ans.data(), validity.data(), n, ans.data());
+
+  array->release(array);
+  return ans;
+}
+
+} // namespace markable_ns
+
+using markable_ns::export_arrow;
+using markable_ns::import_arrow;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_ARROW_HEADER_GUARD_
@@ -0,0 +1,398 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_COLUMN_FILE_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_COLUMN_FILE_HEADER_GUARD_
+
+#include "markable_span.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined __unix__ || defined __APPLE__
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+# define AK_TOOLKIT_COLUMN_FILE_MMAP
+#endif
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// A file storing one column of representations.
+//
+//   offset 0:           column_file_header (64 bytes)
+//   offset data_offset: row_count representations, block after block;
+//                       data_offset is 4096, and the size of each block is
+//                       a multiple of 64 bytes, so every block is aligned
+//   null_counts_offset: one std::uint64_t per block: the number of marked values
+//
+// All numbers are stored in the native byte order, recorded in the header.
+// Reading a file with a different byte order or a different policy fails.
+
+enum class column_policy_kind : std::uint8_t { mark_int = 1, mark_fp_nan = 2, mark_bool = 3, mark_enum = 4 };
+
+struct column_file_header
+{
+  char          magic[8];            // "AKMKCOL\0"
+  std::uint32_t version;
+  std::uint8_t  policy_kind;         // column_policy_kind
+  std::uint8_t  element_width;       // sizeof(representation_type)
+  std::uint8_t  endianness;          // 1: little, 2: big
+  std::uint8_t  is_signed;
+  std::uint64_t marked_bits;         // the marked value, zero-extended
+  std::uint64_t row_count;
+  std::uint64_t block_rows;
+  std::uint64_t data_offset;
+  std::uint64_t null_counts_offset;
+  std::uint64_t reserved;
+};
+
+static_assert (sizeof(column_file_header) == 64, "column_file_header must be 64 bytes");
+
+// Describes a policy in the file header. Specialized for the predefined
+// scalar policies.
+template <typename MP>
+struct column_policy_traits
+{
+  static_assert (sizeof(MP) == 0, "column_policy_traits needs to be specialized for this mark policy");
+};
+
+namespace detail_ {
+
+template <typename MP, column_policy_kind Kind>
+struct column_policy_traits_base
+{
+  typedef typename MP::representation_type representation_type;
+  static column_policy_kind kind() { return Kind; }
+  static bool is_signed() { return std::is_signed<representation_type>::value; }
+  static std::uint64_t marked_bits()
+  {
+    const representation_type m = MP::marked_value();
+    std::uint64_t ans = 0;
+    std::memcpy(&ans, &m, sizeof(m)); // the marked value occupies the leading bytes
+    return ans;
+  }
+};
+
+inline std::uint8_t native_endianness()
+{
+  const std::uint16_t probe = 1;
+  unsigned char first;
+  std::memcpy(&first, &probe, 1);
+  return first == 1 ? 1 : 2;
+}
+
+const std::uint64_t column_data_offset = 4096;
+const char column_magic[8] = { 'A', 'K', 'M', 'K', 'C', 'O', 'L', '\0' };
+
+} // namespace detail_
+
+template <typename T, T Val>
+struct column_policy_traits<mark_int<T, Val>> : detail_::column_policy_traits_base<mark_int<T, Val>, column_policy_kind::mark_int> {};
+
+template <typename FPT>
+struct column_policy_traits<mark_fp_nan<FPT>> : detail_::column_policy_traits_base<mark_fp_nan<FPT>, column_policy_kind::mark_fp_nan> {};
+
+template <>
+struct column_policy_traits<mark_bool> : detail_::column_policy_traits_base<mark_bool, column_policy_kind::mark_bool> {};
+
+#ifndef AK_TOOLBOX_NO_UNDERLYING_TYPE
+template <typename Enum, typename std::underlying_type<Enum>::type Val>
+struct column_policy_traits<mark_enum<Enum, Val>> : detail_::column_policy_traits_base<mark_enum<Enum, Val>, column_policy_kind::mark_enum> {};
+#else
+template <typename Enum, int Val>
+struct column_policy_traits<mark_enum<Enum, Val>> : detail_::column_policy_traits_base<mark_enum<Enum, Val>, column_policy_kind::mark_enum> {};
+#endif // AK_TOOLBOX_NO_UNDERLYING_TYPE
+
+
+// Writes a column block by block. Only a single block is kept in memory.
+template <typename MP, typename OP = order_none>
+class markable_column_writer
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_column_writer requires storage_type to be the same as representation_type");
+public:
+  typedef typename MP::representation_type representation_type;
+  typedef std::size_t size_type;
+
+private:
+  std::FILE* _file;
+  std::vector<representation_type> _block;
+  std::vector<std::uint64_t> _null_counts;
+  size_type _block_rows;
+  std::uint64_t _row_count;
+
+  void write(const void* p, size_type bytes)
+  {
+    if (bytes != 0 && std::fwrite(p, 1, bytes, _file) != bytes)
+      throw std::runtime_error("markable_column_writer: write failed");
+  }
+
+  void flush_block()
+  {
+    if (_block.empty())
+      return;
+    write(_block.data(), _block.size() * sizeof(representation_type));
+    _null_counts.push_back(_block.size() - detail_::count_values<MP>(_block.data(), _block.data() + _block.size()));
+    _row_count += _block.size();
+    _block.clear();
+  }
+
+  column_file_header make_header(std::uint64_t null_counts_offset) const
+  {
+    column_file_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, detail_::column_magic, sizeof(h.magic));
+    h.version = 1;
+    h.policy_kind = std::uint8_t(column_policy_traits<MP>::kind());
+    h.element_width = std::uint8_t(sizeof(representation_type));
+    h.endianness = detail_::native_endianness();
+    h.is_signed = column_policy_traits<MP>::is_signed();
+    h.marked_bits = column_policy_traits<MP>::marked_bits();
+    h.row_count = _row_count;
+    h.block_rows = _block_rows;
+    h.data_offset = detail_::column_data_offset;
+    h.null_counts_offset = null_counts_offset;
+    return h;
+  }
+
+public:
+  // block_rows must be a non-zero multiple of 64
+  explicit markable_column_writer(const std::string& path, size_type block_rows = 65536)
+    : _file(nullptr), _block(), _null_counts(), _block_rows(block_rows), _row_count(0)
+  {
+    if (block_rows == 0 || block_rows % 64 != 0)
+      throw std::invalid_argument("markable_column_writer: block_rows must be a non-zero multiple of 64");
+    _file = std::fopen(path.c_str(), "wb");
+    if (_file == nullptr)
+      throw std::runtime_error("markable_column_writer: cannot open " + path);
+    _block.reserve(block_rows);
+    const std::vector<char> placeholder (detail_::column_data_offset, '\0'); // the header is written by close()
+    write(placeholder.data(), placeholder.size());
+  }
+
+  markable_column_writer(const markable_column_writer&) = delete;
+  markable_column_writer& operator=(const markable_column_writer&) = delete;
+
+  ~markable_column_writer()
+  {
+    if (_file != nullptr)
+      try { close(); } catch (...) {}
+  }
+
+  void append_representation(const representation_type& r)
+  {
+    _block.push_back(r);
+    if (_block.size() == _block_rows)
+      flush_block();
+  }
+
+  void append(const markable<MP, OP>& m) { append_representation(m.representation_value()); }
+
+  void append(const_markable_span<MP, OP> s)
+  {
+    for (size_type i = 0; i != s.size(); ++i)
+      append_representation(s.representation_value(i));
+  }
+
+  // the number of rows appended so far
+  std::uint64_t size() const AK_TOOLKIT_NOEXCEPT { return _row_count + _block.size(); }
+
+  // Writes the last block, the null counts and the header. Called by the destructor.
+  void close()
+  {
+    flush_block();
+    const std::uint64_t data_end = detail_::column_data_offset + _row_count * sizeof(representation_type);
+    const std::uint64_t null_counts_offset = (data_end + 7) / 8 * 8;
+    const char padding[8] = {};
+    write(padding, size_type(null_counts_offset - data_end));
+    write(_null_counts.data(), _null_counts.size() * sizeof(std::uint64_t));
+
+    const column_file_header h = make_header(null_counts_offset);
+    const bool ok = std::fseek(_file, 0, SEEK_SET) == 0 && std::fwrite(&h, sizeof(h), 1, _file) == 1;
+    const bool closed = std::fclose(_file) == 0;
+    _file = nullptr;
+    if (!ok || !closed)
+      throw std::runtime_error("markable_column_writer: cannot write the header");
+  }
+};
+
+
+// Maps a column file into memory (read-only) and hands out views of it.
+template <typename MP, typename OP = order_none>
+class markable_column_reader
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_column_reader requires storage_type to be the same as representation_type");
+public:
+  typedef typename MP::representation_type representation_type;
+  typedef std::size_t size_type;
+
+private:
+  const unsigned char* _bytes;
+  size_type _file_size;
+  column_file_header _header;
+
+  static void fail(const char* what) { throw std::runtime_error(std::string("markable_column_reader: ") + what); }
+
+  void map(const std::string& path)
+  {
+#if defined AK_TOOLKIT_COLUMN_FILE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+      fail("cannot open the file");
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || size_type(st.st_size) < sizeof(column_file_header))
+    {
+      ::close(fd);
+      fail("the file is too small");
+    }
+    _file_size = size_type(st.st_size);
+    void* p = ::mmap(nullptr, _file_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      fail("mmap failed");
+    _bytes = static_cast<const unsigned char*>(p);
+#else
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr)
+      fail("cannot open the file");
+    const long size = std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1L;
+    if (size < 0 || std::fseek(f, 0, SEEK_SET) != 0)
+    {
+      std::fclose(f);
+      fail("cannot determine the size of the file");
+    }
+    if (size_type(size) < sizeof(column_file_header))
+    {
+      std::fclose(f);
+      fail("the file is too small");
+    }
+    _file_size = size_type(size);
+    // blocks are 64-byte aligned in the file: so is the copy. The byte
+    // before it holds its offset in the allocation (1 to 64).
+    unsigned char* raw = static_cast<unsigned char*>(std::malloc(_file_size + 64));
+    unsigned char* p = raw == nullptr ? nullptr : raw + (64 - reinterpret_cast<std::uintptr_t>(raw) % 64);
+    const bool ok = p != nullptr && std::fread(p, 1, _file_size, f) == _file_size;
+    std::fclose(f);
+    if (!ok)
+    {
+      std::free(raw);
+      fail("cannot read the file");
+    }
+    p[-1] = static_cast<unsigned char>(p - raw);
+    _bytes = p;
+#endif
+  }
+
+  void unmap() AK_TOOLKIT_NOEXCEPT
+  {
+    if (_bytes == nullptr)
+      return;
+#if defined AK_TOOLKIT_COLUMN_FILE_MMAP
+    ::munmap(const_cast<unsigned char*>(_bytes), _file_size);
+#else
+    std::free(const_cast<unsigned char*>(_bytes - _bytes[-1]));
+#endif
+    _bytes = nullptr;
+  }
+
+  static std::uint64_t block_count(const column_file_header& h) AK_TOOLKIT_NOEXCEPT
+  {
+    return h.row_count / h.block_rows + (h.row_count % h.block_rows != 0);
+  }
+
+  void validate() const
+  {
+    const column_file_header& h = _header;
+    if (std::memcmp(h.magic, detail_::column_magic, sizeof(h.magic)) != 0 || h.version != 1)
+      fail("not a markable column file");
+    if (h.endianness != detail_::native_endianness())
+      fail("the file has a different byte order");
+    if (h.policy_kind != std::uint8_t(column_policy_traits<MP>::kind()) || h.element_width != sizeof(representation_type) ||
+        h.is_signed != column_policy_traits<MP>::is_signed() || h.marked_bits != column_policy_traits<MP>::marked_bits())
+      fail("the file was written with a different mark policy");
+    if (h.block_rows == 0 || h.block_rows % 64 != 0)
+      fail("invalid block size");
+    // data_offset <= null_counts_offset <= _file_size, compared without overflow
+    if (h.data_offset % 64 != 0 || h.null_counts_offset % 8 != 0 ||
+        h.null_counts_offset > _file_size || h.data_offset > h.null_counts_offset ||
+        h.row_count > (h.null_counts_offset - h.data_offset) / sizeof(representation_type) ||
+        block_count(h) > (_file_size - h.null_counts_offset) / sizeof(std::uint64_t))
+      fail("the file is truncated or corrupt");
+  }
+
+public:
+  // throws std::runtime_error if the file cannot be mapped or does not match MP
+  explicit markable_column_reader(const std::string& path)
+    : _bytes(nullptr), _file_size(0), _header()
+  {
+    map(path);
+    std::memcpy(&_header, _bytes, sizeof(_header));
+    try { validate(); }
+    catch (...) { unmap(); throw; }
+  }
+
+  markable_column_reader(markable_column_reader&& r) AK_TOOLKIT_NOEXCEPT
+    : _bytes(r._bytes), _file_size(r._file_size), _header(r._header) { r._bytes = nullptr; }
+
+  markable_column_reader(const markable_column_reader&) = delete;
+  markable_column_reader& operator=(const markable_column_reader&) = delete;
+
+  ~markable_column_reader() { unmap(); }
+
+  const column_file_header& header() const AK_TOOLKIT_NOEXCEPT { return _header; }
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return size_type(_header.row_count); }
+  size_type block_rows() const AK_TOOLKIT_NOEXCEPT { return size_type(_header.block_rows); }
+  size_type block_count() const AK_TOOLKIT_NOEXCEPT { return size_type(block_count(_header)); }
+
+  // the whole column: blocks are stored without gaps
+  const_markable_span<MP, OP> column() const AK_TOOLKIT_NOEXCEPT
+  {
+    return const_markable_span<MP, OP>(reinterpret_cast<const representation_type*>(_bytes + _header.data_offset), size());
+  }
+
+  const_markable_span<MP, OP> block(size_type i) const
+  {
+    AK_TOOLKIT_ASSERT(i < block_count());
+    const size_type first = i * block_rows();
+    return column().subspan(first, first + block_rows() <= size() ? block_rows() : size() - first);
+  }
+
+  // the number of elements without a value in block i, recorded by the writer
+  size_type null_count(size_type i) const
+  {
+    AK_TOOLKIT_ASSERT(i < block_count());
+    std::uint64_t ans;
+    std::memcpy(&ans, _bytes + _header.null_counts_offset + i * sizeof(std::uint64_t), sizeof(ans));
+    return size_type(ans);
+  }
+
+  size_type null_count() const
+  {
+    size_type ans = 0;
+    for (size_type i = 0; i != block_count(); ++i)
+      ans += null_count(i);
+    return ans;
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::column_policy_kind;
+using markable_ns::column_policy_traits;
+using markable_ns::column_file_header;
+using markable_ns::markable_column_writer;
+using markable_ns::markable_column_reader;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_COLUMN_FILE_HEADER_GUARD_
@@ -0,0 +1,465 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
+
+#include "markable.hpp"
+#include "markable_hash.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Open-addressing hash tables with linear probing, whose keys are markable<MP>.
+// A bucket is empty iff its key has no value: there is no separate array of
+// control bytes, and the key of the marked value cannot be stored.
+// Erasure uses backward-shift deletion, so no tombstones are needed.
+
+namespace detail_ {
+
+template <typename MP, typename V>
+struct flat_slot
+{
+  typedef typename std::aligned_storage<sizeof(V), alignof(V)>::type value_storage;
+
+  markable<MP> key;
+  value_storage raw;
+
+  V& value() AK_TOOLKIT_NOEXCEPT { return *static_cast<V*>(static_cast<void*>(&raw)); }
+  const V& value() const AK_TOOLKIT_NOEXCEPT { return *static_cast<const V*>(static_cast<const void*>(&raw)); }
+
+  template <typename... Args>
+  void construct(const markable<MP>& k, Args&&... args)
+  {
+    ::new (static_cast<void*>(&raw)) V(std::forward<Args>(args)...);
+    key = k;
+  }
+
+  void destroy() AK_TOOLKIT_NOEXCEPT
+  {
+    value().V::~V();
+    key = markable<MP>();
+  }
+};
+
+template <typename MP>
+struct flat_slot<MP, void>
+{
+  markable<MP> key;
+
+  void construct(const markable<MP>& k) { key = k; }
+  void destroy() AK_TOOLKIT_NOEXCEPT { key = markable<MP>(); }
+};
+
+template <typename MP, typename V, typename Hash, typename Eq>
+class flat_table
+{
+public:
+  typedef typename MP::value_type key_type;
+  typedef std::size_t size_type;
+
+protected:
+  typedef flat_slot<MP, V> slot_type;
+  static const size_type npos = size_type(-1);
+
+  std::unique_ptr<slot_type[]> _slots;
+  size_type _capacity;  // zero or a power of two
+  size_type _size;
+  unsigned _shift;      // 64 - log2(_capacity)
+  Hash _hash;
+  Eq _eq;
+
+  size_type home(const markable<MP>& k) const { return home(k, _shift); }
+  size_type home(const markable<MP>& k, unsigned shift) const
+  {
+    return size_type(fibonacci_hash::hash_bits(std::uint64_t(_hash(k))) >> shift);
+  }
+
+  size_type next(size_type i) const AK_TOOLKIT_NOEXCEPT { return (i + 1) & (_capacity - 1); }
+
+  size_type find_index(const markable<MP>& k) const
+  {
+    if (_capacity == 0)
+      return npos;
+    for (size_type i = home(k); ; i = next(i))
+    {
+      const markable<MP>& key = _slots[i].key;
+      if (!key.has_value())
+        return npos;
+      if (_eq(key, k))
+        return i;
+    }
+  }
+
+  // returns the index of the key and whether it has just been inserted
+  template <typename... Args>
+  std::pair<size_type, bool> insert_index(const markable<MP>& k, Args&&... args)
+  {
+    AK_TOOLKIT_ASSERT(k.has_value());
+    // a key that is present neither grows the table nor invalidates iterators
+    const size_type found = find_index(k);
+    if (found != npos)
+      return std::make_pair(found, false);
+
+    if ((_size + 1) * 4 > _capacity * 3)
+      rehash(_capacity == 0 ? 16 : _capacity * 2);
+
+    size_type i = home(k);
+    while (_slots[i].key.has_value())
+      i = next(i);
+    _slots[i].construct(k, std::forward<Args>(args)...);
+    ++_size;
+    return std::make_pair(i, true);
+  }
+
+  void erase_index(size_type i)
+  {
+    _slots[i].destroy();
+    --_size;
+
+    // backward-shift the following elements of the cluster
+    for (size_type j = next(i); _slots[j].key.has_value(); j = next(j))
+    {
+      const size_type h = home(_slots[j].key);
+      if (((j - h) & (_capacity - 1)) >= ((j - i) & (_capacity - 1)))
+      {
+        move_slot(j, i);
+        i = j;
+      }
+    }
+  }
+
+  void move_slot(size_type from, size_type to) { move_slot(from, to, std::is_void<V>()); }
+  void move_slot(size_type from, size_type to, std::false_type)
+  {
+    _slots[to].construct(_slots[from].key, std::move(_slots[from].value()));
+    _slots[from].destroy();
+  }
+  void move_slot(size_type from, size_type to, std::true_type)
+  {
+    _slots[to].construct(_slots[from].key);
+    _slots[from].destroy();
+  }
+
+  // Hash is called for every key before any value leaves the old table, and
+  // values whose move constructor can throw are copied. So if either Hash or
+  // a copy throws, the old table is restored and the exception propagates.
+  void rehash(size_type new_capacity)
+  {
+    std::unique_ptr<slot_type[]> old (new slot_type[new_capacity]);
+    std::unique_ptr<size_type[]> homes (new size_type[_size]);
+    unsigned new_shift = 64;
+    for (size_type c = new_capacity; c > 1; c >>= 1)
+      --new_shift;
+    for (size_type i = 0, j = 0; i != _capacity; ++i)
+      if (_slots[i].key.has_value())
+        homes[j++] = home(_slots[i].key, new_shift);
+
+    const size_type old_capacity = _capacity;
+    const size_type old_size = _size;
+    const unsigned old_shift = _shift;
+    _slots.swap(old);
+    _capacity = new_capacity;
+    _shift = new_shift;
+
+    try
+    {
+      for (size_type i = 0, j = 0; i != old_capacity; ++i)
+        if (old[i].key.has_value())
+          reinsert(old[i], homes[j++]);
+    }
+    catch (...)
+    {
+      destroy_all();
+      _slots.swap(old);
+      _capacity = old_capacity;
+      _size = old_size;
+      _shift = old_shift;
+      throw;
+    }
+
+    for (size_type i = 0; i != old_capacity; ++i)
+      if (old[i].key.has_value())
+        old[i].destroy();
+  }
+
+  void reinsert(slot_type& s, size_type i) { reinsert(s, i, std::is_void<V>()); }
+  void reinsert(slot_type& s, size_type i, std::false_type)
+  {
+    while (_slots[i].key.has_value())
+      i = next(i);
+    _slots[i].construct(s.key, std::move_if_noexcept(s.value()));
+  }
+  void reinsert(slot_type& s, size_type i, std::true_type)
+  {
+    while (_slots[i].key.has_value())
+      i = next(i);
+    _slots[i].construct(s.key);
+  }
+
+  void destroy_all() AK_TOOLKIT_NOEXCEPT
+  {
+    for (size_type i = 0; i != _capacity; ++i)
+      if (_slots[i].key.has_value())
+        _slots[i].destroy();
+    _size = 0;
+  }
+
+  size_type first_full(size_type i) const AK_TOOLKIT_NOEXCEPT
+  {
+    while (i != _capacity && !_slots[i].key.has_value())
+      ++i;
+    return i;
+  }
+
+  flat_table() : _slots(), _capacity(0), _size(0), _shift(64), _hash(), _eq() {}
+  flat_table(const Hash& h, const Eq& e) : _slots(), _capacity(0), _size(0), _shift(64), _hash(h), _eq(e) {}
+  flat_table(flat_table&& r) AK_TOOLKIT_NOEXCEPT
+    : _slots(std::move(r._slots)), _capacity(r._capacity), _size(r._size), _shift(r._shift), _hash(r._hash), _eq(r._eq)
+  {
+    r._capacity = 0;
+    r._size = 0;
+    r._shift = 64;
+  }
+  ~flat_table() { destroy_all(); }
+
+public:
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+  size_type bucket_count() const AK_TOOLKIT_NOEXCEPT { return _capacity; }
+  Hash hash_function() const { return _hash; }
+  Eq key_eq() const { return _eq; }
+
+  void clear() AK_TOOLKIT_NOEXCEPT { destroy_all(); }
+
+  void reserve(size_type n)
+  {
+    size_type c = 16;
+    while (c * 3 < n * 4)
+      c *= 2;
+    if (c > _capacity)
+      rehash(c);
+  }
+
+  bool contains(const key_type& k) const { return find_index(markable<MP>(k)) != npos; }
+  size_type count(const key_type& k) const { return contains(k) ? 1 : 0; }
+
+  size_type erase(const key_type& k)
+  {
+    const size_type i = find_index(markable<MP>(k));
+    if (i == npos)
+      return 0;
+    erase_index(i);
+    return 1;
+  }
+};
+
+template <typename MP, typename V, typename Hash, typename Eq>
+const typename flat_table<MP, V, Hash, Eq>::size_type flat_table<MP, V, Hash, Eq>::npos;
+
+} // namespace detail_
+
+
+template <typename MP, typename V, typename Hash = hash_by_representation, typename Eq = equal_by_representation>
+class markable_flat_map : public detail_::flat_table<MP, V, Hash, Eq>
+{
+  typedef detail_::flat_table<MP, V, Hash, Eq> base;
+  typedef typename base::slot_type slot_type;
+  using base::_slots;
+  using base::_capacity;
+  using base::npos;
+
+public:
+  typedef typename MP::value_type key_type;
+  typedef V mapped_type;
+  typedef std::size_t size_type;
+
+  template <typename Slot, typename Ref>
+  class basic_iterator
+  {
+    Slot* _slots;
+    size_type _i;
+    size_type _capacity;
+
+    struct arrow_proxy
+    {
+      Ref r;
+      const Ref* operator->() const { return &r; }
+    };
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Ref value_type;
+    typedef Ref reference;
+    typedef arrow_proxy pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    basic_iterator() : _slots(), _i(), _capacity() {}
+    basic_iterator(Slot* s, size_type i, size_type c) : _slots(s), _i(i), _capacity(c) {}
+    template <typename S, typename R, typename = typename std::enable_if<std::is_convertible<S*, Slot*>::value>::type>
+    basic_iterator(const basic_iterator<S, R>& r) : _slots(r._slots), _i(r._i), _capacity(r._capacity) {}
+
+    reference operator*() const { return reference(_slots[_i].key.value(), _slots[_i].value()); }
+    pointer operator->() const { pointer p = { **this }; return p; }
+
+    basic_iterator& operator++()
+    {
+      do ++_i; while (_i != _capacity && !_slots[_i].key.has_value());
+      return *this;
+    }
+    basic_iterator operator++(int) { basic_iterator r(*this); ++*this; return r; }
+
+    friend bool operator==(const basic_iterator& l, const basic_iterator& r) { return l._i == r._i; }
+    friend bool operator!=(const basic_iterator& l, const basic_iterator& r) { return l._i != r._i; }
+
+    template <typename, typename> friend class basic_iterator;
+  };
+
+  typedef basic_iterator<slot_type, std::pair<typename MP::reference_type, V&>> iterator;
+  typedef basic_iterator<const slot_type, std::pair<typename MP::reference_type, const V&>> const_iterator;
+
+  markable_flat_map() {}
+  explicit markable_flat_map(const Hash& h, const Eq& e = Eq()) : base(h, e) {}
+  markable_flat_map(markable_flat_map&&) = default;
+  markable_flat_map(const markable_flat_map& r) : base(r._hash, r._eq)
+  {
+    this->reserve(r.size());
+    for (const_iterator it = r.begin(); it != r.end(); ++it)
+      emplace(it->first, it->second);
+  }
+
+  markable_flat_map& operator=(markable_flat_map r) AK_TOOLKIT_NOEXCEPT { swap(*this, r); return *this; }
+
+  friend void swap(markable_flat_map& l, markable_flat_map& r) AK_TOOLKIT_NOEXCEPT
+  {
+    using std::swap;
+    swap(l._slots, r._slots);
+    swap(l._capacity, r._capacity);
+    swap(l._size, r._size);
+    swap(l._shift, r._shift);
+    swap(l._hash, r._hash);
+    swap(l._eq, r._eq);
+  }
+
+  iterator begin() { return iterator(_slots.get(), this->first_full(0), _capacity); }
+  iterator end() { return iterator(_slots.get(), _capacity, _capacity); }
+  const_iterator begin() const { return const_iterator(_slots.get(), this->first_full(0), _capacity); }
+  const_iterator end() const { return const_iterator(_slots.get(), _capacity, _capacity); }
+
+  // the value is only constructed if the key is not present
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const key_type& k, Args&&... args)
+  {
+    std::pair<size_type, bool> r = this->insert_index(markable<MP>(k), std::forward<Args>(args)...);
+    return std::make_pair(iterator(_slots.get(), r.first, _capacity), r.second);
+  }
+
+  std::pair<iterator, bool> insert(const key_type& k, const V& v) { return emplace(k, v); }
+  std::pair<iterator, bool> insert(const key_type& k, V&& v) { return emplace(k, std::move(v)); }
+
+  V& operator[](const key_type& k) { return _slots[this->insert_index(markable<MP>(k)).first].value(); }
+
+  iterator find(const key_type& k)
+  {
+    const size_type i = this->find_index(markable<MP>(k));
+    return i == npos ? end() : iterator(_slots.get(), i, _capacity);
+  }
+
+  const_iterator find(const key_type& k) const
+  {
+    const size_type i = this->find_index(markable<MP>(k));
+    return i == npos ? end() : const_iterator(_slots.get(), i, _capacity);
+  }
+};
+
+
+template <typename MP, typename Hash = hash_by_representation, typename Eq = equal_by_representation>
+class markable_flat_set : public detail_::flat_table<MP, void, Hash, Eq>
+{
+  typedef detail_::flat_table<MP, void, Hash, Eq> base;
+  typedef typename base::slot_type slot_type;
+  using base::_slots;
+  using base::_capacity;
+
+public:
+  typedef typename MP::value_type key_type;
+  typedef typename MP::value_type value_type;
+  typedef std::size_t size_type;
+
+  class const_iterator
+  {
+    const slot_type* _slots;
+    size_type _i;
+    size_type _capacity;
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename MP::value_type value_type;
+    typedef typename MP::reference_type reference;
+    typedef void pointer;
+    typedef std::ptrdiff_t difference_type;
+
+    const_iterator() : _slots(), _i(), _capacity() {}
+    const_iterator(const slot_type* s, size_type i, size_type c) : _slots(s), _i(i), _capacity(c) {}
+
+    reference operator*() const { return _slots[_i].key.value(); }
+
+    const_iterator& operator++()
+    {
+      do ++_i; while (_i != _capacity && !_slots[_i].key.has_value());
+      return *this;
+    }
+    const_iterator operator++(int) { const_iterator r(*this); ++*this; return r; }
+
+    friend bool operator==(const const_iterator& l, const const_iterator& r) { return l._i == r._i; }
+    friend bool operator!=(const const_iterator& l, const const_iterator& r) { return l._i != r._i; }
+  };
+
+  typedef const_iterator iterator;
+
+  markable_flat_set() {}
+  explicit markable_flat_set(const Hash& h, const Eq& e = Eq()) : base(h, e) {}
+  markable_flat_set(markable_flat_set&&) = default;
+  markable_flat_set(const markable_flat_set& r) : base(r._hash, r._eq)
+  {
+    this->reserve(r.size());
+    for (const_iterator it = r.begin(); it != r.end(); ++it)
+      insert(*it);
+  }
+
+  markable_flat_set& operator=(markable_flat_set r) AK_TOOLKIT_NOEXCEPT { swap(*this, r); return *this; }
+
+  friend void swap(markable_flat_set& l, markable_flat_set& r) AK_TOOLKIT_NOEXCEPT
+  {
+    using std::swap;
+    swap(l._slots, r._slots);
+    swap(l._capacity, r._capacity);
+    swap(l._size, r._size);
+    swap(l._shift, r._shift);
+    swap(l._hash, r._hash);
+    swap(l._eq, r._eq);
+  }
+
+  const_iterator begin() const { return const_iterator(_slots.get(), this->first_full(0), _capacity); }
+  const_iterator end() const { return const_iterator(_slots.get(), _capacity, _capacity); }
+
+  bool insert(const key_type& k) { return this->insert_index(markable<MP>(k)).second; }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_flat_map;
+using markable_ns::markable_flat_set;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_FLAT_MAP_HEADER_GUARD_
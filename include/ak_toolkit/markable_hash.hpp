@@ -0,0 +1,384 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_HASH_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_HASH_HEADER_GUARD_
+
+#include "markable_mask.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+// the bits of a representation of 1, 2, 4 or 8 bytes, zero-extended
+template <typename Rep>
+std::uint64_t representation_bits(const Rep& r) AK_TOOLKIT_NOEXCEPT
+{
+  static_assert(std::is_trivially_copyable<Rep>::value, "hashing of bits requires a trivially copyable representation");
+  static_assert(sizeof(Rep) == 1 || sizeof(Rep) == 2 || sizeof(Rep) == 4 || sizeof(Rep) == 8, "hashing of bits requires a representation of 1, 2, 4 or 8 bytes");
+  return as_uint(r);
+}
+
+const std::uint64_t wy_keys[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+// the low and the high half of the 128-bit product, xored
+inline std::uint64_t mum(std::uint64_t a, std::uint64_t b) AK_TOOLKIT_NOEXCEPT
+{
+#if defined __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 uint128;
+  const uint128 p = uint128(a) * b;
+  return std::uint64_t(p) ^ std::uint64_t(p >> 64);
+#else
+  const std::uint64_t a0 = a & 0xFFFFFFFFu, a1 = a >> 32, b0 = b & 0xFFFFFFFFu, b1 = b >> 32;
+  const std::uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  const std::uint64_t mid = (p00 >> 32) + (p01 & 0xFFFFFFFFu) + (p10 & 0xFFFFFFFFu);
+  return ((p00 & 0xFFFFFFFFu) | (mid << 32)) ^ (p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32));
+#endif
+}
+
+struct crc32c_table
+{
+  std::uint32_t entries[256];
+
+  crc32c_table() AK_TOOLKIT_NOEXCEPT
+  {
+    for (std::uint32_t i = 0; i != 256; ++i)
+    {
+      std::uint32_t c = i;
+      for (int k = 0; k != 8; ++k)
+        c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+      entries[i] = c;
+    }
+  }
+};
+
+inline std::uint32_t crc32c_update_software(std::uint32_t crc, std::uint64_t bits) AK_TOOLKIT_NOEXCEPT
+{
+  static const crc32c_table table;
+  for (int i = 0; i != 8; ++i, bits >>= 8)
+    crc = table.entries[(crc ^ std::uint32_t(bits)) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+inline bool has_sse42()
+{
+  static const bool ans = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2") != 0);
+  return ans;
+}
+
+AK_TOOLKIT_TARGET("sse4.2")
+inline std::uint32_t crc32c_update_sse42(std::uint32_t crc, std::uint64_t bits) AK_TOOLKIT_NOEXCEPT
+{
+# if defined __x86_64__
+  return std::uint32_t(_mm_crc32_u64(crc, bits));
+# else
+  return _mm_crc32_u32(_mm_crc32_u32(crc, std::uint32_t(bits)), std::uint32_t(bits >> 32));
+# endif
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+// CRC-32C of the 8 bytes of bits, least significant first
+inline std::uint32_t crc32c(std::uint64_t bits) AK_TOOLKIT_NOEXCEPT
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  if (has_sse42())
+    return ~crc32c_update_sse42(~0u, bits);
+#endif
+  return ~crc32c_update_software(~0u, bits);
+}
+
+} // namespace detail_
+
+
+// Hash functions of markables that hash the bits of the representation, so
+// that they are consistent with equal_by_representation. They require a
+// trivially copyable representation of 1, 2, 4 or 8 bytes, and can be used
+// as the Hash of markable_flat_map or concurrent_markable_map.
+
+// A multiplication by 2^64 / phi: the fastest, but only the high bits of the
+// hash are well distributed.
+struct fibonacci_hash
+{
+  static AK_TOOLKIT_CONSTEXPR std::uint64_t hash_bits(std::uint64_t b) AK_TOOLKIT_NOEXCEPT { return b * 0x9E3779B97F4A7C15ull; }
+
+  template <typename MP, typename OP>
+  std::uint64_t operator()(const markable<MP, OP>& m) const AK_TOOLKIT_NOEXCEPT
+  {
+    return hash_bits(detail_::representation_bits(m.representation_value()));
+  }
+};
+
+// Two rounds of the multiply-and-fold mixing of wyhash: all the bits of the
+// hash depend on all the bits of the representation.
+struct wy_hash
+{
+  static std::uint64_t hash_bits(std::uint64_t b) AK_TOOLKIT_NOEXCEPT
+  {
+    using detail_::wy_keys;
+    return detail_::mum(detail_::mum(b ^ wy_keys[0], wy_keys[1]) ^ wy_keys[2], wy_keys[3]);
+  }
+
+  template <typename MP, typename OP>
+  std::uint64_t operator()(const markable<MP, OP>& m) const AK_TOOLKIT_NOEXCEPT
+  {
+    return hash_bits(detail_::representation_bits(m.representation_value()));
+  }
+};
+
+// CRC-32C of the 8 bytes of the zero-extended representation, computed with
+// the SSE4.2 instruction when the CPU has it. The hash has 32 bits.
+struct crc32c_hash
+{
+  static std::uint64_t hash_bits(std::uint64_t b) AK_TOOLKIT_NOEXCEPT { return detail_::crc32c(b); }
+
+  template <typename MP, typename OP>
+  std::uint64_t operator()(const markable<MP, OP>& m) const AK_TOOLKIT_NOEXCEPT
+  {
+    return hash_bits(detail_::representation_bits(m.representation_value()));
+  }
+};
+
+namespace detail_ {
+
+template <std::size_t Size>
+using size_constant = std::integral_constant<std::size_t, Size>;
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+// Kernels load representations zero-extended to 64-bit lanes. There are no
+// 64x64-bit multiplications in SSE2, AVX2 and AVX-512F: they are composed of
+// 32x32-bit ones. For wy_hash, this is only faster than the scalar 128-bit
+// multiplication with AVX-512. The maskz_ forms of AVX-512 operations avoid false
+// -Wmaybe-uninitialized warnings of GCC.
+
+inline __m128i load_bits_sse2(const void* p, size_constant<8>) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+inline __m128i load_bits_sse2(const void* p, size_constant<4>) { return _mm_unpacklo_epi32(_mm_loadl_epi64(static_cast<const __m128i*>(p)), _mm_setzero_si128()); }
+
+inline __m128i load_bits_sse2(const void* p, size_constant<2>)
+{
+  std::int32_t w;
+  std::memcpy(&w, p, 4);
+  return _mm_unpacklo_epi32(_mm_unpacklo_epi16(_mm_cvtsi32_si128(w), _mm_setzero_si128()), _mm_setzero_si128());
+}
+
+inline __m128i load_bits_sse2(const void* p, size_constant<1>)
+{
+  std::uint16_t w;
+  std::memcpy(&w, p, 2);
+  const __m128i z = _mm_setzero_si128();
+  return _mm_unpacklo_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(w), z), z), z);
+}
+
+inline __m128i mullo64_sse2(__m128i a, __m128i b)
+{
+  const __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+  return _mm_add_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(cross, 32));
+}
+
+inline __m128i mix_sse2(__m128i x, fibonacci_hash) { return mullo64_sse2(x, _mm_set1_epi64x(0x9E3779B97F4A7C15ll)); }
+
+template <typename Hash, typename Rep>
+std::size_t hash_sse2(const Rep* p, std::size_t n, std::uint64_t* out)
+{
+  const std::size_t m = n - n % 2;
+  for (std::size_t i = 0; i != m; i += 2)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), mix_sse2(load_bits_sse2(p + i, size_constant<sizeof(Rep)>()), Hash()));
+  return m;
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i load_bits_avx2(const void* p, size_constant<8>) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i load_bits_avx2(const void* p, size_constant<4>) { return _mm256_cvtepu32_epi64(_mm_loadu_si128(static_cast<const __m128i*>(p))); }
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i load_bits_avx2(const void* p, size_constant<2>) { return _mm256_cvtepu16_epi64(_mm_loadl_epi64(static_cast<const __m128i*>(p))); }
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i load_bits_avx2(const void* p, size_constant<1>)
+{
+  std::int32_t w;
+  std::memcpy(&w, p, 4);
+  return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(w));
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i mullo64_avx2(__m256i a, __m256i b)
+{
+  const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i mix_avx2(__m256i x, fibonacci_hash) { return mullo64_avx2(x, _mm256_set1_epi64x(0x9E3779B97F4A7C15ll)); }
+
+template <typename Hash, typename Rep>
+AK_TOOLKIT_TARGET("avx2")
+std::size_t hash_avx2(const Rep* p, std::size_t n, std::uint64_t* out)
+{
+  const std::size_t m = n - n % 4;
+  for (std::size_t i = 0; i != m; i += 4)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), mix_avx2(load_bits_avx2(p + i, size_constant<sizeof(Rep)>()), Hash()));
+  return m;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i load_bits_avx512(const void* p, size_constant<8>) { return _mm512_loadu_si512(p); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i load_bits_avx512(const void* p, size_constant<4>) { return _mm512_maskz_cvtepu32_epi64(0xFF, _mm256_loadu_si256(static_cast<const __m256i*>(p))); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i load_bits_avx512(const void* p, size_constant<2>) { return _mm512_maskz_cvtepu16_epi64(0xFF, _mm_loadu_si128(static_cast<const __m128i*>(p))); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i load_bits_avx512(const void* p, size_constant<1>) { return _mm512_maskz_cvtepu8_epi64(0xFF, _mm_loadl_epi64(static_cast<const __m128i*>(p))); }
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i mullo64_avx512(__m512i a, __m512i b)
+{
+  const __m512i cross = _mm512_add_epi64(_mm512_maskz_mul_epu32(0xFF, _mm512_maskz_srli_epi64(0xFF, a, 32), b), _mm512_maskz_mul_epu32(0xFF, a, _mm512_maskz_srli_epi64(0xFF, b, 32)));
+  return _mm512_add_epi64(_mm512_maskz_mul_epu32(0xFF, a, b), _mm512_maskz_slli_epi64(0xFF, cross, 32));
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i mum_avx512(__m512i a, __m512i b)
+{
+  const __m512i low = _mm512_set1_epi64(0xFFFFFFFF);
+  const __m512i a1 = _mm512_maskz_srli_epi64(0xFF, a, 32), b1 = _mm512_maskz_srli_epi64(0xFF, b, 32);
+  const __m512i p00 = _mm512_maskz_mul_epu32(0xFF, a, b), p01 = _mm512_maskz_mul_epu32(0xFF, a, b1), p10 = _mm512_maskz_mul_epu32(0xFF, a1, b), p11 = _mm512_maskz_mul_epu32(0xFF, a1, b1);
+  const __m512i mid = _mm512_add_epi64(_mm512_add_epi64(_mm512_maskz_srli_epi64(0xFF, p00, 32), _mm512_and_si512(p01, low)), _mm512_and_si512(p10, low));
+  const __m512i lo = _mm512_or_si512(_mm512_and_si512(p00, low), _mm512_maskz_slli_epi64(0xFF, mid, 32));
+  const __m512i hi = _mm512_add_epi64(_mm512_add_epi64(p11, _mm512_maskz_srli_epi64(0xFF, p01, 32)), _mm512_add_epi64(_mm512_maskz_srli_epi64(0xFF, p10, 32), _mm512_maskz_srli_epi64(0xFF, mid, 32)));
+  return _mm512_xor_si512(lo, hi);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i mix_avx512(__m512i x, fibonacci_hash) { return mullo64_avx512(x, _mm512_set1_epi64(0x9E3779B97F4A7C15ll)); }
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i mix_avx512(__m512i x, wy_hash)
+{
+  const __m512i h = mum_avx512(_mm512_xor_si512(x, _mm512_set1_epi64(wy_keys[0])), _mm512_set1_epi64(wy_keys[1]));
+  return mum_avx512(_mm512_xor_si512(h, _mm512_set1_epi64(wy_keys[2])), _mm512_set1_epi64(wy_keys[3]));
+}
+
+template <typename Hash, typename Rep>
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+std::size_t hash_avx512(const Rep* p, std::size_t n, std::uint64_t* out)
+{
+  const std::size_t m = n - n % 8;
+  for (std::size_t i = 0; i != m; i += 8)
+    _mm512_storeu_si512(out + i, mix_avx512(load_bits_avx512(p + i, size_constant<sizeof(Rep)>()), Hash()));
+  return m;
+}
+
+template <typename Rep>
+AK_TOOLKIT_TARGET("sse4.2")
+std::size_t hash_crc32c_sse42(const Rep* p, std::size_t n, std::uint64_t* out)
+{
+  for (std::size_t i = 0; i != n; ++i)
+    out[i] = ~crc32c_update_sse42(~0u, representation_bits(p[i]));
+  return n;
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+// The kernels return the number of elements they hashed; the caller hashes
+// the rest one by one. There are kernels for the hashes of this header.
+
+template <typename Hash, typename Rep>
+std::size_t hash_kernel(const Rep*, std::size_t, std::uint64_t*, simd_level, const Hash&)
+{
+  return 0;
+}
+
+template <typename Rep>
+std::size_t hash_kernel(const Rep* p, std::size_t n, std::uint64_t* out, simd_level level, const fibonacci_hash&)
+{
+  (void)p; (void)n; (void)out;
+  switch (level)
+  {
+#if defined AK_TOOLKIT_X86_SIMD
+    case simd_level::avx512: return hash_avx512<fibonacci_hash>(p, n, out);
+    case simd_level::avx2: return hash_avx2<fibonacci_hash>(p, n, out);
+    case simd_level::sse2: return hash_sse2<fibonacci_hash>(p, n, out);
+#endif
+    default: return 0;
+  }
+}
+
+template <typename Rep>
+std::size_t hash_kernel(const Rep* p, std::size_t n, std::uint64_t* out, simd_level level, const wy_hash&)
+{
+  (void)p; (void)n; (void)out; (void)level;
+#if defined AK_TOOLKIT_X86_SIMD
+  if (level == simd_level::avx512)
+    return hash_avx512<wy_hash>(p, n, out);
+#endif
+  return 0;
+}
+
+template <typename Rep>
+std::size_t hash_kernel(const Rep* p, std::size_t n, std::uint64_t* out, simd_level level, const crc32c_hash&)
+{
+  (void)p; (void)n; (void)out; (void)level;
+#if defined AK_TOOLKIT_X86_SIMD
+  if (level != simd_level::scalar && has_sse42())
+    return hash_crc32c_sse42(p, n, out);
+#endif
+  return 0;
+}
+
+template <typename MP, typename OP, typename Hash>
+void hash_batch(const typename MP::representation_type* first, std::size_t n, std::uint64_t* out, const Hash& h, simd_level level)
+{
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+  for (std::size_t i = hash_kernel(first, n, out, level, h); i < n; ++i)
+    out[i] = std::uint64_t(h(markable<MP, OP>(with_representation, first[i])));
+}
+
+} // namespace detail_
+
+
+// out[i] = h(markable<MP, OP>(with_representation, first[i])) for i in [0, n).
+// Any Hash can be used; fibonacci_hash is computed in SIMD lanes, wy_hash
+// in AVX-512 lanes and crc32c_hash with the SSE4.2 instruction.
+
+template <typename MP, typename Hash = wy_hash>
+void hash_batch(const typename MP::representation_type* first, std::size_t n, std::uint64_t* out,
+                const Hash& h = Hash(), simd_level level = detected_simd_level())
+{
+  detail_::hash_batch<MP, order_none>(first, n, out, h, level);
+}
+
+template <typename MP, typename OP, typename Hash = wy_hash>
+void hash_batch(const_markable_span<MP, OP> s, std::uint64_t* out, const Hash& h = Hash(), simd_level level = detected_simd_level())
+{
+  detail_::hash_batch<MP, OP>(s.data(), s.size(), out, h, level);
+}
+
+template <typename MP, typename OP, typename Hash = wy_hash>
+void hash_batch(const markable_vector<MP, OP>& v, std::uint64_t* out, const Hash& h = Hash(), simd_level level = detected_simd_level())
+{
+  detail_::hash_batch<MP, OP>(v.data(), v.size(), out, h, level);
+}
+
+} // namespace markable_ns
+
+using markable_ns::fibonacci_hash;
+using markable_ns::wy_hash;
+using markable_ns::crc32c_hash;
+using markable_ns::hash_batch;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_HASH_HEADER_GUARD_
@@ -0,0 +1,385 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_HASH_JOIN_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_HASH_JOIN_HEADER_GUARD_
+
+#include "markable_hash.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+// Key columns compared by order_by_value use equal_by_value; any other use
+// equal_by_representation. Values of mark_int, mark_enum and mark_bool are
+// equal iff their representations are, so they can be hashed by bits.
+
+template <typename MP, typename OP>
+struct default_key_hash { typedef wy_hash type; };
+
+template <typename MP>
+struct default_key_hash<MP, order_by_value>
+  : std::conditional<is_single_sentinel_policy<MP>::value, wy_hash, hash_by_value> {};
+
+template <typename OP>
+struct default_key_equal { typedef equal_by_representation type; };
+
+template <>
+struct default_key_equal<order_by_value> { typedef equal_by_value type; };
+
+// Keys are hashed in batches; while one key is probed, the home slot of the
+// key hash_prefetch_distance positions ahead is prefetched.
+const std::size_t hash_probe_batch = 256;
+const std::size_t hash_prefetch_distance = 16;
+
+inline void prefetch(const void* p) AK_TOOLKIT_NOEXCEPT
+{
+#if defined __GNUC__
+  __builtin_prefetch(p);
+#else
+  (void)p;
+#endif
+}
+
+} // namespace detail_
+
+
+// Assigns to keys dense group ids, in the order of first occurrence. All keys
+// without value form one group (the null group), as in SQL GROUP BY; other
+// keys are compared with Eq. The groups are an open-addressing table of keys
+// and group ids.
+
+template <typename MP, typename OP = order_none,
+          typename Hash = typename detail_::default_key_hash<MP, OP>::type,
+          typename Eq = typename detail_::default_key_equal<OP>::type>
+class markable_hash_group_by
+{
+  static_assert(is_columnar_mark_policy<MP>::value, "markable_hash_group_by requires storage_type to be the same as representation_type");
+
+public:
+  typedef std::size_t size_type;
+  typedef std::uint32_t group_id;
+  typedef markable<MP, OP> key_type;
+  static const group_id no_group = group_id(-1);
+
+private:
+  typedef typename MP::representation_type representation_type;
+
+  struct slot
+  {
+    representation_type key;
+    group_id id;           // no_group in empty slots
+  };
+
+  std::vector<slot> _slots;                // zero or a power of two, at most half full
+  unsigned _shift;                         // 64 - log2(_slots.size())
+  std::vector<representation_type> _keys;  // by group id
+  group_id _null_group;
+  Hash _hash;
+  Eq _eq;
+
+  size_type home(std::uint64_t m) const AK_TOOLKIT_NOEXCEPT { return size_type(m >> _shift); }
+  size_type next(size_type i) const AK_TOOLKIT_NOEXCEPT { return (i + 1) & (_slots.size() - 1); }
+
+  bool equal(const representation_type& l, const representation_type& r) const
+  {
+    return _eq(key_type(with_representation, l), key_type(with_representation, r));
+  }
+
+  // mixed hashes of m keys
+  void hash_keys(const representation_type* p, size_type m, std::uint64_t* hashes) const
+  {
+    hash_batch(const_markable_span<MP, OP>(p, m), hashes, _hash);
+    for (size_type i = 0; i != m; ++i)
+      hashes[i] = fibonacci_hash::hash_bits(hashes[i]);
+  }
+
+  void prefetch_home(std::uint64_t m) const AK_TOOLKIT_NOEXCEPT { detail_::prefetch(&_slots[home(m)]); }
+
+  void rehash(size_type capacity)
+  {
+    _slots.assign(capacity, slot{MP::marked_value(), no_group});
+    _shift = 64;
+    for (size_type c = capacity; c > 1; c /= 2)
+      --_shift;
+
+    std::uint64_t hashes[detail_::hash_probe_batch];
+    for (size_type b = 0; b < _keys.size(); b += detail_::hash_probe_batch)
+    {
+      const size_type m = std::min(detail_::hash_probe_batch, _keys.size() - b);
+      hash_keys(_keys.data() + b, m, hashes);
+      for (size_type i = 0; i != m; ++i)
+        if (group_id(b + i) != _null_group)
+        {
+          size_type s = home(hashes[i]);
+          while (_slots[s].id != no_group)
+            s = next(s);
+          _slots[s] = slot{_keys[b + i], group_id(b + i)};
+        }
+    }
+  }
+
+  // room for n new groups without rehashing
+  void reserve_for(size_type n)
+  {
+    AK_TOOLKIT_ASSERT(_keys.size() + n < no_group);
+    const size_type needed = (_keys.size() + n) * 2;
+    if (needed <= _slots.size())
+      return;
+    size_type c = 16;
+    while (c < needed)
+      c *= 2;
+    rehash(c);
+  }
+
+  group_id null_group_id()
+  {
+    if (_null_group == no_group)
+    {
+      _null_group = group_id(_keys.size());
+      _keys.push_back(MP::marked_value());
+    }
+    return _null_group;
+  }
+
+  group_id insert(const representation_type& k, std::uint64_t m)
+  {
+    size_type s = home(m);
+    for (; _slots[s].id != no_group; s = next(s))
+      if (equal(_slots[s].key, k))
+        return _slots[s].id;
+
+    const group_id id = group_id(_keys.size());
+    _slots[s] = slot{k, id};
+    _keys.push_back(k);
+    return id;
+  }
+
+  group_id lookup(const representation_type& k, std::uint64_t m) const
+  {
+    for (size_type s = home(m); _slots[s].id != no_group; s = next(s))
+      if (equal(_slots[s].key, k))
+        return _slots[s].id;
+    return no_group;
+  }
+
+public:
+  explicit markable_hash_group_by(size_type expected_groups = 0, const Hash& hash = Hash(), const Eq& eq = Eq())
+    : _slots(), _shift(64), _keys(), _null_group(no_group), _hash(hash), _eq(eq)
+  {
+    reserve(expected_groups);
+  }
+
+  void reserve(size_type groups)
+  {
+    if (groups != 0)
+      reserve_for(groups - std::min(groups, _keys.size()));
+  }
+
+  // ids[i] is the group of keys[i]; keys not seen before start new groups
+  void group(const_markable_span<MP, OP> keys, group_id* ids)
+  {
+    const representation_type* p = keys.data();
+    std::uint64_t hashes[detail_::hash_probe_batch];
+    for (size_type b = 0; b < keys.size(); b += detail_::hash_probe_batch)
+    {
+      const size_type m = std::min(detail_::hash_probe_batch, keys.size() - b);
+      reserve_for(m);
+      hash_keys(p + b, m, hashes);
+      for (size_type i = 0; i != std::min(m, detail_::hash_prefetch_distance); ++i)
+        prefetch_home(hashes[i]);
+
+      for (size_type i = 0; i != m; ++i)
+      {
+        if (i + detail_::hash_prefetch_distance < m)
+          prefetch_home(hashes[i + detail_::hash_prefetch_distance]);
+        ids[b + i] = MP::is_marked_value(p[b + i]) ? null_group_id() : insert(p[b + i], hashes[i]);
+      }
+    }
+  }
+
+  // ids[i] is the group of keys[i], or no_group if there is none
+  void find(const_markable_span<MP, OP> keys, group_id* ids) const
+  {
+    const representation_type* p = keys.data();
+    if (_slots.empty())
+    {
+      for (size_type i = 0; i != keys.size(); ++i)
+        ids[i] = MP::is_marked_value(p[i]) ? _null_group : no_group;
+      return;
+    }
+
+    std::uint64_t hashes[detail_::hash_probe_batch];
+    for (size_type b = 0; b < keys.size(); b += detail_::hash_probe_batch)
+    {
+      const size_type m = std::min(detail_::hash_probe_batch, keys.size() - b);
+      hash_keys(p + b, m, hashes);
+      for (size_type i = 0; i != std::min(m, detail_::hash_prefetch_distance); ++i)
+        prefetch_home(hashes[i]);
+
+      for (size_type i = 0; i != m; ++i)
+      {
+        if (i + detail_::hash_prefetch_distance < m)
+          prefetch_home(hashes[i + detail_::hash_prefetch_distance]);
+        ids[b + i] = MP::is_marked_value(p[b + i]) ? _null_group : lookup(p[b + i], hashes[i]);
+      }
+    }
+  }
+
+  size_type group_count() const AK_TOOLKIT_NOEXCEPT { return _keys.size(); }
+
+  // the group of keys without value, or no_group if there were none
+  group_id null_group() const AK_TOOLKIT_NOEXCEPT { return _null_group; }
+
+  // the first key of each group, by group id
+  const_markable_span<MP, OP> keys() const AK_TOOLKIT_NOEXCEPT { return const_markable_span<MP, OP>(_keys.data(), _keys.size()); }
+  key_type key(group_id g) const { return AK_TOOLKIT_ASSERT(g < _keys.size()), key_type(with_representation, _keys[g]); }
+};
+
+template <typename MP, typename OP, typename Hash, typename Eq>
+const typename markable_hash_group_by<MP, OP, Hash, Eq>::group_id markable_hash_group_by<MP, OP, Hash, Eq>::no_group;
+
+
+// counts[ids[i]] += 1 for i in [0, n): COUNT(*) of groups
+inline void count_group_rows(const std::uint32_t* ids, std::size_t n, std::size_t* counts)
+{
+  for (std::size_t i = 0; i != n; ++i)
+    ++counts[ids[i]];
+}
+
+// f(states[ids[i]], values[i].value()) for the values[i] that have a value:
+// like SQL aggregate functions, ignores elements without value
+template <typename MP, typename OP, typename State, typename F>
+void aggregate_group_values(const std::uint32_t* ids, const_markable_span<MP, OP> values, State* states, F f)
+{
+  const typename MP::representation_type* p = values.data();
+  for (std::size_t i = 0; i != values.size(); ++i)
+    if (!MP::is_marked_value(p[i]))
+      f(states[ids[i]], MP::access_value(p[i]));
+}
+
+
+// An equi-join of a probe key column with a build key column. As in SQL,
+// keys without value match no key. The build rows of each distinct key are
+// stored contiguously, in ascending order.
+
+template <typename MP, typename OP = order_none,
+          typename Hash = typename detail_::default_key_hash<MP, OP>::type,
+          typename Eq = typename detail_::default_key_equal<OP>::type>
+class markable_hash_join
+{
+public:
+  typedef std::size_t size_type;
+  typedef std::uint32_t row_index;
+
+private:
+  typedef markable_hash_group_by<MP, OP, Hash, Eq> groups_type;
+  typedef typename groups_type::group_id group_id;
+
+  groups_type _groups;
+  std::vector<row_index> _offsets;  // the build rows of group g are _rows[_offsets[g]], ..., _rows[_offsets[g + 1] - 1]
+  std::vector<row_index> _rows;
+
+  bool matchable(group_id g) const AK_TOOLKIT_NOEXCEPT { return g != groups_type::no_group && g != _groups.null_group(); }
+
+  // f(b, m, ids) for consecutive batches of keys: ids[i] is the group of keys[b + i]
+  template <typename F>
+  void for_each_batch(const_markable_span<MP, OP> keys, F f) const
+  {
+    group_id ids[detail_::hash_probe_batch];
+    for (size_type b = 0; b < keys.size(); b += detail_::hash_probe_batch)
+    {
+      const size_type m = std::min(detail_::hash_probe_batch, keys.size() - b);
+      _groups.find(keys.subspan(b, m), ids);
+      f(b, m, ids);
+    }
+  }
+
+  // the first of n elements added at the end of v
+  static row_index* append(std::vector<row_index>& v, size_type n)
+  {
+    v.resize(v.size() + n);
+    return v.data() + (v.size() - n);
+  }
+
+  row_index match_count(group_id g) const AK_TOOLKIT_NOEXCEPT { return matchable(g) ? _offsets[g + 1] - _offsets[g] : 0; }
+
+public:
+  explicit markable_hash_join(const_markable_span<MP, OP> build_keys, const Hash& hash = Hash(), const Eq& eq = Eq())
+    : _groups(0, hash, eq)
+  {
+    AK_TOOLKIT_ASSERT(build_keys.size() < groups_type::no_group);
+    std::vector<group_id> ids (build_keys.size());
+    _groups.group(build_keys, ids.data());
+
+    _offsets.assign(_groups.group_count() + 1, 0);
+    for (group_id g : ids)
+      if (g != _groups.null_group())
+        ++_offsets[g + 1];
+    for (size_type g = 1; g < _offsets.size(); ++g)
+      _offsets[g] += _offsets[g - 1];
+
+    _rows.resize(_offsets.back());
+    std::vector<row_index> ends (_offsets.begin(), _offsets.end() - 1);
+    for (size_type i = 0; i != ids.size(); ++i)
+      if (ids[i] != _groups.null_group())
+        _rows[ends[ids[i]]++] = row_index(i);
+  }
+
+  // the number of build rows with a key
+  size_type build_size() const AK_TOOLKIT_NOEXCEPT { return _rows.size(); }
+
+  // Appends the pairs of indices (i, j) such that keys[i] matches build_keys[j],
+  // ordered by i, then by j: i to probe_rows and j to build_rows, which need
+  // not have the same size. Returns the number of pairs.
+  size_type probe(const_markable_span<MP, OP> keys, std::vector<row_index>& probe_rows, std::vector<row_index>& build_rows) const
+  {
+    AK_TOOLKIT_ASSERT(keys.size() <= groups_type::no_group);
+    const size_type before = probe_rows.size();
+    for_each_batch(keys, [&](size_type b, size_type m, const group_id* ids) {
+      // the output grows once per batch, not once per pair
+      size_type pairs = 0;
+      for (size_type i = 0; i != m; ++i)
+        pairs += match_count(ids[i]);
+      row_index* out_probe = append(probe_rows, pairs);
+      row_index* out_build = append(build_rows, pairs);
+      for (size_type i = 0; i != m; ++i)
+        if (matchable(ids[i]))
+          for (row_index k = _offsets[ids[i]]; k != _offsets[ids[i] + 1]; ++k)
+          {
+            *out_probe++ = row_index(b + i);
+            *out_build++ = _rows[k];
+          }
+    });
+    return probe_rows.size() - before;
+  }
+
+  // counts[i] is the number of build rows that keys[i] matches: for semi- and anti-joins
+  void count_matches(const_markable_span<MP, OP> keys, row_index* counts) const
+  {
+    for_each_batch(keys, [&](size_type b, size_type m, const group_id* ids) {
+      for (size_type i = 0; i != m; ++i)
+        counts[b + i] = match_count(ids[i]);
+    });
+  }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_hash_group_by;
+using markable_ns::markable_hash_join;
+using markable_ns::count_group_rows;
+using markable_ns::aggregate_group_values;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_HASH_JOIN_HEADER_GUARD_
@@ -0,0 +1,751 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_MASK_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_MASK_HEADER_GUARD_
+
+#include "markable_vector.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !defined AK_TOOLKIT_NO_SIMD && defined __GNUC__ && defined __SSE2__ && (defined __x86_64__ || defined __i386__)
+#  define AK_TOOLKIT_X86_SIMD
+#  include <immintrin.h>
+#  define AK_TOOLKIT_TARGET(ISA) __attribute__((target(ISA)))
+#endif
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// The instruction set used by the batch kernels. The best one supported by
+// the CPU is detected at run-time; a lower one can be requested explicitly.
+
+enum class simd_level { scalar, sse2, avx2, avx512 };
+
+inline simd_level detected_simd_level()
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  static const simd_level level = []{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+      return simd_level::avx512;
+    if (__builtin_cpu_supports("avx2"))
+      return simd_level::avx2;
+    return simd_level::sse2;
+  }();
+  return level;
+#else
+  return simd_level::scalar;
+#endif
+}
+
+// Policies whose is_marked_value(r) is exactly r == marked_value() for an
+// integral representation. For these, the null-mask is computed by SIMD
+// equality comparisons.
+
+template <typename MP>
+struct is_single_sentinel_policy : std::false_type {};
+
+template <typename T, T Val>
+struct is_single_sentinel_policy<mark_int<T, Val>> : std::is_integral<T> {};
+
+#ifndef AK_TOOLBOX_NO_UNDERLYING_TYPE
+template <typename Enum, typename std::underlying_type<Enum>::type Val>
+struct is_single_sentinel_policy<mark_enum<Enum, Val>> : std::true_type {};
+#else
+template <typename Enum, int Val>
+struct is_single_sentinel_policy<mark_enum<Enum, Val>> : std::true_type {};
+#endif
+
+template <>
+struct is_single_sentinel_policy<mark_bool> : std::true_type {};
+
+// mark_fp_nan for IEEE float and double. For these the kernels detect NaNs
+// with unordered comparisons or by inspecting the bits, so that they also
+// work in builds with -ffast-math, where v != v is assumed to be false.
+
+template <typename MP>
+struct is_nan_policy : std::false_type {};
+
+template <>
+struct is_nan_policy<mark_fp_nan<float>> : std::integral_constant<bool, std::numeric_limits<float>::is_iec559> {};
+
+template <>
+struct is_nan_policy<mark_fp_nan<double>> : std::integral_constant<bool, std::numeric_limits<double>::is_iec559> {};
+
+namespace detail_ {
+
+inline std::size_t bitmap_words(std::size_t n) { return (n + 63) / 64; }
+
+template <std::size_t Size> struct uint_of_size;
+template <> struct uint_of_size<1> { typedef std::uint8_t  type; };
+template <> struct uint_of_size<2> { typedef std::uint16_t type; };
+template <> struct uint_of_size<4> { typedef std::uint32_t type; };
+template <> struct uint_of_size<8> { typedef std::uint64_t type; };
+
+template <typename T>
+typename uint_of_size<sizeof(T)>::type as_uint(T v)
+{
+  typename uint_of_size<sizeof(T)>::type ans;
+  std::memcpy(&ans, &v, sizeof(T));
+  return ans;
+}
+
+inline bool is_nan_bits(float v)
+{
+  return (as_uint(v) & 0x7FFFFFFFu) > 0x7F800000u;
+}
+
+inline bool is_nan_bits(double v)
+{
+  return (as_uint(v) & 0x7FFFFFFFFFFFFFFFull) > 0x7FF0000000000000ull;
+}
+
+struct generic_kernel_tag {};
+struct sentinel_kernel_tag {};
+struct nan_kernel_tag {};
+
+template <typename MP>
+struct kernel_tag
+{
+  typedef typename std::conditional<is_single_sentinel_policy<MP>::value, sentinel_kernel_tag,
+          typename std::conditional<is_nan_policy<MP>::value, nan_kernel_tag,
+                                    generic_kernel_tag>::type>::type type;
+};
+
+template <typename MP, typename Rep>
+bool is_marked_representation(const Rep& r, generic_kernel_tag) { return MP::is_marked_value(r); }
+
+template <typename MP, typename Rep>
+bool is_marked_representation(const Rep& r, sentinel_kernel_tag) { return MP::is_marked_value(r); }
+
+template <typename MP, typename Rep>
+bool is_marked_representation(const Rep& r, nan_kernel_tag) { return is_nan_bits(r); }
+
+template <typename MP, typename Rep>
+bool is_marked_representation(const Rep& r)
+{
+  return is_marked_representation<MP>(r, typename kernel_tag<MP>::type{});
+}
+
+// bit j of the returned word is set iff !MP::is_marked_value(p[j]), for j < n <= 64
+template <typename MP, typename Rep>
+std::uint64_t value_mask_word(const Rep* p, std::size_t n)
+{
+  std::uint64_t word = 0;
+  for (std::size_t j = 0; j != n; ++j)
+    word |= std::uint64_t(!is_marked_representation<MP>(p[j])) << j;
+  return word;
+}
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+// Each kernel processes `blocks` full blocks of 64 elements and writes one word per block.
+// A set bit means "not equal to the sentinel".
+
+inline void value_mask_blocks_sse2(const std::uint8_t* p, std::size_t blocks, std::uint8_t s, std::uint64_t* out)
+{
+  const __m128i vs = _mm_set1_epi8(char(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 16)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j));
+      eq |= std::uint64_t(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vs)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+inline void value_mask_blocks_sse2(const std::uint16_t* p, std::size_t blocks, std::uint16_t s, std::uint64_t* out)
+{
+  const __m128i vs = _mm_set1_epi16(short(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 16)
+    {
+      __m128i c0 = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j)), vs);
+      __m128i c1 = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j + 8)), vs);
+      eq |= std::uint64_t(unsigned(_mm_movemask_epi8(_mm_packs_epi16(c0, c1)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+inline void value_mask_blocks_sse2(const std::uint32_t* p, std::size_t blocks, std::uint32_t s, std::uint64_t* out)
+{
+  const __m128i vs = _mm_set1_epi32(int(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 4)
+    {
+      __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j)), vs);
+      eq |= std::uint64_t(unsigned(_mm_movemask_ps(_mm_castsi128_ps(c)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+inline void value_mask_blocks_sse2(const std::uint64_t* p, std::size_t blocks, std::uint64_t s, std::uint64_t* out)
+{
+  const __m128i vs = _mm_set1_epi64x((long long)(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 2)
+    {
+      // SSE2 has no 64-bit compare: both 32-bit halves must compare equal
+      __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j)), vs);
+      c = _mm_and_si128(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+      eq |= std::uint64_t(unsigned(_mm_movemask_pd(_mm_castsi128_pd(c)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const std::uint8_t* p, std::size_t blocks, std::uint8_t s, std::uint64_t* out)
+{
+  const __m256i vs = _mm256_set1_epi8(char(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    __m256i c0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), vs);
+    __m256i c1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), vs);
+    std::uint64_t eq = std::uint64_t(unsigned(_mm256_movemask_epi8(c0)))
+                     | std::uint64_t(unsigned(_mm256_movemask_epi8(c1))) << 32;
+    out[b] = ~eq;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const std::uint16_t* p, std::size_t blocks, std::uint16_t s, std::uint64_t* out)
+{
+  const __m256i vs = _mm256_set1_epi16(short(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 32)
+    {
+      __m256i c0 = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j)), vs);
+      __m256i c1 = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j + 16)), vs);
+      // packs works within 128-bit lanes: restore the element order
+      __m256i c = _mm256_permute4x64_epi64(_mm256_packs_epi16(c0, c1), _MM_SHUFFLE(3, 1, 2, 0));
+      eq |= std::uint64_t(unsigned(_mm256_movemask_epi8(c))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const std::uint32_t* p, std::size_t blocks, std::uint32_t s, std::uint64_t* out)
+{
+  const __m256i vs = _mm256_set1_epi32(int(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 8)
+    {
+      __m256i c = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j)), vs);
+      eq |= std::uint64_t(unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(c)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const std::uint64_t* p, std::size_t blocks, std::uint64_t s, std::uint64_t* out)
+{
+  const __m256i vs = _mm256_set1_epi64x((long long)(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t eq = 0;
+    for (unsigned j = 0; j != 64; j += 4)
+    {
+      __m256i c = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j)), vs);
+      eq |= std::uint64_t(unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(c)))) << j;
+    }
+    out[b] = ~eq;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const std::uint8_t* p, std::size_t blocks, std::uint8_t s, std::uint64_t* out)
+{
+  const __m512i vs = _mm512_set1_epi8(char(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+    out[b] = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p), vs);
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const std::uint16_t* p, std::size_t blocks, std::uint16_t s, std::uint64_t* out)
+{
+  const __m512i vs = _mm512_set1_epi16(short(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+    out[b] = std::uint64_t(_mm512_cmpneq_epi16_mask(_mm512_loadu_si512(p), vs))
+           | std::uint64_t(_mm512_cmpneq_epi16_mask(_mm512_loadu_si512(p + 32), vs)) << 32;
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const std::uint32_t* p, std::size_t blocks, std::uint32_t s, std::uint64_t* out)
+{
+  const __m512i vs = _mm512_set1_epi32(int(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ne = 0;
+    for (unsigned j = 0; j != 64; j += 16)
+      ne |= std::uint64_t(_mm512_cmpneq_epi32_mask(_mm512_loadu_si512(p + j), vs)) << j;
+    out[b] = ne;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const std::uint64_t* p, std::size_t blocks, std::uint64_t s, std::uint64_t* out)
+{
+  const __m512i vs = _mm512_set1_epi64((long long)(s));
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ne = 0;
+    for (unsigned j = 0; j != 64; j += 8)
+      ne |= std::uint64_t(_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(p + j), vs)) << j;
+    out[b] = ne;
+  }
+}
+
+// NaN masks use ordered comparisons of a value with itself: a set bit means "not NaN"
+
+inline void value_mask_blocks_sse2(const float* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 4)
+    {
+      __m128 v = _mm_loadu_ps(p + j);
+      ord |= std::uint64_t(unsigned(_mm_movemask_ps(_mm_cmpord_ps(v, v)))) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+inline void value_mask_blocks_sse2(const double* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 2)
+    {
+      __m128d v = _mm_loadu_pd(p + j);
+      ord |= std::uint64_t(unsigned(_mm_movemask_pd(_mm_cmpord_pd(v, v)))) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const float* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 8)
+    {
+      __m256 v = _mm256_loadu_ps(p + j);
+      ord |= std::uint64_t(unsigned(_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_ORD_Q)))) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline void value_mask_blocks_avx2(const double* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 4)
+    {
+      __m256d v = _mm256_loadu_pd(p + j);
+      ord |= std::uint64_t(unsigned(_mm256_movemask_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q)))) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const float* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 16)
+    {
+      __m512 v = _mm512_loadu_ps(p + j);
+      ord |= std::uint64_t(_mm512_cmp_ps_mask(v, v, _CMP_ORD_Q)) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline void value_mask_blocks_avx512(const double* p, std::size_t blocks, std::uint64_t* out)
+{
+  for (std::size_t b = 0; b != blocks; ++b, p += 64)
+  {
+    std::uint64_t ord = 0;
+    for (unsigned j = 0; j != 64; j += 8)
+    {
+      __m512d v = _mm512_loadu_pd(p + j);
+      ord |= std::uint64_t(_mm512_cmp_pd_mask(v, v, _CMP_ORD_Q)) << j;
+    }
+    out[b] = ord;
+  }
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+// returns the number of leading elements processed by SIMD (a multiple of 64)
+template <typename MP, typename Rep>
+std::size_t value_mask_simd(const Rep* p, std::size_t n, std::uint64_t* out, simd_level level, sentinel_kernel_tag)
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  typedef typename uint_of_size<sizeof(Rep)>::type U;
+  const U* u = reinterpret_cast<const U*>(p);
+  const U s = as_uint(Rep(MP::marked_value()));
+  const std::size_t blocks = n / 64;
+
+  switch (level)
+  {
+    case simd_level::avx512: value_mask_blocks_avx512(u, blocks, s, out); return blocks * 64;
+    case simd_level::avx2:   value_mask_blocks_avx2(u, blocks, s, out);   return blocks * 64;
+    case simd_level::sse2:   value_mask_blocks_sse2(u, blocks, s, out);   return blocks * 64;
+    case simd_level::scalar: break;
+  }
+#else
+  (void)p; (void)n; (void)out; (void)level;
+#endif
+  return 0;
+}
+
+template <typename MP, typename Rep>
+std::size_t value_mask_simd(const Rep* p, std::size_t n, std::uint64_t* out, simd_level level, nan_kernel_tag)
+{
+#if defined AK_TOOLKIT_X86_SIMD
+  const std::size_t blocks = n / 64;
+
+  switch (level)
+  {
+    case simd_level::avx512: value_mask_blocks_avx512(p, blocks, out); return blocks * 64;
+    case simd_level::avx2:   value_mask_blocks_avx2(p, blocks, out);   return blocks * 64;
+    case simd_level::sse2:   value_mask_blocks_sse2(p, blocks, out);   return blocks * 64;
+    case simd_level::scalar: break;
+  }
+#else
+  (void)p; (void)n; (void)out; (void)level;
+#endif
+  return 0;
+}
+
+template <typename MP, typename Rep>
+std::size_t value_mask_simd(const Rep*, std::size_t, std::uint64_t*, simd_level, generic_kernel_tag)
+{
+  return 0;
+}
+
+// Selection by a presence bitmap: out[i] = bit i of the bitmap is set ? p[i] : fill.
+// Used both to replace marked values with a fill value and to write marked values
+// where a bitmap says there is no value. Representations are copied as bits.
+
+template <typename Rep>
+struct is_bitwise_selectable : std::integral_constant<bool, std::is_trivially_copyable<Rep>::value &&
+                                                      (sizeof(Rep) == 1 || sizeof(Rep) == 2 || sizeof(Rep) == 4 || sizeof(Rep) == 8)> {};
+
+template <typename Rep>
+void select_by_mask_scalar(const Rep* p, const std::uint64_t* bitmap, std::size_t first, std::size_t last, const Rep& fill, Rep* out)
+{
+  for (std::size_t i = first; i != last; ++i)
+    out[i] = ((bitmap[i / 64] >> (i % 64)) & 1) ? p[i] : fill;
+}
+
+#if defined AK_TOOLKIT_X86_SIMD
+
+// Each kernel processes `blocks` full blocks of 64 elements, reading one bitmap word per block.
+// The lane_mask functions turn the low bits of `bits` into lanes of all ones or all zeros.
+
+inline __m128i broadcast_sse2(std::uint8_t v)  { return _mm_set1_epi8(char(v)); }
+inline __m128i broadcast_sse2(std::uint16_t v) { return _mm_set1_epi16(short(v)); }
+inline __m128i broadcast_sse2(std::uint32_t v) { return _mm_set1_epi32(int(v)); }
+inline __m128i broadcast_sse2(std::uint64_t v) { return _mm_set1_epi64x((long long)(v)); }
+
+inline __m128i lane_mask_sse2(std::uint64_t bits, std::uint8_t)
+{
+  const __m128i sel = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  __m128i v = _mm_set1_epi16(short(bits));   // b0 b1 b0 b1 ...
+  v = _mm_unpacklo_epi8(v, v);               // b0 b0 b1 b1 ...
+  v = _mm_unpacklo_epi16(v, v);              // b0 x4, b1 x4, ...
+  v = _mm_unpacklo_epi32(v, v);              // b0 x8, b1 x8
+  return _mm_cmpeq_epi8(_mm_and_si128(v, sel), sel);
+}
+
+inline __m128i lane_mask_sse2(std::uint64_t bits, std::uint16_t)
+{
+  const __m128i sel = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+  return _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(short(bits)), sel), sel);
+}
+
+inline __m128i lane_mask_sse2(std::uint64_t bits, std::uint32_t)
+{
+  const __m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+  return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(int(bits)), sel), sel);
+}
+
+inline __m128i lane_mask_sse2(std::uint64_t bits, std::uint64_t)
+{
+  // SSE2 has no 64-bit compare
+  return _mm_set_epi64x(-(long long)((bits >> 1) & 1), -(long long)(bits & 1));
+}
+
+template <typename U>
+void select_blocks_sse2(const U* p, const std::uint64_t* bitmap, std::size_t blocks, U fill, U* out)
+{
+  const unsigned lanes = 16 / sizeof(U);
+  const __m128i vf = broadcast_sse2(fill);
+  for (std::size_t b = 0; b != blocks; ++b, p += 64, out += 64)
+    for (unsigned j = 0; j != 64; j += lanes)
+    {
+      const __m128i m = lane_mask_sse2(bitmap[b] >> j, U());
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + j));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, vf)));
+    }
+}
+
+AK_TOOLKIT_TARGET("avx2") inline __m256i broadcast_avx2(std::uint8_t v)  { return _mm256_set1_epi8(char(v)); }
+AK_TOOLKIT_TARGET("avx2") inline __m256i broadcast_avx2(std::uint16_t v) { return _mm256_set1_epi16(short(v)); }
+AK_TOOLKIT_TARGET("avx2") inline __m256i broadcast_avx2(std::uint32_t v) { return _mm256_set1_epi32(int(v)); }
+AK_TOOLKIT_TARGET("avx2") inline __m256i broadcast_avx2(std::uint64_t v) { return _mm256_set1_epi64x((long long)(v)); }
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i lane_mask_avx2(std::uint64_t bits, std::uint8_t)
+{
+  // the shuffle works within 128-bit halves; each half holds all four bytes of `bits`
+  const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i sel = _mm256_set1_epi64x(0x8040201008040201ll);
+  const __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(int(bits)), spread);
+  return _mm256_cmpeq_epi8(_mm256_and_si256(v, sel), sel);
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i lane_mask_avx2(std::uint64_t bits, std::uint16_t)
+{
+  const __m256i sel = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+  return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(short(bits)), sel), sel);
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i lane_mask_avx2(std::uint64_t bits, std::uint32_t)
+{
+  const __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(bits)), sel), sel);
+}
+
+AK_TOOLKIT_TARGET("avx2")
+inline __m256i lane_mask_avx2(std::uint64_t bits, std::uint64_t)
+{
+  const __m256i sel = _mm256_setr_epi64x(1, 2, 4, 8);
+  return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x((long long)(bits)), sel), sel);
+}
+
+template <typename U>
+AK_TOOLKIT_TARGET("avx2")
+void select_blocks_avx2(const U* p, const std::uint64_t* bitmap, std::size_t blocks, U fill, U* out)
+{
+  const unsigned lanes = 32 / sizeof(U);
+  const __m256i vf = broadcast_avx2(fill);
+  for (std::size_t b = 0; b != blocks; ++b, p += 64, out += 64)
+    for (unsigned j = 0; j != 64; j += lanes)
+    {
+      const __m256i m = lane_mask_avx2(bitmap[b] >> j, U());
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + j));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), _mm256_blendv_epi8(vf, v, m));
+    }
+}
+
+// AVX-512 selects directly with the bitmap bits as the write mask
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline __m512i broadcast_avx512(std::uint8_t v)  { return _mm512_set1_epi8(char(v)); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline __m512i broadcast_avx512(std::uint16_t v) { return _mm512_set1_epi16(short(v)); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline __m512i broadcast_avx512(std::uint32_t v) { return _mm512_set1_epi32(int(v)); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw") inline __m512i broadcast_avx512(std::uint64_t v) { return _mm512_set1_epi64((long long)(v)); }
+
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i masked_move_avx512(__m512i vf, std::uint64_t bits, __m512i v, std::uint8_t)  { return _mm512_mask_mov_epi8(vf, __mmask64(bits), v); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i masked_move_avx512(__m512i vf, std::uint64_t bits, __m512i v, std::uint16_t) { return _mm512_mask_mov_epi16(vf, __mmask32(bits), v); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i masked_move_avx512(__m512i vf, std::uint64_t bits, __m512i v, std::uint32_t) { return _mm512_mask_mov_epi32(vf, __mmask16(bits), v); }
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+inline __m512i masked_move_avx512(__m512i vf, std::uint64_t bits, __m512i v, std::uint64_t) { return _mm512_mask_mov_epi64(vf, __mmask8(bits), v); }
+
+template <typename U>
+AK_TOOLKIT_TARGET("avx512f,avx512bw")
+void select_blocks_avx512(const U* p, const std::uint64_t* bitmap, std::size_t blocks, U fill, U* out)
+{
+  const unsigned lanes = 64 / sizeof(U);
+  const __m512i vf = broadcast_avx512(fill);
+  for (std::size_t b = 0; b != blocks; ++b, p += 64, out += 64)
+    for (unsigned j = 0; j != 64; j += lanes)
+    {
+      const __m512i v = _mm512_loadu_si512(p + j);
+      _mm512_storeu_si512(out + j, masked_move_avx512(vf, bitmap[b] >> j, v, U()));
+    }
+}
+
+#endif // AK_TOOLKIT_X86_SIMD
+
+template <typename Rep>
+void select_by_mask(const Rep* p, const std::uint64_t* bitmap, std::size_t n, const Rep& fill, Rep* out, simd_level level, std::true_type)
+{
+  std::size_t done = 0;
+#if defined AK_TOOLKIT_X86_SIMD
+  typedef typename uint_of_size<sizeof(Rep)>::type U;
+  const U* u = reinterpret_cast<const U*>(p);
+  U* uo = reinterpret_cast<U*>(out);
+  const std::size_t blocks = n / 64;
+
+  switch (level)
+  {
+    case simd_level::avx512: select_blocks_avx512(u, bitmap, blocks, as_uint(fill), uo); done = blocks * 64; break;
+    case simd_level::avx2:   select_blocks_avx2(u, bitmap, blocks, as_uint(fill), uo);   done = blocks * 64; break;
+    case simd_level::sse2:   select_blocks_sse2(u, bitmap, blocks, as_uint(fill), uo);   done = blocks * 64; break;
+    case simd_level::scalar: break;
+  }
+#else
+  (void)level;
+#endif
+  select_by_mask_scalar(p, bitmap, done, n, fill, out);
+}
+
+template <typename Rep>
+void select_by_mask(const Rep* p, const std::uint64_t* bitmap, std::size_t n, const Rep& fill, Rep* out, simd_level, std::false_type)
+{
+  select_by_mask_scalar(p, bitmap, 0, n, fill, out);
+}
+
+template <typename Rep>
+void select_by_mask(const Rep* p, const std::uint64_t* bitmap, std::size_t n, const Rep& fill, Rep* out, simd_level level)
+{
+  select_by_mask(p, bitmap, n, fill, out, level, is_bitwise_selectable<Rep>{});
+}
+
+} // namespace detail_
+
+
+// Writes to bitmap_out[0 .. (n + 63) / 64) a packed presence bitmap:
+// bit (i % 64) of word (i / 64) is set iff element i has a value.
+// The unused high bits of the last word are zero.
+
+template <typename MP>
+void compute_value_mask(const typename MP::representation_type* first, std::size_t n, std::uint64_t* bitmap_out,
+                        simd_level level = detected_simd_level())
+{
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+
+  const std::size_t done = detail_::value_mask_simd<MP>(first, n, bitmap_out, level,
+                                                        typename detail_::kernel_tag<MP>::type{});
+  for (std::size_t i = done; i < n; i += 64)
+    bitmap_out[i / 64] = detail_::value_mask_word<MP>(first + i, n - i < 64 ? n - i : 64);
+}
+
+template <typename MP, typename OP>
+void compute_value_mask(const markable<MP, OP>* first, std::size_t n, std::uint64_t* bitmap_out,
+                        simd_level level = detected_simd_level())
+{
+  static_assert(sizeof(markable<MP, OP>) == sizeof(typename MP::representation_type), "markable must not add storage");
+  static_assert(is_columnar_mark_policy<MP>::value, "compute_value_mask requires storage_type to be the same as representation_type");
+  compute_value_mask<MP>(reinterpret_cast<const typename MP::representation_type*>(first), n, bitmap_out, level);
+}
+
+template <typename MP, typename OP>
+void compute_value_mask(const markable_vector<MP, OP>& v, std::uint64_t* bitmap_out,
+                        simd_level level = detected_simd_level())
+{
+  compute_value_mask<MP>(v.data(), v.size(), bitmap_out, level);
+}
+
+template <typename MP, typename OP>
+void compute_value_mask(const_markable_span<MP, OP> v, std::uint64_t* bitmap_out,
+                        simd_level level = detected_simd_level())
+{
+  compute_value_mask<MP>(v.data(), v.size(), bitmap_out, level);
+}
+
+
+// Conversion to and from separate values and a validity bitmap, as used by
+// Apache Arrow: a set bit means that the corresponding value is present.
+
+// Writes to values_out[0 .. n) the representations, with every marked value
+// replaced by `fill`, and to bitmap_out the presence bitmap (see compute_value_mask).
+// values_out can be the same as first.
+
+template <typename MP>
+void to_values_and_mask(const typename MP::representation_type* first, std::size_t n,
+                        typename MP::representation_type* values_out, std::uint64_t* bitmap_out,
+                        const typename MP::representation_type& fill = typename MP::representation_type(),
+                        simd_level level = detected_simd_level())
+{
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+
+  compute_value_mask<MP>(first, n, bitmap_out, level);
+  detail_::select_by_mask(first, bitmap_out, n, fill, values_out, level);
+}
+
+template <typename MP, typename OP>
+void to_values_and_mask(const_markable_span<MP, OP> v, typename MP::representation_type* values_out, std::uint64_t* bitmap_out,
+                        const typename MP::representation_type& fill = typename MP::representation_type(),
+                        simd_level level = detected_simd_level())
+{
+  to_values_and_mask<MP>(v.data(), v.size(), values_out, bitmap_out, fill, level);
+}
+
+// Writes to out[0 .. n) values[i] where bit i of the bitmap is set, and
+// MP::marked_value() elsewhere. out can be the same as values.
+
+template <typename MP>
+void from_values_and_mask(const typename MP::representation_type* values, const std::uint64_t* bitmap, std::size_t n,
+                          typename MP::representation_type* out, simd_level level = detected_simd_level())
+{
+  static_assert(is_columnar_mark_policy<MP>::value, "from_values_and_mask requires storage_type to be the same as representation_type");
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+
+  const typename MP::representation_type marked = MP::marked_value();
+  detail_::select_by_mask(values, bitmap, n, marked, out, level);
+}
+
+template <typename MP, typename OP>
+void from_values_and_mask(const typename MP::representation_type* values, const std::uint64_t* bitmap,
+                          markable_span<MP, OP> out, simd_level level = detected_simd_level())
+{
+  from_values_and_mask<MP>(values, bitmap, out.size(), out.data(), level);
+}
+
+} // namespace markable_ns
+
+using markable_ns::compute_value_mask;
+using markable_ns::to_values_and_mask;
+using markable_ns::from_values_and_mask;
+using markable_ns::simd_level;
+using markable_ns::detected_simd_level;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_MASK_HEADER_GUARD_
@@ -0,0 +1,457 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_PARALLEL_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_PARALLEL_HEADER_GUARD_
+
+#include "markable_aggregate.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+namespace detail_ {
+
+// The chunk indices [begin, end) owned by one thread of a markable_thread_pool.
+// The owner takes chunks from the front; idle threads steal the back half.
+struct chunk_range
+{
+  std::mutex mutex;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+
+  void reset(std::size_t b, std::size_t e)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    begin = b;
+    end = e;
+  }
+
+  bool pop_front(std::size_t& i)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (begin == end)
+      return false;
+    i = begin++;
+    return true;
+  }
+
+  // moves the back half of victim's chunks to *this, which is empty
+  bool steal_from(chunk_range& victim)
+  {
+    std::size_t b, e;
+    {
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (victim.begin == victim.end)
+        return false;
+      b = victim.begin + (victim.end - victim.begin) / 2;
+      e = victim.end;
+      victim.end = b;
+    }
+    reset(b, e);
+    return true;
+  }
+};
+
+} // namespace detail_
+
+
+// A fixed set of threads that run the chunks of one job at a time, together
+// with the thread that submitted it. The chunks are initially split evenly
+// between the threads; a thread that runs out of chunks steals half of the
+// remaining ones of another thread. Algorithms that use the pool split their
+// input into chunks of chunk_bytes() bytes, and combine partial results in
+// the order of chunks: their results do not depend on the number of threads.
+
+class markable_thread_pool
+{
+  typedef std::function<void(std::size_t)> task_type;
+
+  std::vector<std::thread> _threads;
+  std::unique_ptr<detail_::chunk_range[]> _ranges; // [0] belongs to the submitting thread
+  std::size_t _chunk_bytes;
+
+  std::mutex _submit_mutex;                        // one job at a time
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  std::size_t _generation;
+  unsigned _busy;                                  // workers running the current job
+  bool _stop;
+  const task_type* _task;
+
+  std::mutex _error_mutex;
+  std::exception_ptr _error;
+  std::atomic<bool> _failed;
+
+  unsigned participants() const AK_TOOLKIT_NOEXCEPT { return unsigned(_threads.size()) + 1; }
+
+  void run_chunk(std::size_t i)
+  {
+    if (_failed.load(std::memory_order_relaxed))
+      return; // after an exception, the remaining chunks are skipped
+    try {
+      (*_task)(i);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(_error_mutex);
+      if (!_error)
+        _error = std::current_exception();
+      _failed.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  void participate(unsigned self)
+  {
+    const unsigned n = participants();
+    std::size_t i;
+    for (;;)
+    {
+      while (_ranges[self].pop_front(i))
+        run_chunk(i);
+
+      bool stolen = false;
+      for (unsigned k = 1; k != n && !stolen; ++k)
+        stolen = _ranges[self].steal_from(_ranges[(self + k) % n]);
+      if (!stolen)
+        return;
+    }
+  }
+
+  void worker(unsigned self)
+  {
+    std::size_t seen = 0;
+    for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _start.wait(lock, [&] { return _stop || _generation != seen; });
+        if (_stop)
+          return;
+        seen = _generation;
+      }
+      participate(self);
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_busy == 0)
+          _done.notify_one();
+      }
+    }
+  }
+
+public:
+  static unsigned default_thread_count() AK_TOOLKIT_NOEXCEPT
+  {
+    const unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+  }
+
+  // `threads` includes the thread that submits jobs: markable_thread_pool(1) starts no threads
+  explicit markable_thread_pool(unsigned threads = default_thread_count(), std::size_t chunk_bytes = 256 * 1024)
+    : _ranges(new detail_::chunk_range[threads == 0 ? 1 : threads]), _chunk_bytes(chunk_bytes == 0 ? 1 : chunk_bytes),
+      _generation(0), _busy(0), _stop(false), _task(nullptr), _failed(false)
+  {
+    for (unsigned i = 1; i < threads; ++i)
+      _threads.emplace_back(&markable_thread_pool::worker, this, i);
+  }
+
+  markable_thread_pool(const markable_thread_pool&) = delete;
+  markable_thread_pool& operator=(const markable_thread_pool&) = delete;
+
+  ~markable_thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _start.notify_all();
+    for (std::thread& t : _threads)
+      t.join();
+  }
+
+  unsigned thread_count() const AK_TOOLKIT_NOEXCEPT { return participants(); }
+  std::size_t chunk_bytes() const AK_TOOLKIT_NOEXCEPT { return _chunk_bytes; }
+
+  // the number of elements of type T in a chunk: a multiple of 64, so that
+  // chunks of a column start at word boundaries of its presence bitmap
+  template <typename T>
+  std::size_t chunk_elements() const AK_TOOLKIT_NOEXCEPT
+  {
+    const std::size_t n = _chunk_bytes / sizeof(T) / 64 * 64;
+    return n == 0 ? 64 : n;
+  }
+
+  // Calls f(i) once for every i in [0, chunks) and returns when all calls
+  // have returned. If a call throws, the chunks that have not started are
+  // skipped, and the first exception is rethrown. Must not be called from f.
+  template <typename F>
+  void for_each_chunk(std::size_t chunks, F f)
+  {
+    if (chunks == 0)
+      return;
+    if (_threads.empty() || chunks == 1)
+    {
+      for (std::size_t i = 0; i != chunks; ++i)
+        f(i);
+      return;
+    }
+
+    std::lock_guard<std::mutex> submit(_submit_mutex);
+    const task_type task = f;
+    const unsigned n = participants();
+    for (unsigned t = 0; t != n; ++t)
+      _ranges[t].reset(chunks * t / n, chunks * (t + 1) / n);
+    _error = nullptr;
+    _failed.store(false, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _task = &task;
+      _busy = unsigned(_threads.size());
+      ++_generation;
+    }
+    _start.notify_all();
+
+    participate(0);
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done.wait(lock, [&] { return _busy == 0; });
+      _task = nullptr;
+    }
+    if (_error)
+      std::rethrow_exception(_error);
+  }
+};
+
+namespace detail_ {
+
+inline std::size_t chunk_count(std::size_t n, std::size_t chunk) AK_TOOLKIT_NOEXCEPT { return (n + chunk - 1) / chunk; }
+
+// f(first, last, i) for the elements of chunk i
+template <typename Rep, typename F>
+void for_each_chunk_of(markable_thread_pool& pool, Rep* first, std::size_t n, F f)
+{
+  const std::size_t chunk = pool.chunk_elements<Rep>();
+  pool.for_each_chunk(chunk_count(n, chunk), [&](std::size_t i) {
+    Rep* b = first + i * chunk;
+    f(b, b + std::min(chunk, n - i * chunk), i);
+  });
+}
+
+template <typename FPT>
+fp_summary<FPT> combine_summaries(const fp_summary<FPT>& l, const fp_summary<FPT>& r)
+{
+  fp_summary<FPT> ans = { l.count + r.count, l.sum + r.sum, r.min < l.min ? r.min : l.min, l.max < r.max ? r.max : l.max };
+  return ans;
+}
+
+template <typename FPT>
+fp_summary<FPT> combine_pairwise(const fp_summary<FPT>* p, std::size_t n)
+{
+  return n == 1 ? p[0] : combine_summaries(combine_pairwise(p, n / 2), combine_pairwise(p + n / 2, n - n / 2));
+}
+
+template <typename MP>
+fp_summary<typename MP::representation_type>
+parallel_summarize(markable_thread_pool& pool, const typename MP::representation_type* first, std::size_t n,
+                   simd_level level, summation method, nan_kernel_tag)
+{
+  typedef typename MP::representation_type FPT;
+  std::vector<fp_summary<FPT>> parts (chunk_count(n, pool.chunk_elements<FPT>()));
+  for_each_chunk_of(pool, first, n, [&](const FPT* b, const FPT* e, std::size_t i) {
+    parts[i] = summarize<MP>(b, std::size_t(e - b), level, method);
+  });
+
+  if (parts.empty())
+    return summarize<MP>(first, 0, level, method);
+  if (method == summation::pairwise)
+    return combine_pairwise(parts.data(), parts.size());
+
+  fp_summary<FPT> ans = parts[0];
+  FPT comp = 0;
+  for (std::size_t i = 1; i != parts.size(); ++i)
+  {
+    if (method == summation::kahan)
+    {
+      const FPT s = ans.sum;
+      ans = combine_summaries(ans, parts[i]);
+      ans.sum = s;
+      compensated_add(ans.sum, comp, parts[i].sum);
+    }
+    else
+      ans = combine_summaries(ans, parts[i]);
+  }
+  if (method == summation::kahan)
+    ans.sum = compensated_total(ans.sum, comp);
+  return ans;
+}
+
+// integer sums are combined exactly
+template <typename MP>
+int_summary<typename MP::representation_type>
+parallel_summarize(markable_thread_pool& pool, const typename MP::representation_type* first, std::size_t n,
+                   simd_level level, summation, sentinel_kernel_tag)
+{
+  typedef typename MP::representation_type T;
+  typedef typename int_summary<T>::sum_type S;
+  std::vector<int_summary<T>> parts (chunk_count(n, pool.chunk_elements<T>()));
+  std::vector<wide_sum> sums (parts.size());
+  for_each_chunk_of(pool, first, n, [&](const T* b, const T* e, std::size_t i) {
+    parts[i] = summarize_ints<MP>(b, std::size_t(e - b), level, sums[i]);
+  });
+
+  wide_sum sum = { 0, 0 };
+  int_summary<T> ans = { 0, 0, false, std::numeric_limits<T>::max(), std::numeric_limits<T>::min() };
+  for (std::size_t i = 0; i != parts.size(); ++i)
+  {
+    ans.count += parts[i].count;
+    sum.add_bits(sums[i].lo, sums[i].hi);
+    ans.min = parts[i].min < ans.min ? parts[i].min : ans.min;
+    ans.max = ans.max < parts[i].max ? parts[i].max : ans.max;
+  }
+  ans.sum = S(sum.lo);
+  ans.overflow = !sum.fits(S());
+  return ans;
+}
+
+} // namespace detail_
+
+
+// summarize() of chunks in parallel. The result is the same for any number
+// of threads; for floating-point values it depends on chunk_bytes(), as the
+// sums of chunks are added with `method`.
+
+template <typename MP>
+typename detail_::summary_of<MP>::type
+parallel_summarize(markable_thread_pool& pool, const typename MP::representation_type* first, std::size_t n,
+                   summation method = summation::simple, simd_level level = detected_simd_level())
+{
+  static_assert(is_single_sentinel_policy<MP>::value || is_nan_policy<MP>::value, "parallel_summarize requires mark_int, mark_enum, mark_bool or mark_fp_nan");
+  if (level > detected_simd_level())
+    level = detected_simd_level();
+  return detail_::parallel_summarize<MP>(pool, first, n, level, method, typename detail_::kernel_tag<MP>::type{});
+}
+
+template <typename MP, typename OP>
+typename detail_::summary_of<MP>::type
+parallel_summarize(markable_thread_pool& pool, const_markable_span<MP, OP> s,
+                   summation method = summation::simple, simd_level level = detected_simd_level())
+{
+  return parallel_summarize<MP>(pool, s.data(), s.size(), method, level);
+}
+
+template <typename MP, typename OP>
+typename detail_::summary_of<MP>::type
+parallel_summarize(markable_thread_pool& pool, const markable_vector<MP, OP>& v,
+                   summation method = summation::simple, simd_level level = detected_simd_level())
+{
+  return parallel_summarize<MP>(pool, v.data(), v.size(), method, level);
+}
+
+// The following work for any policy whose storage is the representation.
+
+template <typename MP>
+std::size_t parallel_count_values(markable_thread_pool& pool, const typename MP::representation_type* first, std::size_t n)
+{
+  typedef typename MP::representation_type Rep;
+  std::vector<std::size_t> counts (detail_::chunk_count(n, pool.chunk_elements<Rep>()));
+  detail_::for_each_chunk_of(pool, first, n, [&](const Rep* b, const Rep* e, std::size_t i) {
+    counts[i] = detail_::count_values<MP>(b, e);
+  });
+
+  std::size_t ans = 0;
+  for (std::size_t c : counts)
+    ans += c;
+  return ans;
+}
+
+template <typename MP, typename OP>
+std::size_t parallel_count_values(markable_thread_pool& pool, const_markable_span<MP, OP> s)
+{
+  return parallel_count_values<MP>(pool, s.data(), s.size());
+}
+
+// assigns r to every element
+template <typename MP>
+void parallel_fill(markable_thread_pool& pool, typename MP::representation_type* first, std::size_t n,
+                   const typename MP::representation_type& r)
+{
+  typedef typename MP::representation_type Rep;
+  detail_::for_each_chunk_of(pool, first, n, [&](Rep* b, Rep* e, std::size_t) {
+    std::fill(b, e, r);
+  });
+}
+
+template <typename MP, typename OP>
+void parallel_fill(markable_thread_pool& pool, markable_span<MP, OP> s, const markable<MP, OP>& v)
+{
+  parallel_fill<MP>(pool, s.data(), s.size(), v.representation_value());
+}
+
+// out[i] = f(in[i]), where f is called with markable_cref<MP, OP> and
+// returns a value convertible to markable<MP2, OP2>
+template <typename MP, typename OP, typename MP2, typename OP2, typename F>
+void parallel_transform(markable_thread_pool& pool, const_markable_span<MP, OP> in, markable_span<MP2, OP2> out, F f)
+{
+  typedef typename MP::representation_type Rep;
+  AK_TOOLKIT_ASSERT(in.size() == out.size());
+  typename MP2::representation_type* o = out.data();
+  const Rep* first = in.data();
+  detail_::for_each_chunk_of(pool, first, in.size(), [&](const Rep* b, const Rep* e, std::size_t) {
+    for (const Rep* p = b; p != e; ++p)
+      o[p - first] = markable<MP2, OP2>(f(markable_cref<MP, OP>(p))).representation_value();
+  });
+}
+
+// Writes to out the values of the elements that have one, in order, and
+// returns their number. Runs in two passes: counting, then copying.
+template <typename MP>
+std::size_t parallel_compact_values(markable_thread_pool& pool, const typename MP::representation_type* first, std::size_t n,
+                                    typename MP::value_type* out)
+{
+  typedef typename MP::representation_type Rep;
+  std::vector<std::size_t> offsets (detail_::chunk_count(n, pool.chunk_elements<Rep>()) + 1, 0);
+  detail_::for_each_chunk_of(pool, first, n, [&](const Rep* b, const Rep* e, std::size_t i) {
+    offsets[i + 1] = detail_::count_values<MP>(b, e);
+  });
+  for (std::size_t i = 1; i < offsets.size(); ++i)
+    offsets[i] += offsets[i - 1];
+
+  detail_::for_each_chunk_of(pool, first, n, [&](const Rep* b, const Rep* e, std::size_t i) {
+    typename MP::value_type* o = out + offsets[i];
+    for (const Rep* p = b; p != e; ++p)
+      if (!MP::is_marked_value(*p))
+        *o++ = MP::access_value(*p);
+  });
+  return offsets.back();
+}
+
+template <typename MP, typename OP>
+std::size_t parallel_compact_values(markable_thread_pool& pool, const_markable_span<MP, OP> s, typename MP::value_type* out)
+{
+  return parallel_compact_values<MP>(pool, s.data(), s.size(), out);
+}
+
+} // namespace markable_ns
+
+using markable_ns::markable_thread_pool;
+using markable_ns::parallel_summarize;
+using markable_ns::parallel_count_values;
+using markable_ns::parallel_fill;
+using markable_ns::parallel_transform;
+using markable_ns::parallel_compact_values;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_PARALLEL_HEADER_GUARD_
@@ -0,0 +1,261 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_RECORD_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_RECORD_HEADER_GUARD_
+
+#include "markable_span.hpp"
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// A field of a markable_record without a marked value: its presence is a bit
+// in the record's shared bitset. The interface is that of markable_ref.
+
+template <typename T>
+class markable_bit_cref
+{
+public:
+  typedef T value_type;
+  typedef const T& reference_type;
+
+private:
+  const T* _ptr;
+  const unsigned char* _byte;
+  unsigned char _mask;
+
+public:
+  markable_bit_cref(const T* p, const unsigned char* byte, unsigned char mask) AK_TOOLKIT_NOEXCEPT : _ptr(p), _byte(byte), _mask(mask) {}
+
+  bool has_value() const AK_TOOLKIT_NOEXCEPT { return (*_byte & _mask) != 0; }
+  reference_type value() const { return AK_TOOLKIT_ASSERT(has_value()), *_ptr; }
+};
+
+template <typename T>
+class markable_bit_ref
+{
+public:
+  typedef T value_type;
+  typedef const T& reference_type;
+
+private:
+  T* _ptr;
+  unsigned char* _byte;
+  unsigned char _mask;
+
+public:
+  markable_bit_ref(T* p, unsigned char* byte, unsigned char mask) AK_TOOLKIT_NOEXCEPT : _ptr(p), _byte(byte), _mask(mask) {}
+  markable_bit_ref(const markable_bit_ref&) = default;
+
+  // assignment writes through the reference
+  const markable_bit_ref& operator=(const markable_bit_ref& r) const
+  {
+    if (r.has_value())
+      assign(r.value());
+    else
+      assign_marked();
+    return *this;
+  }
+
+  bool has_value() const AK_TOOLKIT_NOEXCEPT { return (*_byte & _mask) != 0; }
+  reference_type value() const { return AK_TOOLKIT_ASSERT(has_value()), *_ptr; }
+
+  void assign(const value_type& v) const { *_ptr = v; *_byte |= _mask; }
+  void assign_marked() const { *_ptr = T(); *_byte &= ~_mask; }
+
+  operator markable_bit_cref<T> () const AK_TOOLKIT_NOEXCEPT { return markable_bit_cref<T>(_ptr, _byte, _mask); }
+};
+
+namespace detail_ {
+
+// A field declared with a mark policy stores its representation; any other
+// type is stored as is, with a presence bit.
+
+template <typename F, typename = void>
+struct record_field
+{
+  static_assert(std::is_trivially_copyable<F>::value, "a markable_record field must be trivially copyable");
+
+  typedef F slot_type;
+  typedef markable_bit_ref<F> reference;
+  typedef markable_bit_cref<F> const_reference;
+  static AK_TOOLKIT_CONSTEXPR bool uses_bit() AK_TOOLKIT_NOEXCEPT { return true; }
+};
+
+template <typename MP>
+struct record_field<MP, decltype(void(MP::is_marked_value(MP::marked_value())))>
+{
+  static_assert(is_columnar_mark_policy<MP>::value, "a markable_record field policy requires storage_type to be the same as representation_type");
+  static_assert(std::is_trivially_copyable<typename MP::representation_type>::value, "a markable_record field must be trivially copyable");
+
+  typedef typename MP::representation_type slot_type;
+  typedef markable_ref<MP> reference;
+  typedef markable_cref<MP> const_reference;
+  static AK_TOOLKIT_CONSTEXPR bool uses_bit() AK_TOOLKIT_NOEXCEPT { return false; }
+};
+
+// Slots are laid out by decreasing alignment, in declaration order for equal
+// alignments: as sizes are multiples of alignments, there is no padding.
+// The offset of slot I (of alignment A) is the size of the slots that precede it.
+
+template <std::size_t A, std::size_t I, std::size_t J, typename... Fs>
+struct record_offset : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t A, std::size_t I, std::size_t J, typename F, typename... Fs>
+struct record_offset<A, I, J, F, Fs...> : std::integral_constant<std::size_t,
+  (std::alignment_of<typename record_field<F>::slot_type>::value > A ||
+   (std::alignment_of<typename record_field<F>::slot_type>::value == A && J < I)
+     ? sizeof(typename record_field<F>::slot_type) : 0)
+  + record_offset<A, I, J + 1, Fs...>::value>
+{};
+
+template <std::size_t I, typename... Fs>
+struct record_bit_index : std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t I, typename F, typename... Fs>
+struct record_bit_index<I, F, Fs...> : std::integral_constant<std::size_t,
+  (I != 0 && record_field<F>::uses_bit() ? 1 : 0) + (I == 0 ? 0 : record_bit_index<I - 1, Fs...>::value)>
+{};
+
+template <typename... Fs>
+struct record_layout;
+
+template <>
+struct record_layout<>
+{
+  static AK_TOOLKIT_CONSTEXPR std::size_t slots_size() AK_TOOLKIT_NOEXCEPT { return 0; }
+  static AK_TOOLKIT_CONSTEXPR std::size_t bit_count() AK_TOOLKIT_NOEXCEPT { return 0; }
+  static AK_TOOLKIT_CONSTEXPR std::size_t alignment() AK_TOOLKIT_NOEXCEPT { return 1; }
+};
+
+template <typename F, typename... Fs>
+struct record_layout<F, Fs...>
+{
+  typedef typename record_field<F>::slot_type slot_type;
+
+  static AK_TOOLKIT_CONSTEXPR std::size_t slots_size() AK_TOOLKIT_NOEXCEPT { return sizeof(slot_type) + record_layout<Fs...>::slots_size(); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t bit_count() AK_TOOLKIT_NOEXCEPT { return (record_field<F>::uses_bit() ? 1 : 0) + record_layout<Fs...>::bit_count(); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t alignment() AK_TOOLKIT_NOEXCEPT
+  {
+    return std::alignment_of<slot_type>::value > record_layout<Fs...>::alignment() ? std::alignment_of<slot_type>::value : record_layout<Fs...>::alignment();
+  }
+};
+
+} // namespace detail_
+
+
+// A record of optional fields, stored without padding between them. Each of
+// Fields is either a mark policy, whose representation is stored, or a
+// trivially copyable type, whose presence is stored in a bitset shared by all
+// such fields and placed after the last field.
+
+template <typename... Fields>
+class markable_record
+{
+  typedef detail_::record_layout<Fields...> layout;
+
+public:
+  template <std::size_t I>
+  using field_type = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+  template <std::size_t I>
+  using slot_type = typename detail_::record_field<field_type<I>>::slot_type;
+
+  template <std::size_t I>
+  using reference = typename detail_::record_field<field_type<I>>::reference;
+
+  template <std::size_t I>
+  using const_reference = typename detail_::record_field<field_type<I>>::const_reference;
+
+  static AK_TOOLKIT_CONSTEXPR std::size_t field_count() AK_TOOLKIT_NOEXCEPT { return sizeof...(Fields); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t presence_bit_count() AK_TOOLKIT_NOEXCEPT { return layout::bit_count(); }
+
+  template <std::size_t I>
+  static AK_TOOLKIT_CONSTEXPR std::size_t offset_of() AK_TOOLKIT_NOEXCEPT
+  {
+    return detail_::record_offset<std::alignment_of<slot_type<I>>::value, I, 0, Fields...>::value;
+  }
+
+private:
+  static AK_TOOLKIT_CONSTEXPR std::size_t bitset_offset() AK_TOOLKIT_NOEXCEPT { return layout::slots_size(); }
+  static AK_TOOLKIT_CONSTEXPR std::size_t byte_count() AK_TOOLKIT_NOEXCEPT { return layout::slots_size() + (layout::bit_count() + 7) / 8; }
+
+  alignas(layout::alignment()) unsigned char _bytes[byte_count() == 0 ? 1 : byte_count()];
+
+  template <std::size_t I>
+  static AK_TOOLKIT_CONSTEXPR std::size_t bit_index() AK_TOOLKIT_NOEXCEPT { return detail_::record_bit_index<I, Fields...>::value; }
+
+  template <std::size_t I>
+  static AK_TOOLKIT_CONSTEXPR unsigned char bit_mask() AK_TOOLKIT_NOEXCEPT { return static_cast<unsigned char>(1u << (bit_index<I>() % 8)); }
+
+  template <std::size_t I>
+  slot_type<I>* slot() AK_TOOLKIT_NOEXCEPT { return reinterpret_cast<slot_type<I>*>(_bytes + offset_of<I>()); }
+
+  template <std::size_t I>
+  const slot_type<I>* slot() const AK_TOOLKIT_NOEXCEPT { return reinterpret_cast<const slot_type<I>*>(_bytes + offset_of<I>()); }
+
+  template <std::size_t I>
+  reference<I> make_reference(std::true_type) AK_TOOLKIT_NOEXCEPT
+  { return reference<I>(slot<I>(), _bytes + bitset_offset() + bit_index<I>() / 8, bit_mask<I>()); }
+
+  template <std::size_t I>
+  reference<I> make_reference(std::false_type) AK_TOOLKIT_NOEXCEPT
+  { return reference<I>(slot<I>()); }
+
+  template <std::size_t I>
+  const_reference<I> make_reference(std::true_type) const AK_TOOLKIT_NOEXCEPT
+  { return const_reference<I>(slot<I>(), _bytes + bitset_offset() + bit_index<I>() / 8, bit_mask<I>()); }
+
+  template <std::size_t I>
+  const_reference<I> make_reference(std::false_type) const AK_TOOLKIT_NOEXCEPT
+  { return const_reference<I>(slot<I>()); }
+
+  template <std::size_t I>
+  void init_slot(std::true_type) AK_TOOLKIT_NOEXCEPT { ::new (static_cast<void*>(slot<I>())) slot_type<I>(); }
+
+  template <std::size_t I>
+  void init_slot(std::false_type) AK_TOOLKIT_NOEXCEPT { ::new (static_cast<void*>(slot<I>())) slot_type<I>(field_type<I>::marked_value()); }
+
+  void init_slots(std::integral_constant<std::size_t, sizeof...(Fields)>) AK_TOOLKIT_NOEXCEPT {}
+
+  template <std::size_t I>
+  void init_slots(std::integral_constant<std::size_t, I>) AK_TOOLKIT_NOEXCEPT
+  {
+    init_slot<I>(std::integral_constant<bool, detail_::record_field<field_type<I>>::uses_bit()>{});
+    init_slots(std::integral_constant<std::size_t, I + 1>{});
+  }
+
+public:
+  // all fields without value
+  markable_record() AK_TOOLKIT_NOEXCEPT
+  {
+    std::memset(_bytes, 0, sizeof(_bytes));
+    init_slots(std::integral_constant<std::size_t, 0>{});
+  }
+
+  template <std::size_t I>
+  reference<I> get() AK_TOOLKIT_NOEXCEPT
+  { return make_reference<I>(std::integral_constant<bool, detail_::record_field<field_type<I>>::uses_bit()>{}); }
+
+  template <std::size_t I>
+  const_reference<I> get() const AK_TOOLKIT_NOEXCEPT
+  { return make_reference<I>(std::integral_constant<bool, detail_::record_field<field_type<I>>::uses_bit()>{}); }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_record;
+using markable_ns::markable_bit_ref;
+using markable_ns::markable_bit_cref;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_RECORD_HEADER_GUARD_
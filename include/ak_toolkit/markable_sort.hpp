@@ -0,0 +1,262 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_SORT_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_SORT_HEADER_GUARD_
+
+#include "markable_mask.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Where elements without value go. null_order::first gives the order of order_by_value.
+enum class null_order { first, last };
+
+namespace detail_ {
+
+// Maps representations to unsigned keys, such that the order of keys is the
+// order of values, and elements without value get the smallest or the
+// largest key.
+
+template <typename Rep, bool = std::is_floating_point<Rep>::value>
+struct ordered_bits
+{
+  typedef typename std::make_unsigned<Rep>::type U;
+  static U get(Rep r) AK_TOOLKIT_NOEXCEPT
+  {
+    return std::is_signed<Rep>::value ? U(U(r) ^ (U(1) << (sizeof(U) * 8 - 1))) : U(r);
+  }
+};
+
+template <typename Rep>
+struct ordered_bits<Rep, true>
+{
+  typedef typename uint_of_size<sizeof(Rep)>::type U;
+  static U get(Rep r) AK_TOOLKIT_NOEXCEPT
+  {
+    const U sign = U(1) << (sizeof(U) * 8 - 1);
+    U b = as_uint(r);
+    if (U(b << 1) == 0) // -0 is equal to +0
+      b = 0;
+    return (b & sign) ? U(~b) : U(b | sign);
+  }
+};
+
+template <typename MP, typename Tag = typename kernel_tag<MP>::type>
+struct radix_key;
+
+template <typename MP>
+struct radix_key<MP, sentinel_kernel_tag>
+{
+  typedef typename MP::representation_type Rep;
+  typedef typename ordered_bits<Rep>::U U;
+
+  U _marked;
+  U _null_key;
+  U _step; // +1 or -1
+
+  explicit radix_key(null_order o) AK_TOOLKIT_NOEXCEPT
+    : _marked(ordered_bits<Rep>::get(MP::marked_value()))
+    , _null_key(o == null_order::last ? std::numeric_limits<U>::max() : U(0))
+    , _step(o == null_order::last ? U(-1) : U(1)) {}
+
+  // The key of the marked value is free: values between it and the null key
+  // move by one towards it. Computed without branches.
+  U operator()(Rep r) const AK_TOOLKIT_NOEXCEPT
+  {
+    const U k = ordered_bits<Rep>::get(r);
+    const bool between = _step == 1 ? k < _marked : k > _marked;
+    const U moved = U(k + (between ? _step : U(0)));
+    return k == _marked ? _null_key : moved;
+  }
+};
+
+// no non-NaN value has key 0 or the maximum key
+template <typename MP>
+struct radix_key<MP, nan_kernel_tag>
+{
+  typedef typename MP::representation_type Rep;
+  typedef typename ordered_bits<Rep>::U U;
+
+  U _null_key;
+
+  explicit radix_key(null_order o) AK_TOOLKIT_NOEXCEPT : _null_key(o == null_order::last ? std::numeric_limits<U>::max() : U(0)) {}
+
+  U operator()(Rep r) const AK_TOOLKIT_NOEXCEPT
+  {
+    return is_nan_bits(r) ? _null_key : ordered_bits<Rep>::get(r);
+  }
+};
+
+template <typename U>
+unsigned radix_digit(U k, unsigned shift) AK_TOOLKIT_NOEXCEPT { return unsigned(k >> shift) & 0xFF; }
+
+// LSD radix sort: a pass per byte, skipping bytes that are equal in all keys
+template <typename Rep, typename Key>
+void lsd_radix_sort(Rep* first, std::size_t n, const Key& key)
+{
+  typedef typename Key::U U;
+  const unsigned passes = sizeof(U);
+  std::vector<std::size_t> counts (passes * 256, 0);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    const U k = key(first[i]);
+    for (unsigned p = 0; p != passes; ++p)
+      ++counts[p * 256 + radix_digit(k, 8 * p)];
+  }
+
+  std::vector<Rep> buffer (n);
+  Rep* src = first;
+  Rep* dst = buffer.data();
+  for (unsigned p = 0; p != passes; ++p)
+  {
+    std::size_t* c = &counts[p * 256];
+    if (c[radix_digit(key(first[0]), 8 * p)] == n)
+      continue;
+
+    std::size_t offset = 0;
+    for (unsigned d = 0; d != 256; ++d)
+    {
+      const std::size_t count = c[d];
+      c[d] = offset;
+      offset += count;
+    }
+    for (std::size_t i = 0; i != n; ++i)
+      dst[c[radix_digit(key(src[i]), 8 * p)]++] = src[i];
+    std::swap(src, dst);
+  }
+
+  if (src != first)
+    std::memcpy(static_cast<void*>(first), src, n * sizeof(Rep));
+}
+
+template <typename Rep, typename Key>
+void insertion_sort_by_key(Rep* first, std::size_t n, const Key& key)
+{
+  for (std::size_t i = 1; i < n; ++i)
+  {
+    const Rep r = first[i];
+    const typename Key::U k = key(r);
+    std::size_t j = i;
+    for (; j != 0 && k < key(first[j - 1]); --j)
+      first[j] = first[j - 1];
+    first[j] = r;
+  }
+}
+
+// In-place MSD radix sort (American flag sort): elements are cycled into
+// their buckets, then each bucket is sorted by the next byte.
+template <typename Rep, typename Key>
+void msd_radix_sort(Rep* first, std::size_t n, const Key& key, unsigned shift)
+{
+  const std::size_t small = 64;
+  if (n < small)
+    return insertion_sort_by_key(first, n, key);
+
+  std::size_t counts[256] = {};
+  for (std::size_t i = 0; i != n; ++i)
+    ++counts[radix_digit(key(first[i]), shift)];
+
+  std::size_t heads[256], tails[256];
+  std::size_t offset = 0;
+  for (unsigned d = 0; d != 256; ++d)
+  {
+    heads[d] = offset;
+    offset += counts[d];
+    tails[d] = offset;
+  }
+
+  if (counts[radix_digit(key(first[0]), shift)] != n)
+  {
+    for (unsigned b = 0; b != 256; ++b)
+      while (heads[b] < tails[b])
+      {
+        Rep r = first[heads[b]];
+        unsigned d = radix_digit(key(r), shift);
+        while (d != b)
+        {
+          std::swap(r, first[heads[d]++]);
+          d = radix_digit(key(r), shift);
+        }
+        first[heads[b]++] = r;
+      }
+  }
+
+  if (shift == 0)
+    return;
+  for (unsigned d = 0; d != 256; ++d)
+    if (counts[d] > 1)
+      msd_radix_sort(first + tails[d] - counts[d], counts[d], key, shift - 8);
+}
+
+template <typename MP>
+struct is_radix_sortable : std::integral_constant<bool, is_single_sentinel_policy<MP>::value || is_nan_policy<MP>::value> {};
+
+} // namespace detail_
+
+
+// Sorts representations in the order of values, with the elements without
+// value first or last. For mark_int, mark_enum, mark_bool and mark_fp_nan.
+// stable_radix_sort preserves the relative order of equal elements and
+// allocates a copy of the range; radix_sort sorts in place.
+
+template <typename MP>
+void stable_radix_sort(typename MP::representation_type* first, std::size_t n, null_order nulls = null_order::first)
+{
+  static_assert(detail_::is_radix_sortable<MP>::value, "stable_radix_sort requires mark_int, mark_enum, mark_bool or mark_fp_nan");
+  if (n > 1)
+    detail_::lsd_radix_sort(first, n, detail_::radix_key<MP>(nulls));
+}
+
+template <typename MP>
+void radix_sort(typename MP::representation_type* first, std::size_t n, null_order nulls = null_order::first)
+{
+  static_assert(detail_::is_radix_sortable<MP>::value, "radix_sort requires mark_int, mark_enum, mark_bool or mark_fp_nan");
+  typedef typename detail_::radix_key<MP>::U U;
+  if (n > 1)
+    detail_::msd_radix_sort(first, n, detail_::radix_key<MP>(nulls), unsigned(8 * (sizeof(U) - 1)));
+}
+
+template <typename MP, typename OP>
+void stable_radix_sort(markable_span<MP, OP> s, null_order nulls = null_order::first)
+{
+  stable_radix_sort<MP>(s.data(), s.size(), nulls);
+}
+
+template <typename MP, typename OP>
+void radix_sort(markable_span<MP, OP> s, null_order nulls = null_order::first)
+{
+  radix_sort<MP>(s.data(), s.size(), nulls);
+}
+
+template <typename MP, typename OP>
+void stable_radix_sort(markable_vector<MP, OP>& v, null_order nulls = null_order::first)
+{
+  stable_radix_sort<MP>(v.data(), v.size(), nulls);
+}
+
+template <typename MP, typename OP>
+void radix_sort(markable_vector<MP, OP>& v, null_order nulls = null_order::first)
+{
+  radix_sort<MP>(v.data(), v.size(), nulls);
+}
+
+} // namespace markable_ns
+
+using markable_ns::null_order;
+using markable_ns::radix_sort;
+using markable_ns::stable_radix_sort;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_SORT_HEADER_GUARD_
@@ -0,0 +1,259 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_SPAN_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_SPAN_HEADER_GUARD_
+
+#include "markable.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// Contiguous arrays of MP::representation_type objects, observed through
+// proxies that offer the interface of markable<MP, OP>. This only works for
+// policies where the storage is the representation (mark_int, mark_fp_nan,
+// mark_enum, mark_bool).
+
+template <typename MP, typename OP = order_none>
+class markable_cref
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_cref requires storage_type to be the same as representation_type");
+public:
+  typedef typename MP::value_type value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef typename MP::reference_type reference_type;
+  typedef markable<MP, OP> optional_type;
+
+private:
+  const representation_type* _ptr;
+
+public:
+  AK_TOOLKIT_CONSTEXPR explicit markable_cref(const representation_type* p) AK_TOOLKIT_NOEXCEPT : _ptr(p) {}
+
+  AK_TOOLKIT_CONSTEXPR bool has_value() const { return !MP::is_marked_value(*_ptr); }
+  AK_TOOLKIT_CONSTEXPR reference_type value() const { return AK_TOOLKIT_ASSERT(has_value()), MP::access_value(*_ptr); }
+  AK_TOOLKIT_CONSTEXPR representation_type const& representation_value() const AK_TOOLKIT_NOEXCEPT { return *_ptr; }
+
+  operator optional_type () const { return optional_type(with_representation, *_ptr); }
+};
+
+template <typename MP, typename OP = order_none>
+class markable_ref
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_ref requires storage_type to be the same as representation_type");
+public:
+  typedef typename MP::value_type value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef typename MP::reference_type reference_type;
+  typedef markable<MP, OP> optional_type;
+
+private:
+  representation_type* _ptr;
+
+public:
+  AK_TOOLKIT_CONSTEXPR explicit markable_ref(representation_type* p) AK_TOOLKIT_NOEXCEPT : _ptr(p) {}
+  markable_ref(const markable_ref&) = default;
+
+  // assignment writes through the reference, as in std::vector<bool>::reference
+  const markable_ref& operator=(const markable_ref& r) const { *_ptr = *r._ptr; return *this; }
+  const markable_ref& operator=(const optional_type& m) const { *_ptr = m.representation_value(); return *this; }
+
+  AK_TOOLKIT_CONSTEXPR bool has_value() const { return !MP::is_marked_value(*_ptr); }
+  AK_TOOLKIT_CONSTEXPR reference_type value() const { return AK_TOOLKIT_ASSERT(has_value()), MP::access_value(*_ptr); }
+  AK_TOOLKIT_CONSTEXPR representation_type const& representation_value() const AK_TOOLKIT_NOEXCEPT { return *_ptr; }
+
+  void assign(const value_type& v) const { *_ptr = MP::store_value(v); }
+  void assign_representation(const representation_type& r) const { *_ptr = r; }
+  void assign_marked() const { *_ptr = MP::marked_value(); }
+
+  operator optional_type () const { return optional_type(with_representation, *_ptr); }
+  operator markable_cref<MP, OP> () const AK_TOOLKIT_NOEXCEPT { return markable_cref<MP, OP>(_ptr); }
+
+  friend void swap(markable_ref l, markable_ref r) {
+    using std::swap; swap(*l._ptr, *r._ptr);
+  }
+};
+
+namespace detail_ {
+
+template <typename Ref, typename Rep>
+class markable_proxy_iterator
+{
+  Rep* _ptr;
+
+public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename Ref::optional_type value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef Ref reference;
+  typedef void pointer;
+
+  AK_TOOLKIT_CONSTEXPR markable_proxy_iterator() AK_TOOLKIT_NOEXCEPT : _ptr() {}
+  AK_TOOLKIT_CONSTEXPR explicit markable_proxy_iterator(Rep* p) AK_TOOLKIT_NOEXCEPT : _ptr(p) {}
+
+  Rep* base() const AK_TOOLKIT_NOEXCEPT { return _ptr; }
+
+  reference operator*() const { return reference(_ptr); }
+  reference operator[](difference_type n) const { return reference(_ptr + n); }
+
+  markable_proxy_iterator& operator++() { ++_ptr; return *this; }
+  markable_proxy_iterator& operator--() { --_ptr; return *this; }
+  markable_proxy_iterator operator++(int) { markable_proxy_iterator r(*this); ++_ptr; return r; }
+  markable_proxy_iterator operator--(int) { markable_proxy_iterator r(*this); --_ptr; return r; }
+  markable_proxy_iterator& operator+=(difference_type n) { _ptr += n; return *this; }
+  markable_proxy_iterator& operator-=(difference_type n) { _ptr -= n; return *this; }
+
+  friend markable_proxy_iterator operator+(markable_proxy_iterator i, difference_type n) { return i += n; }
+  friend markable_proxy_iterator operator+(difference_type n, markable_proxy_iterator i) { return i += n; }
+  friend markable_proxy_iterator operator-(markable_proxy_iterator i, difference_type n) { return i -= n; }
+  friend difference_type operator-(markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr - r._ptr; }
+
+  friend bool operator==(markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr == r._ptr; }
+  friend bool operator!=(markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr != r._ptr; }
+  friend bool operator< (markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr <  r._ptr; }
+  friend bool operator> (markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr >  r._ptr; }
+  friend bool operator<=(markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr <= r._ptr; }
+  friend bool operator>=(markable_proxy_iterator l, markable_proxy_iterator r) { return l._ptr >= r._ptr; }
+};
+
+template <typename MP, typename Rep>
+std::size_t count_values(const Rep* b, const Rep* e)
+{
+  // no early exits and no branches: this loop is expected to be vectorized
+  std::size_t ans = 0;
+  for (; b != e; ++b)
+    ans += !MP::is_marked_value(*b);
+  return ans;
+}
+
+} // namespace detail_
+
+namespace detail_ {
+
+template <typename MP, typename OP, typename Rep, typename Ref>
+class markable_span_base
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_span requires storage_type to be the same as representation_type");
+public:
+  typedef markable<MP, OP> value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef Ref reference;
+  typedef markable_cref<MP, OP> const_reference;
+  typedef markable_proxy_iterator<Ref, Rep> iterator;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+protected:
+  Rep* _data;
+  size_type _size;
+
+  static bool is_aligned(const void* p) AK_TOOLKIT_NOEXCEPT
+  {
+    return reinterpret_cast<std::uintptr_t>(p) % alignof(representation_type) == 0;
+  }
+
+  static Rep* checked_cast(typename std::conditional<std::is_const<Rep>::value, const void*, void*>::type p, size_type bytes)
+  {
+    if (!is_aligned(p))
+      throw std::invalid_argument("markable_span: buffer is not aligned for representation_type");
+    if (bytes % sizeof(representation_type) != 0)
+      throw std::invalid_argument("markable_span: buffer size is not a multiple of sizeof(representation_type)");
+    return static_cast<Rep*>(p);
+  }
+
+  AK_TOOLKIT_CONSTEXPR markable_span_base() AK_TOOLKIT_NOEXCEPT : _data(nullptr), _size(0) {}
+  markable_span_base(Rep* p, size_type n) AK_TOOLKIT_NOEXCEPT : _data(p), _size(n) { AK_TOOLKIT_ASSERT(is_aligned(p)); }
+
+public:
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  size_type size_bytes() const AK_TOOLKIT_NOEXCEPT { return _size * sizeof(representation_type); }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+  Rep* data() const AK_TOOLKIT_NOEXCEPT { return _data; }
+
+  reference operator[](size_type i) const { return AK_TOOLKIT_ASSERT(i < _size), reference(_data + i); }
+  reference front() const { return (*this)[0]; }
+  reference back() const { return (*this)[_size - 1]; }
+
+  bool has_value(size_type i) const { return AK_TOOLKIT_ASSERT(i < _size), !MP::is_marked_value(_data[i]); }
+  typename MP::reference_type value(size_type i) const { return AK_TOOLKIT_ASSERT(has_value(i)), MP::access_value(_data[i]); }
+  const representation_type& representation_value(size_type i) const { return AK_TOOLKIT_ASSERT(i < _size), _data[i]; }
+
+  iterator begin() const AK_TOOLKIT_NOEXCEPT { return iterator(_data); }
+  iterator end() const AK_TOOLKIT_NOEXCEPT { return iterator(_data + _size); }
+
+  size_type count_values() const { return detail_::count_values<MP>(_data, _data + _size); }
+};
+
+} // namespace detail_
+
+// Non-owning views of an array of representations, e.g. a memory-mapped file.
+
+template <typename MP, typename OP = order_none>
+class const_markable_span
+  : public detail_::markable_span_base<MP, OP, const typename MP::representation_type, markable_cref<MP, OP>>
+{
+  typedef detail_::markable_span_base<MP, OP, const typename MP::representation_type, markable_cref<MP, OP>> base;
+public:
+  typedef typename base::representation_type representation_type;
+  typedef typename base::size_type size_type;
+
+  AK_TOOLKIT_CONSTEXPR const_markable_span() AK_TOOLKIT_NOEXCEPT {}
+  const_markable_span(const representation_type* p, size_type n) AK_TOOLKIT_NOEXCEPT : base(p, n) {}
+
+  // throws std::invalid_argument if p is misaligned or bytes is not a multiple of sizeof(representation_type)
+  static const_markable_span from_bytes(const void* p, size_type bytes)
+  {
+    return const_markable_span(base::checked_cast(p, bytes), bytes / sizeof(representation_type));
+  }
+
+  const_markable_span subspan(size_type offset, size_type count) const
+  {
+    return AK_TOOLKIT_ASSERT(offset <= this->_size && count <= this->_size - offset),
+           const_markable_span(this->_data + offset, count);
+  }
+};
+
+template <typename MP, typename OP = order_none>
+class markable_span
+  : public detail_::markable_span_base<MP, OP, typename MP::representation_type, markable_ref<MP, OP>>
+{
+  typedef detail_::markable_span_base<MP, OP, typename MP::representation_type, markable_ref<MP, OP>> base;
+public:
+  typedef typename base::representation_type representation_type;
+  typedef typename base::size_type size_type;
+
+  AK_TOOLKIT_CONSTEXPR markable_span() AK_TOOLKIT_NOEXCEPT {}
+  markable_span(representation_type* p, size_type n) AK_TOOLKIT_NOEXCEPT : base(p, n) {}
+
+  // throws std::invalid_argument if p is misaligned or bytes is not a multiple of sizeof(representation_type)
+  static markable_span from_bytes(void* p, size_type bytes)
+  {
+    return markable_span(base::checked_cast(p, bytes), bytes / sizeof(representation_type));
+  }
+
+  markable_span subspan(size_type offset, size_type count) const
+  {
+    return AK_TOOLKIT_ASSERT(offset <= this->_size && count <= this->_size - offset),
+           markable_span(this->_data + offset, count);
+  }
+
+  operator const_markable_span<MP, OP> () const AK_TOOLKIT_NOEXCEPT { return const_markable_span<MP, OP>(this->_data, this->_size); }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_span;
+using markable_ns::const_markable_span;
+using markable_ns::markable_ref;
+using markable_ns::markable_cref;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_SPAN_HEADER_GUARD_
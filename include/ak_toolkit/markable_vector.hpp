@@ -0,0 +1,88 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_MARKABLE_VECTOR_HEADER_GUARD_
+#define AK_TOOLBOX_MARKABLE_VECTOR_HEADER_GUARD_
+
+#include "markable_span.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// A markable_vector<MP, OP> stores only MP::representation_type objects,
+// contiguously. The elements are observed through proxies that offer the
+// interface of markable<MP, OP>.
+
+template <typename MP, typename OP = order_none>
+class markable_vector
+{
+  static_assert (is_columnar_mark_policy<MP>::value, "markable_vector requires storage_type to be the same as representation_type");
+public:
+  typedef markable<MP, OP> value_type;
+  typedef typename MP::representation_type representation_type;
+  typedef markable_ref<MP, OP> reference;
+  typedef markable_cref<MP, OP> const_reference;
+  typedef detail_::markable_proxy_iterator<reference, representation_type> iterator;
+  typedef detail_::markable_proxy_iterator<const_reference, const representation_type> const_iterator;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+private:
+  std::vector<representation_type> _reps;
+
+public:
+  markable_vector() {}
+  explicit markable_vector(size_type n) : _reps(n, MP::marked_value()) {}
+  markable_vector(size_type n, const value_type& m) : _reps(n, m.representation_value()) {}
+
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _reps.size(); }
+  size_type capacity() const AK_TOOLKIT_NOEXCEPT { return _reps.capacity(); }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _reps.empty(); }
+  void reserve(size_type n) { _reps.reserve(n); }
+  void clear() AK_TOOLKIT_NOEXCEPT { _reps.clear(); }
+  void resize(size_type n) { _reps.resize(n, MP::marked_value()); }
+  void resize(size_type n, const value_type& m) { _reps.resize(n, m.representation_value()); }
+
+  void push_back(const value_type& m) { _reps.push_back(m.representation_value()); }
+  void push_back_marked() { _reps.push_back(MP::marked_value()); }
+  void push_back_representation(const representation_type& r) { _reps.push_back(r); }
+  void pop_back() { AK_TOOLKIT_ASSERT(!empty()); _reps.pop_back(); }
+
+  // the contiguous array of representations
+  representation_type* data() AK_TOOLKIT_NOEXCEPT { return _reps.data(); }
+  const representation_type* data() const AK_TOOLKIT_NOEXCEPT { return _reps.data(); }
+
+  reference operator[](size_type i) { return AK_TOOLKIT_ASSERT(i < size()), reference(data() + i); }
+  const_reference operator[](size_type i) const { return AK_TOOLKIT_ASSERT(i < size()), const_reference(data() + i); }
+  reference front() { return (*this)[0]; }
+  const_reference front() const { return (*this)[0]; }
+  reference back() { return (*this)[size() - 1]; }
+  const_reference back() const { return (*this)[size() - 1]; }
+
+  iterator begin() AK_TOOLKIT_NOEXCEPT { return iterator(data()); }
+  iterator end() AK_TOOLKIT_NOEXCEPT { return iterator(data() + size()); }
+  const_iterator begin() const AK_TOOLKIT_NOEXCEPT { return const_iterator(data()); }
+  const_iterator end() const AK_TOOLKIT_NOEXCEPT { return const_iterator(data() + size()); }
+  const_iterator cbegin() const AK_TOOLKIT_NOEXCEPT { return begin(); }
+  const_iterator cend() const AK_TOOLKIT_NOEXCEPT { return end(); }
+
+  size_type count_values() const { return detail_::count_values<MP>(data(), data() + size()); }
+
+  operator markable_span<MP, OP> () AK_TOOLKIT_NOEXCEPT { return markable_span<MP, OP>(data(), size()); }
+  operator const_markable_span<MP, OP> () const AK_TOOLKIT_NOEXCEPT { return const_markable_span<MP, OP>(data(), size()); }
+
+  friend void swap(markable_vector& l, markable_vector& r) AK_TOOLKIT_NOEXCEPT { l._reps.swap(r._reps); }
+};
+
+} // namespace markable_ns
+
+using markable_ns::markable_vector;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_MARKABLE_VECTOR_HEADER_GUARD_
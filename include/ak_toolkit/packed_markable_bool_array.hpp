@@ -0,0 +1,199 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_PACKED_MARKABLE_BOOL_ARRAY_HEADER_GUARD_
+#define AK_TOOLBOX_PACKED_MARKABLE_BOOL_ARRAY_HEADER_GUARD_
+
+#include "markable.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// An array of optional bools, 2 bits per element, 32 elements per word.
+// Each 2-bit field holds the representation of mark_bool: 0 (false),
+// 1 (true) or 2 (no value). Unused fields in the last word hold 0.
+
+namespace detail_ {
+
+const std::uint64_t low_bits_of_pairs = 0x5555555555555555ull;
+
+// the fields are decomposed into bit masks: one bit per element, at even positions
+inline std::uint64_t trues_of(std::uint64_t w) { return w & low_bits_of_pairs; }
+inline std::uint64_t missing_of(std::uint64_t w) { return (w >> 1) & low_bits_of_pairs; }
+inline std::uint64_t falses_of(std::uint64_t w) { return ~w & ~(w >> 1) & low_bits_of_pairs; }
+inline std::uint64_t compose(std::uint64_t trues, std::uint64_t falses)
+{
+  return trues | ((~(trues | falses) & low_bits_of_pairs) << 1);
+}
+
+} // namespace detail_
+
+class packed_markable_bool_ref
+{
+  std::uint64_t* _word;
+  unsigned _shift;
+
+public:
+  typedef bool value_type;
+  typedef char representation_type;
+
+  packed_markable_bool_ref(std::uint64_t* w, unsigned shift) AK_TOOLKIT_NOEXCEPT : _word(w), _shift(shift) {}
+  packed_markable_bool_ref(const packed_markable_bool_ref&) = default;
+
+  // assignment writes through the reference
+  const packed_markable_bool_ref& operator=(const packed_markable_bool_ref& r) const
+    { assign_representation(r.representation_value()); return *this; }
+
+  template <typename OP>
+  const packed_markable_bool_ref& operator=(const markable<mark_bool, OP>& m) const
+    { assign_representation(m.representation_value()); return *this; }
+
+  char representation_value() const AK_TOOLKIT_NOEXCEPT { return char((*_word >> _shift) & 3); }
+  bool has_value() const AK_TOOLKIT_NOEXCEPT { return !mark_bool::is_marked_value(representation_value()); }
+  bool value() const { return AK_TOOLKIT_ASSERT(has_value()), mark_bool::access_value(representation_value()); }
+
+  void assign_representation(char r) const
+  {
+    AK_TOOLKIT_ASSERT(r >= 0 && r <= 2);
+    *_word = (*_word & ~(std::uint64_t(3) << _shift)) | (std::uint64_t(r) << _shift);
+  }
+  void assign(bool v) const { assign_representation(mark_bool::store_value(v)); }
+  void assign_marked() const { assign_representation(mark_bool::marked_value()); }
+
+  template <typename OP>
+  operator markable<mark_bool, OP> () const { return markable<mark_bool, OP>(with_representation, representation_value()); }
+};
+
+class packed_markable_bool_array
+{
+  std::vector<std::uint64_t> _words;
+  std::size_t _size;
+
+  static std::size_t words_for(std::size_t n) { return (n + 31) / 32; }
+
+  // all fields of the last word past size() set to 0
+  void clear_padding()
+  {
+    if (_size % 32 != 0)
+      _words.back() &= (std::uint64_t(1) << (2 * (_size % 32))) - 1;
+  }
+
+  static std::uint64_t all_missing_word() { return detail_::low_bits_of_pairs << 1; }
+
+public:
+  typedef markable<mark_bool> value_type;
+  typedef packed_markable_bool_ref reference;
+  typedef markable<mark_bool> const_reference;
+  typedef std::size_t size_type;
+
+  packed_markable_bool_array() : _words(), _size(0) {}
+  explicit packed_markable_bool_array(size_type n) : _words(words_for(n), all_missing_word()), _size(n) { clear_padding(); }
+
+  size_type size() const AK_TOOLKIT_NOEXCEPT { return _size; }
+  bool empty() const AK_TOOLKIT_NOEXCEPT { return _size == 0; }
+
+  // the packed representation: 32 elements per word
+  const std::uint64_t* data() const AK_TOOLKIT_NOEXCEPT { return _words.data(); }
+  size_type word_count() const AK_TOOLKIT_NOEXCEPT { return _words.size(); }
+
+  void resize(size_type n)
+  {
+    // new elements have no value
+    while (_size < n && _size % 32 != 0)
+      (*this)[_size++].assign_marked();
+    _words.resize(words_for(n), all_missing_word());
+    _size = n;
+    clear_padding();
+  }
+
+  void push_back(const value_type& m)
+  {
+    if (_size % 32 == 0)
+      _words.push_back(0);
+    ++_size;
+    (*this)[_size - 1] = m;
+  }
+
+  reference operator[](size_type i)
+  {
+    return AK_TOOLKIT_ASSERT(i < _size), reference(&_words[i / 32], unsigned(2 * (i % 32)));
+  }
+
+  const_reference operator[](size_type i) const
+  {
+    return AK_TOOLKIT_ASSERT(i < _size),
+           const_reference(with_representation, char((_words[i / 32] >> (2 * (i % 32))) & 3));
+  }
+
+  size_type count_true() const
+  {
+    size_type ans = 0;
+    for (std::uint64_t w : _words)
+      ans += detail_::popcount64(detail_::trues_of(w));
+    return ans;
+  }
+
+  size_type count_missing() const
+  {
+    size_type ans = 0;
+    for (std::uint64_t w : _words)
+      ans += detail_::popcount64(detail_::missing_of(w));
+    return ans;
+  }
+
+  size_type count_false() const { return _size - count_true() - count_missing(); }
+
+  // Kleene (SQL) three-valued logic, 32 elements at a time
+
+  packed_markable_bool_array& operator&=(const packed_markable_bool_array& r)
+  {
+    AK_TOOLKIT_ASSERT(size() == r.size());
+    for (size_type i = 0; i != _words.size(); ++i)
+    {
+      const std::uint64_t a = _words[i], b = r._words[i];
+      _words[i] = detail_::compose(detail_::trues_of(a) & detail_::trues_of(b),
+                                   detail_::falses_of(a) | detail_::falses_of(b));
+    }
+    clear_padding();
+    return *this;
+  }
+
+  packed_markable_bool_array& operator|=(const packed_markable_bool_array& r)
+  {
+    AK_TOOLKIT_ASSERT(size() == r.size());
+    for (size_type i = 0; i != _words.size(); ++i)
+    {
+      const std::uint64_t a = _words[i], b = r._words[i];
+      _words[i] = detail_::compose(detail_::trues_of(a) | detail_::trues_of(b),
+                                   detail_::falses_of(a) & detail_::falses_of(b));
+    }
+    clear_padding();
+    return *this;
+  }
+
+  void flip()
+  {
+    for (std::uint64_t& w : _words)
+      w = detail_::compose(detail_::falses_of(w), detail_::trues_of(w));
+    clear_padding();
+  }
+
+  friend packed_markable_bool_array operator&(packed_markable_bool_array l, const packed_markable_bool_array& r) { return l &= r; }
+  friend packed_markable_bool_array operator|(packed_markable_bool_array l, const packed_markable_bool_array& r) { return l |= r; }
+  friend packed_markable_bool_array operator~(packed_markable_bool_array a) { a.flip(); return a; }
+};
+
+} // namespace markable_ns
+
+using markable_ns::packed_markable_bool_array;
+using markable_ns::packed_markable_bool_ref;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_PACKED_MARKABLE_BOOL_ARRAY_HEADER_GUARD_
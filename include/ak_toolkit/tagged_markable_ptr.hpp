@@ -0,0 +1,78 @@
+// Copyright (C) 2015-2021 Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef AK_TOOLBOX_TAGGED_MARKABLE_PTR_HEADER_GUARD_
+#define AK_TOOLBOX_TAGGED_MARKABLE_PTR_HEADER_GUARD_
+
+#include "markable.hpp"
+#include <cstdint>
+
+namespace ak_toolkit {
+namespace markable_ns {
+
+// An optional pointer and an optional small tag packed in one word. The tag
+// occupies the Bits low bits, which are zero in every T*: the pointer has no
+// value when it is nullptr, the tag when all its bits are set. Thus tags are
+// in [0, 2^Bits - 2]. T can be incomplete where the type is named.
+
+template <typename T, unsigned Bits>
+class tagged_markable_ptr
+{
+  static_assert(Bits >= 1 && Bits < 8, "tagged_markable_ptr requires 1 <= Bits < 8");
+
+  static AK_TOOLKIT_CONSTEXPR std::uintptr_t tag_bits() AK_TOOLKIT_NOEXCEPT { return (std::uintptr_t(1) << Bits) - 1; }
+
+  std::uintptr_t _word;
+
+  static std::uintptr_t pointer_bits(T* p) AK_TOOLKIT_NOEXCEPT
+  {
+    static_assert(detail_::has_spare_low_bits<T, Bits>::value, "T is not aligned enough for tagged_markable_ptr");
+    return AK_TOOLKIT_ASSERTED_EXPRESSION((reinterpret_cast<std::uintptr_t>(p) & tag_bits()) == 0, reinterpret_cast<std::uintptr_t>(p));
+  }
+
+public:
+  typedef markable<mark_ptr<T*>> pointer_type;
+  typedef markable<mark_int<unsigned, unsigned((1u << Bits) - 1)>> tag_type;
+
+private:
+  static std::uintptr_t tag_bits_of(tag_type t) AK_TOOLKIT_NOEXCEPT
+  {
+    return AK_TOOLKIT_ASSERTED_EXPRESSION(t.representation_value() <= tag_bits(), std::uintptr_t(t.representation_value()));
+  }
+
+public:
+  static AK_TOOLKIT_CONSTEXPR unsigned max_tag() AK_TOOLKIT_NOEXCEPT { return unsigned(tag_bits()) - 1; }
+
+  AK_TOOLKIT_CONSTEXPR tagged_markable_ptr() AK_TOOLKIT_NOEXCEPT : _word(tag_bits()) {}
+
+  explicit tagged_markable_ptr(pointer_type p, tag_type t = tag_type()) AK_TOOLKIT_NOEXCEPT
+    : _word(pointer_bits(p.representation_value()) | tag_bits_of(t)) {}
+
+  T* get() const AK_TOOLKIT_NOEXCEPT { return reinterpret_cast<T*>(_word & ~tag_bits()); }
+  pointer_type pointer() const AK_TOOLKIT_NOEXCEPT { return pointer_type(get()); }
+  tag_type tag() const AK_TOOLKIT_NOEXCEPT { return tag_type(unsigned(_word & tag_bits())); }
+
+  bool has_pointer() const AK_TOOLKIT_NOEXCEPT { return (_word & ~tag_bits()) != 0; }
+  bool has_tag() const AK_TOOLKIT_NOEXCEPT { return (_word & tag_bits()) != tag_bits(); }
+
+  void set_pointer(pointer_type p) AK_TOOLKIT_NOEXCEPT { _word = pointer_bits(p.representation_value()) | (_word & tag_bits()); }
+  void set_tag(tag_type t) AK_TOOLKIT_NOEXCEPT { _word = (_word & ~tag_bits()) | tag_bits_of(t); }
+
+  // the packed word, e.g. for storing in a std::atomic<std::uintptr_t>
+  AK_TOOLKIT_CONSTEXPR std::uintptr_t word() const AK_TOOLKIT_NOEXCEPT { return _word; }
+  static tagged_markable_ptr from_word(std::uintptr_t w) AK_TOOLKIT_NOEXCEPT { tagged_markable_ptr ans; ans._word = w; return ans; }
+
+  friend AK_TOOLKIT_CONSTEXPR bool operator==(const tagged_markable_ptr& l, const tagged_markable_ptr& r) AK_TOOLKIT_NOEXCEPT { return l._word == r._word; }
+  friend AK_TOOLKIT_CONSTEXPR bool operator!=(const tagged_markable_ptr& l, const tagged_markable_ptr& r) AK_TOOLKIT_NOEXCEPT { return l._word != r._word; }
+};
+
+} // namespace markable_ns
+
+using markable_ns::tagged_markable_ptr;
+
+} // namespace ak_toolkit
+
+#endif //AK_TOOLBOX_TAGGED_MARKABLE_PTR_HEADER_GUARD_
@@ -0,0 +1,113 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/atomic_markable.hpp"
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::uint64_t, ~std::uint64_t(0)> mark_slot;
+typedef markable<mark_slot> opt_slot;
+
+void test_single_thread()
+{
+  atomic_markable<mark_slot> a;
+  assert (a.is_lock_free());
+  assert (!a.has_value());
+  assert (!a.load().has_value());
+
+  a.store(opt_slot(5));
+  assert (a.load().value() == 5);
+
+  opt_slot old = a.exchange(opt_slot(6));
+  assert (old.value() == 5);
+  assert (a.load(std::memory_order_acquire).value() == 6);
+
+  opt_slot expected;
+  assert (!a.compare_exchange_strong(expected, opt_slot(7)));
+  assert (expected.value() == 6); // updated on failure
+  assert (a.compare_exchange_strong(expected, opt_slot(7), std::memory_order_acq_rel, std::memory_order_acquire));
+  assert (a.load().value() == 7);
+
+  assert (!a.try_claim(8));
+  a.clear(std::memory_order_release);
+  assert (!a.has_value());
+  assert (a.try_claim(8));
+  assert (a.load().value() == 8);
+}
+
+void test_claim_multi_marked()
+{
+  // a slot that is either empty or a tombstone can be claimed
+  typedef mark_int_multi<int, -1, -2> mark_bucket;
+  atomic_markable<mark_bucket> a;
+  a.store(markable<mark_bucket>(with_representation, -2));
+  assert (!a.has_value());
+  assert (a.try_claim(3));
+  assert (!a.try_claim(4));
+  assert (a.load().value() == 3);
+
+  atomic_markable<mark_fp_nan<double>> d;
+  assert (d.try_claim(1.5));
+  assert (!d.try_claim(2.5));
+  assert (d.load().value() == 1.5);
+}
+
+void test_concurrent_claims()
+{
+  const int slots = 1000, threads = 4;
+  std::vector<atomic_markable<mark_slot>> table (slots);
+  std::vector<int> wins (threads);
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t != threads; ++t)
+    workers.emplace_back([&, t] {
+      for (int i = 0; i != slots; ++i)
+        if (table[i].try_claim(std::uint64_t(t), std::memory_order_acq_rel))
+          ++wins[t];
+    });
+  for (std::thread& w : workers)
+    w.join();
+
+  int total = 0;
+  for (int t = 0; t != threads; ++t)
+  {
+    total += wins[t];
+    int owned = 0;
+    for (int i = 0; i != slots; ++i)
+      owned += table[i].load().value() == std::uint64_t(t);
+    assert (owned == wins[t]);
+  }
+  assert (total == slots); // every slot claimed exactly once
+}
+
+#if defined __cpp_lib_atomic_wait
+void test_wait_for_value()
+{
+  atomic_markable<mark_slot> a;
+  std::thread producer ([&] {
+    a.store(opt_slot(42), std::memory_order_release);
+    a.notify_all();
+  });
+  assert (a.wait_for_value(std::memory_order_acquire).value() == 42);
+  producer.join();
+
+  a.wait(opt_slot(), std::memory_order_acquire); // does not block: the state is different
+}
+#endif
+
+int main()
+{
+  test_single_thread();
+  test_claim_multi_marked();
+  test_concurrent_claims();
+#if defined __cpp_lib_atomic_wait
+  test_wait_for_value();
+#endif
+}
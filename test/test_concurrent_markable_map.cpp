@@ -0,0 +1,267 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/concurrent_markable_map.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+// counts the bytes allocated and not yet freed
+std::atomic<std::ptrdiff_t> live_bytes (0);
+const std::size_t header_size = 16; // keeps allocations aligned
+
+void* operator new(std::size_t n)
+{
+  void* p = std::malloc(n + header_size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  *static_cast<std::size_t*>(p) = n;
+  live_bytes += std::ptrdiff_t(n);
+  return static_cast<char*>(p) + header_size;
+}
+
+void operator delete(void* p) noexcept
+{
+  if (p == nullptr)
+    return;
+  char* q = static_cast<char*>(p) - header_size;
+  live_bytes -= std::ptrdiff_t(*reinterpret_cast<std::size_t*>(q));
+  std::free(q);
+}
+
+using namespace ak_toolkit;
+
+// ~0, ~0 - 1 and ~0 - 2 are reserved: empty, erased and migrated buckets
+typedef mark_int_range<std::uint64_t, ~std::uint64_t(0) - 2, ~std::uint64_t(0)> mark_key;
+typedef concurrent_markable_map<mark_key, std::uint64_t> map_type;
+
+const int thread_count = 4;
+
+std::uint64_t value_for(std::uint64_t k) { return k * 2 + 1; }
+
+template <typename F>
+void run_threads(F f)
+{
+  std::vector<std::thread> threads;
+  for (int t = 0; t != thread_count; ++t)
+    threads.emplace_back(f, t);
+  for (std::thread& t : threads)
+    t.join();
+}
+
+void test_single_thread()
+{
+  map_type m;
+  assert (m.empty());
+  assert (!m.find(1).has_value());
+
+  assert (m.insert(1, 10));
+  assert (!m.insert(1, 11));
+  assert (m.find(1).value() == 10);
+  assert (m.contains(1));
+  assert (m.size() == 1);
+
+  for (std::uint64_t k = 2; k != 5000; ++k)
+    assert (m.insert(k, value_for(k)));
+  assert (m.size() == 4999);
+  assert (m.bucket_count() >= 4999 * 4 / 3);
+  for (std::uint64_t k = 2; k != 5000; ++k)
+    assert (m.find(k).value() == value_for(k));
+
+  assert (m.erase(1) == 1);
+  assert (m.erase(1) == 0);
+  assert (!m.contains(1));
+  assert (m.insert(1, 12));
+  assert (m.find(1).value() == 12);
+}
+
+// all threads insert the same keys: each key is inserted exactly once
+void test_contended_inserts()
+{
+  const std::uint64_t keys = 100000;
+  map_type m;
+  std::atomic<std::uint64_t> successes (0);
+
+  run_threads([&](int t) {
+    std::uint64_t mine = 0;
+    for (std::uint64_t i = 0; i != keys; ++i)
+    {
+      const std::uint64_t k = (i * 7919 + std::uint64_t(t) * 104729) % keys; // different orders
+      if (m.insert(k, value_for(k)))
+        ++mine;
+    }
+    successes += mine;
+  });
+
+  assert (successes == keys);
+  assert (m.size() == keys);
+  for (std::uint64_t k = 0; k != keys; ++k)
+    assert (m.find(k).value() == value_for(k));
+}
+
+// threads insert and erase their own keys while others read them
+void test_mixed_operations()
+{
+  const std::uint64_t per_thread = 30000;
+  map_type m (8); // forces many migrations
+
+  run_threads([&](int t) {
+    const std::uint64_t base = std::uint64_t(t) * per_thread;
+    for (std::uint64_t i = 0; i != per_thread; ++i)
+    {
+      const std::uint64_t k = base + i;
+      assert (m.insert(k, value_for(k)));
+      if (i % 3 == 0)
+        assert (m.erase(k) == 1);
+
+      // a key of another thread: either absent or with the right value
+      const std::uint64_t other = (k * 31 + 17) % (per_thread * thread_count);
+      markable<mark_int<std::uint64_t, ~std::uint64_t(0)>> v = m.find(other);
+      assert (!v.has_value() || v.value() == value_for(other));
+    }
+  });
+
+  std::uint64_t present = 0;
+  for (std::uint64_t k = 0; k != per_thread * thread_count; ++k)
+  {
+    markable<mark_int<std::uint64_t, ~std::uint64_t(0)>> v = m.find(k);
+    assert (v.has_value() == (k % per_thread % 3 != 0));
+    if (v.has_value())
+    {
+      assert (v.value() == value_for(k));
+      ++present;
+    }
+  }
+  assert (m.size() == present);
+}
+
+// Tombstones fill tables of the same capacity: migrated tables must be freed.
+void test_churn_memory_is_bounded()
+{
+  const std::ptrdiff_t before = live_bytes;
+  {
+    map_type m;
+    const std::ptrdiff_t empty_map = live_bytes - before;
+    for (std::uint64_t k = 0; k != 200000; ++k)
+    {
+      assert (m.insert(k, value_for(k)));
+      assert (m.erase(k) == 1);
+    }
+    assert (m.size() == 0);
+    assert (m.bucket_count() == 32);
+    assert (live_bytes - before <= 4 * empty_map);
+  }
+  assert (live_bytes == before);
+}
+
+// the same with concurrent threads, each with its own keys
+void test_concurrent_churn_memory_is_bounded()
+{
+  const std::uint64_t per_thread = 50000;
+  const std::ptrdiff_t before = live_bytes;
+  map_type m;
+  const std::ptrdiff_t empty_map = live_bytes - before;
+
+  run_threads([&](int t) {
+    const std::uint64_t base = std::uint64_t(t) * per_thread;
+    for (std::uint64_t i = 0; i != per_thread; ++i)
+    {
+      assert (m.insert(base + i, value_for(base + i)));
+      assert (m.find(base + i).value() == value_for(base + i));
+      assert (m.erase(base + i) == 1);
+    }
+  });
+
+  assert (m.size() == 0);
+  m.find(0); // frees the tables retired by the last operations
+  m.find(0);
+  assert (live_bytes - before <= 4 * empty_map);
+}
+
+// keys present before migrations start are found during them
+void test_find_during_migrations()
+{
+  const std::uint64_t old_keys = 1000, per_thread = 20000;
+  map_type m (8);
+  for (std::uint64_t k = 0; k != old_keys; ++k)
+    assert (m.insert(k, value_for(k)));
+
+  std::atomic<int> writers (thread_count - 1);
+  run_threads([&](int t) {
+    if (t == 0)
+    {
+      do
+        for (std::uint64_t k = 0; k != old_keys; ++k)
+          assert (m.find(k).value() == value_for(k));
+      while (writers != 0);
+      return;
+    }
+    const std::uint64_t base = old_keys + std::uint64_t(t) * per_thread;
+    for (std::uint64_t i = 0; i != per_thread; ++i)
+      assert (m.insert(base + i, value_for(base + i)));
+    --writers;
+  });
+}
+
+// Blocks the thread that migrates the table while it copies the stalled key.
+std::atomic<bool> migrator_stalled (false);
+std::atomic<bool> release_migrator (false);
+std::thread::id migrator_id;
+const std::uint64_t stalled_key = 5;
+
+struct stalling_hash
+{
+  template <typename M>
+  std::size_t operator()(const M& m) const
+  {
+    if (m.representation_value() == stalled_key && std::this_thread::get_id() == migrator_id)
+    {
+      migrator_stalled = true;
+      while (!release_migrator)
+        std::this_thread::yield();
+    }
+    return hash_by_representation()(m);
+  }
+};
+
+// find() does not wait for a migration that another thread has not finished
+void test_find_does_not_wait_for_migration()
+{
+  concurrent_markable_map<mark_key, std::uint64_t, mark_int<std::uint64_t, ~std::uint64_t(0)>, stalling_hash> m (8);
+  for (std::uint64_t k = 0; k != 12; ++k) // the table of 16 buckets is now 3/4 full
+    assert (m.insert(k, value_for(k)));
+
+  std::thread migrator ([&] {
+    migrator_id = std::this_thread::get_id();
+    assert (m.insert(12, value_for(12)));
+  });
+  while (!migrator_stalled)
+    std::this_thread::yield();
+
+  for (std::uint64_t k = 0; k != 12; ++k)
+    assert (m.find(k).value() == value_for(k));
+  assert (!m.find(100).has_value());
+
+  release_migrator = true;
+  migrator.join();
+  for (std::uint64_t k = 0; k != 13; ++k)
+    assert (m.find(k).value() == value_for(k));
+}
+
+int main()
+{
+  test_single_thread();
+  test_contended_inserts();
+  test_mixed_operations();
+  test_churn_memory_is_bounded();
+  test_concurrent_churn_memory_is_bounded();
+  test_find_during_migrations();
+  test_find_does_not_wait_for_migration();
+}
@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <unordered_set>
 #include <set>
+#include <cstring>
 
 
 
@@ -1159,11 +1160,385 @@ namespace nested_markable
     assert(1 == ooi.representation_value());
   }
 
+  // the same, with niches found automatically
+
+  void test_mark_nested_bool()
+  {
+    typedef markable<mark_nested<markable<mark_bool>>> oob_t;
+    static_assert(sizeof(oob_t) == sizeof(char), "excessive size");
+    // mark_nested is opt-in: default_markable keeps treating a value-initialized markable as no value
+    static_assert(std::is_same<default_markable<markable<mark_bool>>, markable<mark_value_init<markable<mark_bool>>, order_by_value>>::value, "default policy changed");
+    assert(!(default_markable<markable<mark_bool, order_by_representation>>{markable<mark_bool, order_by_representation>()}.has_value()));
+
+    oob_t oob {};
+    assert(!oob.has_value());
+    assert(char(3) == oob.representation_value());
+
+    oob.assign(markable<mark_bool>{});
+    assert(oob.has_value());
+    assert(!oob.value().has_value());
+    assert(char(2) == oob.representation_value());
+
+    oob.assign(markable<mark_bool>{false});
+    assert(oob.value().has_value());
+    assert(oob.value().value() == false);
+  }
+
+  void test_mark_nested_three_levels()
+  {
+    typedef markable<mark_int_range<int, -3, -1>> l1_t; // -3 is no value, -2 and -1 are niches
+    typedef markable<mark_nested<l1_t>> l2_t;
+    typedef markable<mark_nested<l2_t>> l3_t;
+    static_assert(sizeof(l3_t) == sizeof(int), "excessive size");
+    static_assert(niche_of<mark_int_range<int, -3, -1>>::count() == 2, "wrong niche count");
+    static_assert(niche_of<mark_nested<l1_t>>::count() == 1, "wrong niche count");
+    static_assert(niche_of<mark_nested<l2_t>>::count() == 0, "wrong niche count");
+
+    l3_t o3 {};
+    assert(!o3.has_value());
+
+    o3.assign(l2_t{});
+    assert(o3.has_value());
+    assert(!o3.value().has_value());
+
+    o3.assign(l2_t{l1_t{}});
+    assert(o3.value().has_value());
+    assert(!o3.value().value().has_value());
+
+    o3.assign(l2_t{l1_t{7}});
+    assert(o3.value().value().value() == 7);
+    assert(7 == o3.representation_value());
+
+    // any no-value state of the inner markable is stored as its marked_value()
+    l1_t other_marked {};
+    other_marked.assign_marked(2);
+    o3.assign(l2_t{other_marked});
+    assert(o3.value().has_value());
+    assert(!o3.value().value().has_value());
+    assert(-3 == o3.representation_value());
+  }
+
   void test()
   {
     test_opt_opt_bool();
     test_opt_opt_int();
+    test_mark_nested_bool();
+    test_mark_nested_three_levels();
+  }
+}
+
+void test_mark_int_multi()
+{
+  // empty, tombstone
+  typedef markable<mark_int_multi<int, -1, -2>> slot_t;
+  static_assert (sizeof(slot_t) == sizeof(int), "size waste");
+  static_assert (is_multi_mark_policy<mark_int_multi<int, -1, -2>>::value, "multi-marked policy not detected");
+  static_assert (!is_multi_mark_policy<mark_int<int, -1>>::value, "single-marked policy detected as multi");
+  static_assert (mark_int_multi<int, -1, -2>::marked_value_count() == 2, "wrong marked value count");
+  static_assert (mark_int_multi<int, -1, -2>::marked_value(1) == -2, "wrong marked value");
+
+  slot_t s_, s0(0), sT(-2);
+  assert (!s_.has_value());
+  assert ( s0.has_value());
+  assert (!sT.has_value());
+  assert (s_.marked_index() == 0);
+  assert (sT.marked_index() == 1);
+  assert (s_.representation_value() == -1);
+
+  s0.assign_marked(1);
+  assert (!s0.has_value());
+  assert (s0.marked_index() == 1);
+  assert (s0.representation_value() == -2);
+
+  s0.assign_marked(0);
+  assert (s0.marked_index() == 0);
+
+  s0.assign(7);
+  assert (s0.has_value());
+  assert (s0.value() == 7);
+}
+
+void test_mark_int_range()
+{
+  // not computed, computed with no result, ...
+  typedef markable<mark_int_range<unsigned, 0, 3>, order_by_representation> cache_t;
+  static_assert (mark_int_range<unsigned, 0, 3>::marked_value_count() == 4, "wrong marked value count");
+  static_assert (mark_int_range<unsigned, 0, 3>::marked_value(2) == 2, "wrong marked value");
+
+  // ranges wider than the positive values of T
+  typedef mark_int_range<std::int8_t, -128, 127> all_int8;
+  static_assert (all_int8::marked_value_count() == 256, "wrong marked value count");
+  static_assert (all_int8::marked_value(255) == 127, "wrong marked value");
+  static_assert (all_int8::marked_index(127) == 255, "wrong marked index");
+  typedef mark_int_range<std::int64_t, std::numeric_limits<std::int64_t>::min() + 1, std::numeric_limits<std::int64_t>::max()> wide;
+  static_assert (wide::marked_value_count() == std::numeric_limits<std::size_t>::max(), "wrong marked value count");
+  static_assert (wide::marked_value(std::numeric_limits<std::size_t>::max() - 1) == std::numeric_limits<std::int64_t>::max(), "wrong marked value");
+  static_assert (wide::marked_index(0) == (std::size_t(1) << 63) - 1, "wrong marked index");
+  static_assert (wide::marked_index(std::numeric_limits<std::int64_t>::max()) == std::numeric_limits<std::size_t>::max() - 1, "wrong marked index");
+
+  cache_t c_, c3(3), c4(4);
+  assert (!c_.has_value());
+  assert (!c3.has_value());
+  assert ( c4.has_value());
+  assert (c_.marked_index() == 0);
+  assert (c3.marked_index() == 3);
+  assert (c4.value() == 4);
+
+  c_.assign_marked(1);
+  assert (!c_.has_value());
+  assert (c_.marked_index() == 1);
+
+  // every marked value is a valid state for order_by_representation
+  assert (c_ != c3);
+  assert (c_ < c3);
+  assert (c3 < c4);
+}
+
+void test_mark_ptr()
+{
+  int i = 1, j = 2;
+  typedef markable<mark_ptr<int*>> opt_ptr;
+  opt_ptr p_, pi(&i);
+  assert (!p_.has_value());
+  assert (pi.has_value());
+  assert (pi.value() == &i);
+  assert (p_.representation_value() == nullptr);
+  static_assert (std::is_same<default_markable<int*>, markable<mark_ptr<int*>, order_by_value>>::value, "wrong default policy for pointers");
+
+  // nullptr is a value, when another address is marked
+  typedef markable<mark_ptr<int*, 1>> opt_ptr1;
+  opt_ptr1 q_, q0(nullptr), qj(&j);
+  assert (!q_.has_value());
+  assert (q0.has_value() && q0.value() == nullptr);
+  assert (qj.value() == &j);
+}
+
+void test_mark_aligned_ptr()
+{
+  alignas(4) int i = 1;
+  typedef markable<mark_aligned_ptr<int*, 2>> opt_ptr;
+  static_assert (is_multi_mark_policy<mark_aligned_ptr<int*, 2>>::value, "multi-marked policy not detected");
+  static_assert (mark_aligned_ptr<int*, 2>::marked_value_count() == 3, "wrong marked value count");
+  static_assert (sizeof(opt_ptr) == sizeof(int*), "not a single word");
+
+  opt_ptr p_, p0(nullptr), pi(&i);
+  assert (!p_.has_value());
+  assert (p0.has_value());
+  assert (p0.value() == nullptr);
+  assert (pi.value() == &i);
+  assert (*pi.value() == 1);
+
+  // the spare marked values encode more "no value" states
+  p_.assign_marked(2);
+  assert (!p_.has_value());
+  assert (p_.marked_index() == 2);
+  p_.assign(&i);
+  assert (p_.value() == &i);
+  assert (p_.value_or(nullptr) == &i);
+  assert (opt_ptr().value_or(&i) == &i);
+}
+
+template <typename M>
+struct is_memcpyable : std::integral_constant<bool,
+  std::is_trivially_copyable<M>::value && std::is_trivially_destructible<M>::value> {};
+
+void test_trivial_copyability()
+{
+  static_assert (is_memcpyable<markable<mark_int<int, -1>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_fp_nan<double>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_bool>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_enum<Dir, -1>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_value_init<int>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_int_multi<int, -1, -2>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_int_range<int, -9, -1>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_ptr<int*>>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_aligned_ptr<int*, 2>>>::value, "not trivially copyable");
+  static_assert (!is_memcpyable<markable<mark_stl_empty<std::string>>>::value, "std::string is not trivially copyable");
+
+  // dual storage of trivial types is trivial
+  static_assert (is_memcpyable<mark_TOD::storage_type>::value, "dual_storage not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_TOD>>::value, "not trivially copyable");
+  static_assert (is_memcpyable<markable<mark_TOD_cmp>>::value, "not trivially copyable");
+  static_assert (!is_memcpyable<markable<mark_range>>::value, "range has a user-provided copy constructor");
+
+  markable<mark_TOD> src[3] = { markable<mark_TOD>(TOD(10)), markable<mark_TOD>(), markable<mark_TOD>(TOD(20)) };
+  markable<mark_TOD> dst[3];
+  std::memcpy(static_cast<void*>(dst), src, sizeof(src));
+  assert (dst[0].has_value() && dst[0].value() == TOD(10));
+  assert (!dst[1].has_value());
+  assert (dst[2].has_value() && dst[2].value() == TOD(20));
+
+  dst[0] = src[1];
+  assert (!dst[0].has_value());
+  dst[1] = src[2];
+  assert (dst[1].value() == TOD(20));
+  swap(dst[1], dst[0]);
+  assert (dst[0].value() == TOD(20));
+  assert (!dst[1].has_value());
+}
+
+int seconds_copies = 0;
+
+class seconds // not trivially copyable, but nothrow movable
+{
+  int _count;
+
+public:
+  explicit seconds(int c) : _count(c) {}
+  seconds(const seconds& r) : _count(r._count) { ++seconds_copies; }
+  seconds(seconds&& r) noexcept : _count(r._count) {}
+  seconds& operator=(const seconds&) = default;
+  seconds& operator=(seconds&&) = default;
+  ~seconds() {}
+  int count() const { return _count; }
+};
+
+struct seconds_representation
+{
+  int count;
+};
+
+struct mark_seconds : markable_dual_storage_type<mark_seconds, seconds, seconds_representation>
+{
+  static representation_type marked_value() AK_TOOLKIT_NOEXCEPT { return {-1}; }
+  static bool is_marked_value(const representation_type& v) { return v.count < 0; }
+};
+
+namespace ak_toolkit { namespace markable_ns {
+  template <> struct is_trivially_relocatable<seconds> : std::true_type {};
+}}
+
+void test_dual_storage_noexcept()
+{
+  typedef markable<mark_seconds> opt_seconds;
+  static_assert (std::is_nothrow_move_constructible<opt_seconds>::value, "move should be noexcept");
+  static_assert (std::is_nothrow_move_assignable<opt_seconds>::value, "move should be noexcept");
+  static_assert (!std::is_nothrow_copy_constructible<opt_seconds>::value, "copy can throw");
+  static_assert (noexcept(swap(std::declval<opt_seconds&>(), std::declval<opt_seconds&>())), "swap should be noexcept");
+  static_assert (noexcept(opt_seconds()), "default constructor should be noexcept");
+  static_assert (noexcept(std::declval<opt_seconds&>().assign(std::declval<seconds>())), "assign should be noexcept");
+  static_assert (!noexcept(std::declval<opt_seconds&>().assign(std::declval<const seconds&>())), "copy-assign can throw");
+  static_assert (!std::is_nothrow_move_constructible<markable<mark_range>>::value, "range's move is a copy");
+  static_assert (std::is_nothrow_move_constructible<markable<mark_int<int, -1>>>::value, "move should be noexcept");
+  static_assert (std::is_nothrow_constructible<markable<mark_int<int, -1>>, int>::value, "constructor should be noexcept");
+
+  // reallocation moves rather than copies
+  seconds_copies = 0;
+  std::vector<opt_seconds> v;
+  for (int i = 0; i != 100; ++i)
+    v.push_back(i % 3 ? opt_seconds(seconds(i)) : opt_seconds());
+  assert (seconds_copies == 0);
+}
+
+void test_relocate_n()
+{
+  typedef markable<mark_seconds> opt_seconds;
+  static_assert (is_trivially_relocatable<opt_seconds>::value, "opted in");
+  static_assert (is_trivially_relocatable<markable<mark_int<int, -1>>>::value, "trivially copyable");
+  static_assert (!is_trivially_relocatable<markable<mark_range>>::value, "not opted in");
+
+  {
+    std::aligned_storage<sizeof(opt_seconds), alignof(opt_seconds)>::type src[4], dst[4];
+    opt_seconds* s = reinterpret_cast<opt_seconds*>(src);
+    opt_seconds* d = reinterpret_cast<opt_seconds*>(dst);
+    for (int i = 0; i != 4; ++i)
+      ::new (s + i) opt_seconds(i % 2 ? opt_seconds(seconds(i)) : opt_seconds());
+
+    assert (relocate_n(s, 4, d) == d + 4);
+    assert (!d[0].has_value());
+    assert (d[1].value().count() == 1);
+    assert (!d[2].has_value());
+    assert (d[3].value().count() == 3);
+    for (int i = 0; i != 4; ++i)
+      d[i].~opt_seconds();
   }
+
+  reset_globals();
+  {
+    typedef markable<mark_range> opt_range;
+    std::aligned_storage<sizeof(opt_range), alignof(opt_range)>::type src[3], dst[3];
+    opt_range* s = reinterpret_cast<opt_range*>(src);
+    opt_range* d = reinterpret_cast<opt_range*>(dst);
+    ::new (s + 0) opt_range(range(1, 2));
+    ::new (s + 1) opt_range();
+    ::new (s + 2) opt_range(range(3, 4));
+
+    relocate_n(s, 3, d);
+    assert (d[0].value() == range(1, 2));
+    assert (!d[1].has_value());
+    assert (d[2].value() == range(3, 4));
+    for (int i = 0; i != 3; ++i)
+      d[i].~opt_range();
+  }
+  assert (objects_created == objects_destroyed);
+}
+
+struct twice
+{
+  constexpr int operator()(int i) const { return 2 * i; }
+};
+
+struct half_if_even
+{
+  constexpr markable<mark_int<int, -1>> operator()(int i) const
+  {
+    return i % 2 == 0 ? markable<mark_int<int, -1>>(i / 2) : markable<mark_int<int, -1>>();
+  }
+};
+
+struct minus_one
+{
+  constexpr markable<mark_int<int, -1>> operator()() const { return markable<mark_int<int, -1>>(-1); }
+};
+
+void test_value_or_and_monadic()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  constexpr opt_int i_, i4(4), i3(3);
+
+  static_assert (i_.value_or(7) == 7, "bad value_or");
+  static_assert (i4.value_or(7) == 4, "bad value_or");
+  static_assert (i4.transform(twice{}).value() == 8, "bad transform");
+  static_assert (!i_.transform(twice{}).has_value(), "bad transform");
+  static_assert (i4.and_then(half_if_even{}).value() == 2, "bad and_then");
+  static_assert (!i3.and_then(half_if_even{}).has_value(), "bad and_then");
+  static_assert (!i_.and_then(half_if_even{}).has_value(), "bad and_then");
+  static_assert (i4.or_else(minus_one{}).value() == 4, "bad or_else");
+  static_assert (!i_.or_else(minus_one{}).has_value(), "bad or_else");
+
+  // a different result type gets a default_markable
+  opt_int m5(5);
+  default_markable<std::string> s = m5.transform([](int i) { return std::string(i, 'x'); });
+  assert (s.value() == "xxxxx");
+  assert (!i_.transform([](int i) { return std::string(i, 'x'); }).has_value());
+  assert ((i4.transform<mark_int<long, 0>>([](int i) { return long(i) * 3; }).value() == 12));
+
+  // select-friendly policies
+  typedef markable<mark_fp_nan<double>> opt_double;
+  assert (opt_double().value_or(1.5) == 1.5);
+  assert (opt_double(2.5).value_or(1.5) == 2.5);
+
+  typedef markable<mark_enum<Dir, -1>> opt_dir;
+  assert (opt_dir().value_or(Dir::W) == Dir::W);
+  assert (opt_dir(Dir::E).value_or(Dir::W) == Dir::E);
+
+  typedef markable<mark_bool> opt_bool;
+  assert (opt_bool().value_or(true) == true);
+  assert (opt_bool(false).value_or(true) == false);
+
+  typedef markable<mark_int<unsigned char, 0xFF>> opt_byte;
+  assert (opt_byte().value_or(3) == 3);
+  assert (opt_byte(200).value_or(3) == 200);
+
+  // the generic path
+  typedef markable<mark_stl_empty<std::string>> opt_str;
+  assert (opt_str().value_or("none") == "none");
+  assert (opt_str("a").value_or("none") == "a");
+  assert (opt_str().or_else([] { return opt_str("b"); }).value() == "b");
+  assert (opt_str("a").transform([](const std::string& x) { return x + x; }).value() == "aa");
+
+  markable<mark_TOD> t;
+  assert (t.value_or(TOD(5)) == TOD(5));
 }
 
 int main()
@@ -1196,4 +1571,12 @@ int main()
   most_hostile_types::test();
   nested_markable::test();
   test_manual_cmp();
+  test_mark_int_multi();
+  test_mark_int_range();
+  test_mark_ptr();
+  test_mark_aligned_ptr();
+  test_trivial_copyability();
+  test_dual_storage_noexcept();
+  test_relocate_n();
+  test_value_or_and_monadic();
 }
@@ -0,0 +1,349 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// This file is also compiled with -ffast-math: the expected results are
+// therefore never computed with markable::has_value() on floating-point values.
+
+#include "../include/ak_toolkit/markable_aggregate.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace ak_toolkit;
+
+const simd_level all_levels[] = { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 };
+
+// element i is marked iff i % 3 == 1; values are small integers, so that sums are exact
+template <typename FPT>
+std::vector<markable<mark_fp_nan<FPT>>> make_column(std::size_t n)
+{
+  std::vector<markable<mark_fp_nan<FPT>>> v;
+  for (std::size_t i = 0; i != n; ++i)
+    if (i % 3 == 1)
+      v.push_back(markable<mark_fp_nan<FPT>>());
+    else
+      v.push_back(markable<mark_fp_nan<FPT>>(FPT(int(i % 17) - 8)));
+  return v;
+}
+
+template <typename FPT>
+void test_nan_mask()
+{
+  for (std::size_t n : {0, 5, 64, 130, 1001})
+  {
+    std::vector<markable<mark_fp_nan<FPT>>> v = make_column<FPT>(n);
+    for (simd_level level : all_levels)
+    {
+      std::vector<std::uint64_t> mask ((n + 63) / 64);
+      compute_value_mask(v.data(), n, mask.data(), level);
+      for (std::size_t i = 0; i != n; ++i)
+        assert (bool((mask[i / 64] >> (i % 64)) & 1) == (i % 3 != 1));
+    }
+  }
+}
+
+template <typename FPT>
+void test_summarize()
+{
+  for (std::size_t n : {0, 1, 2, 3, 7, 16, 33, 1000, 1025})
+  {
+    std::vector<markable<mark_fp_nan<FPT>>> v = make_column<FPT>(n);
+
+    std::size_t count = 0;
+    FPT sum = 0, mn = 100, mx = -100;
+    for (std::size_t i = 0; i != n; ++i)
+      if (i % 3 != 1)
+      {
+        FPT x = FPT(int(i % 17) - 8);
+        ++count;
+        sum += x;
+        mn = x < mn ? x : mn;
+        mx = mx < x ? x : mx;
+      }
+
+    for (simd_level level : all_levels)
+    {
+      fp_summary<FPT> s = summarize(v.data(), n, level);
+      assert (s.count == count);
+      assert (s.sum == sum);
+      if (count != 0)
+      {
+        assert (s.min == mn);
+        assert (s.max == mx);
+      }
+    }
+  }
+}
+
+template <typename FPT>
+bool is_marked_value_bits(const markable<mark_fp_nan<FPT>>& m)
+{
+  const FPT marked = mark_fp_nan<FPT>::marked_value();
+  return std::memcmp(&m.representation_value(), &marked, sizeof(FPT)) == 0;
+}
+
+template <typename FPT>
+void test_reductions()
+{
+  typedef markable<mark_fp_nan<FPT>> opt_fp;
+  std::vector<opt_fp> v = make_column<FPT>(9); // -8, _, -6, -5, _, -3, -2, _, 0
+
+  assert (markable_ns::count_values(v.data(), v.size()) == 6);
+  assert (markable_ns::sum_values(v.data(), v.size()) == FPT(-24));
+  assert (markable_ns::min_value(v.data(), v.size()).value() == FPT(-8));
+  assert (markable_ns::max_value(v.data(), v.size()).value() == FPT(0));
+  assert (markable_ns::mean_value(v.data(), v.size()).value() == FPT(-4));
+
+  std::vector<opt_fp> e (10);
+  assert (markable_ns::count_values(e.data(), e.size()) == 0);
+  assert (markable_ns::sum_values(e.data(), e.size()) == FPT(0));
+  // no values: the result is the marked value, i.e. a NaN
+  assert (is_marked_value_bits(markable_ns::min_value(e.data(), e.size())));
+  assert (is_marked_value_bits(markable_ns::mean_value(e.data(), e.size())));
+}
+
+void test_markable_vector_summary()
+{
+  markable_vector<mark_fp_nan<float>> v (100);
+  v[10] = markable<mark_fp_nan<float>>(2.5f);
+  v[99] = markable<mark_fp_nan<float>>(-1.0f);
+  fp_summary<float> s = summarize(v);
+  assert (s.count == 2);
+  assert (s.sum == 1.5f);
+  assert (s.min == -1.0f);
+  assert (s.max == 2.5f);
+}
+
+std::uint64_t next_random(std::uint64_t& seed)
+{
+  seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+  return seed >> 16;
+}
+
+// compares with the sum computed in 128 bits, one element at a time
+template <typename MP>
+void test_int_summarize(typename MP::representation_type lo, typename MP::representation_type hi)
+{
+  typedef typename MP::representation_type T;
+  typedef typename int_summary<T>::sum_type S;
+
+  std::uint64_t seed = 7;
+  for (std::size_t n : {0, 1, 3, 8, 17, 64, 100, 1000, 1027})
+  {
+    std::vector<T> v;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const std::uint64_t r = next_random(seed);
+      // computed in 64 unsigned bits: hi - lo overflows T for a full-range int
+      const std::uint64_t offset = r / 4 % (std::uint64_t(hi) - std::uint64_t(lo) + 1);
+      v.push_back(r % 4 == 0 ? T(MP::marked_value()) : T(std::uint64_t(lo) + offset));
+    }
+
+    std::size_t count = 0;
+    T mn = std::numeric_limits<T>::max(), mx = std::numeric_limits<T>::min();
+    unsigned __int128 sum = 0;
+    for (T x : v)
+      if (!MP::is_marked_value(x))
+      {
+        ++count;
+        sum += std::is_signed<T>::value ? (unsigned __int128)(__int128)(std::int64_t)x : (unsigned __int128)(std::uint64_t)x;
+        mn = x < mn ? x : mn;
+        mx = mx < x ? x : mx;
+      }
+    const __int128 exact = (__int128)sum;
+    const bool fits = std::is_signed<S>::value
+      ? exact >= std::numeric_limits<std::int64_t>::min() && exact <= std::numeric_limits<std::int64_t>::max()
+      : exact >= 0 && exact <= (__int128)std::numeric_limits<std::uint64_t>::max();
+
+    for (simd_level level : all_levels)
+    {
+      int_summary<T> s = summarize<MP>(v.data(), n, level);
+      assert (s.count == count);
+      assert (s.overflow == !fits);
+      assert (s.sum == S(std::uint64_t(sum)));
+      if (count != 0)
+      {
+        assert (s.min == mn);
+        assert (s.max == mx);
+      }
+    }
+  }
+}
+
+void test_int_summaries()
+{
+  test_int_summarize<mark_int<int, -1>>(-1000, 1000);
+  test_int_summarize<mark_int<int, std::numeric_limits<int>::min()>>(std::numeric_limits<int>::min() + 1, std::numeric_limits<int>::max());
+  test_int_summarize<mark_int<unsigned, 0>>(1, std::numeric_limits<unsigned>::max());
+  test_int_summarize<mark_int<std::int64_t, 0>>(-3, 5);
+  test_int_summarize<mark_int<std::int64_t, std::numeric_limits<std::int64_t>::min()>>(std::numeric_limits<std::int64_t>::max() / 4, std::numeric_limits<std::int64_t>::max());
+  test_int_summarize<mark_int<std::uint64_t, 7>>(std::numeric_limits<std::uint64_t>::max() / 3, std::numeric_limits<std::uint64_t>::max());
+  test_int_summarize<mark_int<std::int16_t, -1>>(-30000, 30000);
+  test_int_summarize<mark_int<std::uint8_t, 255>>(0, 254);
+  test_int_summarize<mark_bool>(0, 1);
+}
+
+void test_int64_overflow()
+{
+  const std::int64_t big = std::numeric_limits<std::int64_t>::max();
+  for (simd_level level : all_levels)
+  {
+    // the running sum overflows, but the total fits
+    std::vector<std::int64_t> v (64, -1);
+    v[0] = big;
+    v[1] = big;
+    v[2] = -big;
+    int_summary<std::int64_t> s = summarize<mark_int<std::int64_t, -1>>(v.data(), v.size(), level);
+    assert (s.count == 3);
+    assert (!s.overflow);
+    assert (s.sum == big);
+
+    v[2] = 1;
+    s = summarize<mark_int<std::int64_t, -1>>(v.data(), v.size(), level);
+    assert (s.overflow);
+  }
+}
+
+enum class grade { a, b, c, d, none = -1 };
+
+void test_int_reductions()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  std::vector<opt_int> v;
+  for (int i : {4, -1, 7, 2, -1, 1, 0, 5, -1, 6})
+    v.push_back(opt_int(i));
+
+  assert (markable_ns::count_values(v.data(), v.size()) == 7);
+  assert (markable_ns::sum_value(v.data(), v.size()).value() == 25);
+  assert (markable_ns::min_value(v.data(), v.size()).value() == 0);
+  assert (markable_ns::max_value(v.data(), v.size()).value() == 7);
+  assert (markable_ns::mean_value(v.data(), v.size()).value() == 25.0 / 7);
+
+  std::vector<opt_int> e (20);
+  assert (!markable_ns::sum_value(e.data(), e.size()).has_value());
+  assert (!markable_ns::min_value(e.data(), e.size()).has_value());
+  assert (!markable_ns::max_value(e.data(), e.size()).has_value());
+  assert (is_marked_value_bits(markable_ns::mean_value(e.data(), e.size())));
+
+  // a sum that does not fit has no value
+  typedef markable<mark_int<std::int64_t, 0>> opt_long;
+  std::vector<opt_long> w (2, opt_long(std::numeric_limits<std::int64_t>::max()));
+  assert (!markable_ns::sum_value(w.data(), w.size()).has_value());
+
+  // every value of sum_type is a valid sum, the smallest one too
+  const std::int64_t min64 = std::numeric_limits<std::int64_t>::min();
+  std::vector<opt_long> low (2, opt_long(min64 / 2));
+  assert (markable_ns::sum_value(low.data(), low.size()).value() == min64);
+  low.push_back(opt_long(-1));
+  assert (!markable_ns::sum_value(low.data(), low.size()).has_value());
+  typedef markable<mark_int<std::uint64_t, 0>> opt_ulong;
+  std::vector<opt_ulong> high (1, opt_ulong(std::numeric_limits<std::uint64_t>::max()));
+  assert (markable_ns::sum_value(high.data(), high.size()).value() == std::numeric_limits<std::uint64_t>::max());
+  assert (markable_ns::mean_value(w.data(), w.size()).value() == double(std::numeric_limits<std::int64_t>::max()));
+
+  typedef markable<mark_enum<grade, -1>> opt_grade;
+  markable_vector<mark_enum<grade, -1>> g (40);
+  g[3] = opt_grade(grade::c);
+  g[17] = opt_grade(grade::b);
+  g[39] = opt_grade(grade::d);
+  int_summary<int> gs = summarize(g);
+  assert (gs.count == 3);
+  assert (gs.min == int(grade::b));
+  assert (gs.max == int(grade::d));
+
+  std::vector<opt_grade> h (5);
+  h[1] = opt_grade(grade::c);
+  h[4] = opt_grade(grade::a);
+  assert (markable_ns::min_value(h.data(), h.size()).value() == grade::a);
+  assert (markable_ns::max_value(h.data(), h.size()).value() == grade::c);
+}
+
+template <typename FPT>
+FPT abs_error(FPT x, double exact)
+{
+  const double d = double(x) - exact;
+  return FPT(d < 0 ? -d : d);
+}
+
+// 1 followed by many values too small to change it when added one by one
+void test_float_summation()
+{
+  const std::size_t n = 100000;
+  std::vector<float> v (n, 1e-8f);
+  v[0] = 1.0f;
+  for (std::size_t i = 5; i < n; i += 5)
+    v[i] = mark_fp_nan<float>::marked_value();
+  const double exact = 1.0 + double(1e-8f) * double(n - 1 - (n - 1) / 5);
+
+  for (simd_level level : all_levels)
+  {
+    fp_summary<float> simple = summarize<mark_fp_nan<float>>(v.data(), n, level, summation::simple);
+    fp_summary<float> pairwise = summarize<mark_fp_nan<float>>(v.data(), n, level, summation::pairwise);
+    assert (pairwise.count == simple.count);
+    assert (pairwise.min == 1e-8f);
+    assert (pairwise.max == 1.0f);
+    assert (abs_error(pairwise.sum, exact) < abs_error(simple.sum, exact));
+
+    fp_summary<float> kahan = summarize<mark_fp_nan<float>>(v.data(), n, level, summation::kahan);
+    assert (kahan.count == simple.count);
+    assert (abs_error(kahan.sum, exact) <= abs_error(pairwise.sum, exact));
+    assert (abs_error(kahan.sum, exact) < abs_error(simple.sum, exact));
+
+#ifndef __FAST_MATH__
+    // infinities are added as in simple summation
+    v[1] = std::numeric_limits<float>::infinity();
+    assert (summarize<mark_fp_nan<float>>(v.data(), n, level, summation::kahan).sum == std::numeric_limits<float>::infinity());
+    v[1] = 1e-8f;
+#endif
+  }
+}
+
+// a sum of finite values that does not fit is an infinity, as in simple summation
+template <typename FPT>
+void test_overflowing_sum()
+{
+#ifndef __FAST_MATH__
+  const FPT inf = std::numeric_limits<FPT>::infinity();
+  for (std::size_t n : {1, 64, 1001})
+  {
+    std::vector<FPT> v (n + 1, std::numeric_limits<FPT>::max());
+    v[0] = mark_fp_nan<FPT>::marked_value();
+    for (simd_level level : all_levels)
+      for (summation m : { summation::simple, summation::pairwise, summation::kahan })
+      {
+        const FPT s = summarize<mark_fp_nan<FPT>>(v.data(), v.size(), level, m).sum;
+        assert (n == 1 ? s == std::numeric_limits<FPT>::max() : s == inf);
+      }
+
+    for (FPT& e : v)
+      e = -e;
+    for (simd_level level : all_levels)
+    {
+      const FPT s = summarize<mark_fp_nan<FPT>>(v.data(), v.size(), level, summation::kahan).sum;
+      assert (n == 1 ? s == -std::numeric_limits<FPT>::max() : s == -inf);
+    }
+  }
+#endif
+}
+
+int main()
+{
+  test_nan_mask<float>();
+  test_nan_mask<double>();
+  test_summarize<float>();
+  test_summarize<double>();
+  test_reductions<float>();
+  test_reductions<double>();
+  test_markable_vector_summary();
+  test_int_summaries();
+  test_int64_overflow();
+  test_int_reductions();
+  test_float_summation();
+  test_overflowing_sum<float>();
+  test_overflowing_sum<double>();
+}
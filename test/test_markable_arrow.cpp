@@ -0,0 +1,195 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_arrow.hpp"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::int32_t, -1> mark_id;
+
+// A consumer that knows only the Arrow specification
+bool arrow_is_valid(const ArrowArray* a, std::int64_t i)
+{
+  const std::uint8_t* validity = static_cast<const std::uint8_t*>(a->buffers[0]);
+  const std::int64_t j = a->offset + i;
+  return validity == nullptr || ((validity[j / 8] >> (j % 8)) & 1);
+}
+
+template <typename T>
+T arrow_sum(const ArrowArray* a)
+{
+  const T* values = static_cast<const T*>(a->buffers[1]) + a->offset;
+  T sum = 0;
+  for (std::int64_t i = 0; i != a->length; ++i)
+    if (arrow_is_valid(a, i))
+      sum += values[i];
+  return sum;
+}
+
+void test_export_span()
+{
+  std::vector<std::int32_t> column;
+  for (std::int32_t i = 0; i != 100; ++i)
+    column.push_back(i % 10 == 0 ? -1 : i);
+
+  ArrowArray array;
+  ArrowSchema schema;
+  export_arrow(const_markable_span<mark_id>(column.data(), column.size()), &array, &schema);
+
+  assert (std::strcmp(schema.format, "i") == 0);
+  assert (schema.flags & ARROW_FLAG_NULLABLE);
+  assert (array.length == 100);
+  assert (array.null_count == 10);
+  assert (array.n_buffers == 2);
+  assert (array.buffers[1] == column.data()); // zero-copy
+  assert (!arrow_is_valid(&array, 0));
+  assert (arrow_is_valid(&array, 1));
+  assert (arrow_sum<std::int32_t>(&array) == 4950 - 450);
+
+  array.release(&array);
+  assert (array.release == nullptr);
+  schema.release(&schema);
+  assert (schema.release == nullptr);
+}
+
+void test_export_without_nulls()
+{
+  markable_vector<mark_fp_nan<double>> v;
+  v.push_back(markable<mark_fp_nan<double>>(1.5));
+  v.push_back(markable<mark_fp_nan<double>>(2.5));
+
+  ArrowArray array;
+  ArrowSchema schema;
+  export_arrow(v, &array, &schema);
+  assert (std::strcmp(schema.format, "g") == 0);
+  assert (array.null_count == 0);
+  assert (array.buffers[0] == nullptr);
+  assert (arrow_sum<double>(&array) == 4.0);
+  array.release(&array);
+  schema.release(&schema);
+}
+
+void test_owning_export_and_import()
+{
+  markable_vector<mark_id> v;
+  for (std::int32_t i = 0; i != 130; ++i)
+    v.push_back(i % 3 == 0 ? markable<mark_id>() : markable<mark_id>(i));
+  const std::int32_t* data = v.data();
+
+  ArrowArray array;
+  ArrowSchema schema;
+  export_arrow(std::move(v), &array, &schema);
+  assert (v.empty());
+  assert (array.buffers[1] == data); // the vector has been moved, not copied
+
+  markable_vector<mark_id> back = import_arrow<mark_id>(&array, &schema);
+  assert (array.release == nullptr); // released by import_arrow
+  assert (back.size() == 130);
+  for (std::int32_t i = 0; i != 130; ++i)
+    assert (back[i].has_value() == (i % 3 != 0));
+  assert (back[4].value() == 4);
+  schema.release(&schema);
+}
+
+void test_bool_round_trip()
+{
+  markable_vector<mark_bool> v;
+  v.push_back(markable<mark_bool>(true));
+  v.push_back(markable<mark_bool>());
+  v.push_back(markable<mark_bool>(false));
+  v.push_back(markable<mark_bool>(true));
+
+  ArrowArray array;
+  ArrowSchema schema;
+  export_arrow(v, &array, &schema);
+  assert (std::strcmp(schema.format, "b") == 0);
+  assert (array.null_count == 1);
+  assert (*static_cast<const std::uint8_t*>(array.buffers[1]) == 0x9); // bits 0 and 3
+
+  markable_vector<mark_bool> back = import_arrow<mark_bool>(&array, &schema);
+  assert (back[0].value() == true);
+  assert (!back[1].has_value());
+  assert (back[2].value() == false);
+  assert (back[3].value() == true);
+  schema.release(&schema);
+}
+
+static int released_arrays = 0;
+void release_test_array(ArrowArray* a) { ++released_arrays; a->release = nullptr; }
+void release_test_schema(ArrowSchema* s) { s->release = nullptr; }
+
+// an array produced by another library, with a non-zero offset
+void test_import_with_offset()
+{
+  const std::int16_t values[] = { 9, 9, 9, 1, 2, 3, 4, 5, 6, 7, 8, 10 };
+  const std::uint8_t validity[] = { 0xB8, 0x0F }; // offset 3: 1 1 1 0 1 1 1 1 1 (bits 3 .. 11)
+  const void* buffers[] = { validity, values };
+
+  ArrowArray array = { 9, -1, 3, 2, 0, buffers, nullptr, nullptr, &release_test_array, nullptr };
+  ArrowSchema schema = { "s", nullptr, nullptr, ARROW_FLAG_NULLABLE, 0, nullptr, nullptr, &release_test_schema, nullptr };
+
+  markable_vector<mark_int<std::int16_t, -1>> v = import_arrow<mark_int<std::int16_t, -1>>(&array, &schema);
+  assert (released_arrays == 1);
+  assert (v.size() == 9);
+  assert (v[0].value() == 1);
+  assert (!v[3].has_value());
+  assert (v[8].value() == 10);
+  assert (v.count_values() == 8);
+
+  ArrowArray array2 = { 9, -1, 3, 2, 0, buffers, nullptr, nullptr, &release_test_array, nullptr };
+  bool thrown = false;
+  try { import_arrow<mark_id>(&array2, &schema); } // "s" is not int32
+  catch (std::invalid_argument const&) { thrown = true; }
+  assert (thrown);
+  assert (array2.release != nullptr); // not consumed
+}
+
+// a valid element that is a marked value is rejected; a null one is not
+void test_import_marked_value()
+{
+  const std::int16_t values[] = { 1, -1, 3, 4 };
+  const std::uint8_t validity[] = { 0x0D }; // 1 0 1 1
+  const void* buffers[] = { validity, values };
+  ArrowSchema schema = { "s", nullptr, nullptr, ARROW_FLAG_NULLABLE, 0, nullptr, nullptr, &release_test_schema, nullptr };
+
+  ArrowArray array = { 4, 1, 0, 2, 0, buffers, nullptr, nullptr, &release_test_array, nullptr };
+  markable_vector<mark_int<std::int16_t, -1>> v = import_arrow<mark_int<std::int16_t, -1>>(&array, &schema);
+  assert (v.count_values() == 3);
+
+  const void* no_validity[] = { nullptr, values };
+  ArrowArray array2 = { 4, 0, 0, 2, 0, no_validity, nullptr, nullptr, &release_test_array, nullptr };
+  bool thrown = false;
+  try { import_arrow<mark_int<std::int16_t, -1>>(&array2, &schema); }
+  catch (std::invalid_argument const&) { thrown = true; }
+  assert (thrown);
+  assert (array2.release != nullptr);
+
+  const double reals[] = { 1.0, std::nan(""), 2.0 };
+  const void* real_buffers[] = { nullptr, reals };
+  ArrowArray array3 = { 3, 0, 0, 2, 0, real_buffers, nullptr, nullptr, &release_test_array, nullptr };
+  ArrowSchema real_schema = { "g", nullptr, nullptr, ARROW_FLAG_NULLABLE, 0, nullptr, nullptr, &release_test_schema, nullptr };
+  thrown = false;
+  try { import_arrow<mark_fp_nan<double>>(&array3, &real_schema); }
+  catch (std::invalid_argument const&) { thrown = true; }
+  assert (thrown);
+  assert (array3.release != nullptr);
+}
+
+int main()
+{
+  test_export_span();
+  test_export_without_nulls();
+  test_owning_export_and_import();
+  test_bool_round_trip();
+  test_import_with_offset();
+  test_import_marked_value();
+}
@@ -0,0 +1,174 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_column_file.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace ak_toolkit;
+
+typedef mark_int<int, -1> mark_id;
+
+const std::string path = "test_markable_column_file.tmp";
+
+void test_int_column()
+{
+  const std::size_t rows = 1000;
+  {
+    markable_column_writer<mark_id> w (path, 128);
+    for (std::size_t i = 0; i != rows; ++i)
+      w.append(i % 10 == 0 ? markable<mark_id>() : markable<mark_id>(int(i)));
+    assert (w.size() == rows);
+  } // closed by the destructor
+
+  markable_column_reader<mark_id> r (path);
+  assert (r.size() == rows);
+  assert (r.block_rows() == 128);
+  assert (r.block_count() == 8);
+  assert (r.block(7).size() == rows - 7 * 128);
+  assert (reinterpret_cast<std::uintptr_t>(r.block(1).data()) % 64 == 0);
+
+  assert (r.null_count(0) == 13); // 0, 10, ..., 120
+  assert (r.null_count() == rows / 10);
+  for (std::size_t i = 0; i != r.block_count(); ++i)
+    assert (r.null_count(i) == r.block(i).size() - r.block(i).count_values());
+
+  const_markable_span<mark_id> c = r.column();
+  assert (c.size() == rows);
+  assert (!c.has_value(0));
+  assert (c.value(999) == 999);
+  assert (r.block(3).value(1) == 3 * 128 + 1);
+
+  markable_column_reader<mark_id> moved (std::move(r));
+  assert (moved.column().value(1) == 1);
+}
+
+void test_other_policies()
+{
+  {
+    markable_column_writer<mark_fp_nan<double>> w (path, 64);
+    const double buffer[] = { 1.5, std::numeric_limits<double>::quiet_NaN(), 2.5 };
+    w.append(const_markable_span<mark_fp_nan<double>>(buffer, 3));
+    w.close();
+  }
+  {
+    markable_column_reader<mark_fp_nan<double>> r (path);
+    assert (r.size() == 3);
+    assert (r.null_count() == 1);
+    assert (r.column().value(2) == 2.5);
+  }
+  {
+    markable_column_writer<mark_bool> w (path, 64);
+    w.append(markable<mark_bool>(true));
+    w.append(markable<mark_bool>());
+  }
+  {
+    markable_column_reader<mark_bool> r (path);
+    assert (r.size() == 2);
+    assert (r.column().value(0) == true);
+    assert (!r.column().has_value(1));
+  }
+}
+
+void test_mismatch_rejected()
+{
+  {
+    markable_column_writer<mark_id> w (path, 64);
+    w.append(markable<mark_id>(1));
+  }
+
+  bool thrown = false;
+  try { markable_column_reader<mark_int<int, -2>> r (path); }
+  catch (std::runtime_error const&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  try { markable_column_reader<mark_int<unsigned, unsigned(-1)>> r (path); }
+  catch (std::runtime_error const&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  try { markable_column_reader<mark_id> r ("no_such_file.tmp"); }
+  catch (std::runtime_error const&) { thrown = true; }
+  assert (thrown);
+
+  thrown = false;
+  try { markable_column_writer<mark_id> w (path, 100); }
+  catch (std::invalid_argument const&) { thrown = true; }
+  assert (thrown);
+}
+
+// rewrites the header of the file at path
+void patch_header(void (*f)(column_file_header&))
+{
+  std::FILE* file = std::fopen(path.c_str(), "r+b");
+  column_file_header h;
+  assert (std::fread(&h, sizeof(h), 1, file) == 1);
+  f(h);
+  std::fseek(file, 0, SEEK_SET);
+  assert (std::fwrite(&h, sizeof(h), 1, file) == 1);
+  std::fclose(file);
+}
+
+void write_short_column()
+{
+  markable_column_writer<mark_id> w (path, 64);
+  for (int i = 0; i != 100; ++i)
+    w.append(markable<mark_id>(i));
+}
+
+bool rejected()
+{
+  try { markable_column_reader<mark_id> r (path); }
+  catch (std::runtime_error const&) { return true; }
+  return false;
+}
+
+// sizes and offsets that would overflow when added or multiplied
+void test_corrupt_header_rejected()
+{
+  write_short_column();
+  assert (!rejected());
+
+  patch_header([](column_file_header& h) { h.row_count = h.block_rows = std::uint64_t(1) << 62; });
+  assert (rejected());
+
+  write_short_column();
+  patch_header([](column_file_header& h) { h.row_count = std::uint64_t(1) << 62; });
+  assert (rejected());
+
+  write_short_column();
+  patch_header([](column_file_header& h) { h.data_offset = ~std::uint64_t(63); });
+  assert (rejected());
+
+  write_short_column();
+  patch_header([](column_file_header& h) { h.null_counts_offset = ~std::uint64_t(7); });
+  assert (rejected());
+
+  write_short_column();
+  patch_header([](column_file_header& h) { h.data_offset = h.null_counts_offset + 64; });
+  assert (rejected());
+
+  // shorter than the header
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  std::fputs("AKMKCOL", file);
+  std::fclose(file);
+  assert (rejected());
+}
+
+int main()
+{
+  test_int_column();
+  test_other_policies();
+  test_mismatch_rejected();
+  test_corrupt_header_rejected();
+  std::remove(path.c_str());
+}
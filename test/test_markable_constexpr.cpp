@@ -0,0 +1,136 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable.hpp"
+#include <cassert>
+
+using namespace ak_toolkit;
+
+typedef markable<mark_int<int, -1>> opt_int;
+
+template <typename M, int N>
+struct table
+{
+  M entries[N];
+};
+
+#if defined __cpp_constexpr && __cpp_constexpr >= 201304
+// C++14: tables of markables with scalar storage can be filled with assign()
+constexpr table<opt_int, 8> make_squares()
+{
+  table<opt_int, 8> t {};
+  for (int i = 0; i != 8; ++i)
+    if (i % 3 != 0)
+      t.entries[i].assign(i * i);
+  return t;
+}
+
+constexpr table<opt_int, 8> squares = make_squares();
+static_assert (!squares.entries[0].has_value(), "");
+static_assert (squares.entries[2].value() == 4, "");
+static_assert (squares.entries[7].value_or(0) == 49, "");
+static_assert (squares.entries[6].value_or(0) == 0, "");
+#endif
+
+#if defined AK_TOOLKIT_CONSTEXPR_DUAL_STORAGE
+// C++20: tables of markables with dual storage. During constant evaluation the
+// representation can only be read while it is the active member: when there is no value.
+
+struct tod // trivially copyable
+{
+  int minutes;
+  constexpr explicit tod(int m) : minutes(m) {}
+};
+
+struct tod_representation
+{
+  int minutes;
+};
+
+struct mark_tod : markable_dual_storage_type<mark_tod, tod, tod_representation>
+{
+  static constexpr representation_type marked_value() noexcept { return {-1}; }
+  static constexpr bool is_marked_value(const representation_type& v) { return v.minutes < 0; }
+};
+
+typedef markable<mark_tod> opt_tod;
+
+constexpr table<opt_tod, 6> make_timetable()
+{
+  table<opt_tod, 6> t {};
+  for (int i = 0; i != 6; ++i)
+    if (i % 2 == 0)
+      t.entries[i].assign(tod(i * 60));      // changes the active member
+
+  t.entries[4].assign(tod(1));               // value to value
+  t.entries[0].assign_representation({-1});  // value to no value
+  opt_tod copy = t.entries[2];
+  swap(copy, t.entries[3]);
+  return t;
+}
+
+constexpr table<opt_tod, 6> timetable = make_timetable();
+static_assert (!timetable.entries[0].has_value(), "");
+static_assert (!timetable.entries[1].has_value(), "");
+static_assert (!timetable.entries[5].has_value(), "");
+
+class minutes // not trivially copyable
+{
+  int _count;
+
+public:
+  constexpr explicit minutes(int c) : _count(c) {}
+  constexpr minutes(const minutes& r) : _count(r._count) {}
+  constexpr minutes& operator=(const minutes& r) { _count = r._count; return *this; }
+  constexpr int count() const { return _count; }
+};
+
+struct minutes_representation
+{
+  int count;
+};
+
+struct mark_minutes : markable_dual_storage_type<mark_minutes, minutes, minutes_representation>
+{
+  static constexpr representation_type marked_value() noexcept { return {-1}; }
+  static constexpr bool is_marked_value(const representation_type& v) { return v.count < 0; }
+};
+
+typedef markable<mark_minutes> opt_minutes;
+static_assert (!std::is_trivially_copyable<opt_minutes>::value, "");
+
+constexpr opt_minutes durations[] = { opt_minutes(minutes(15)), opt_minutes(), opt_minutes(minutes(90)) };
+static_assert (!durations[1].has_value(), "");
+
+constexpr bool no_value_round_trip()
+{
+  opt_minutes m;
+  opt_minutes n = m;  // copy of no value
+  n = m;
+  m.assign_representation({-2});
+  swap(m, n);
+  return !n.has_value() && !m.has_value();
+}
+static_assert (no_value_round_trip(), "");
+#endif
+
+int main()
+{
+#if defined __cpp_constexpr && __cpp_constexpr >= 201304
+  assert (squares.entries[4].value() == 16);
+#endif
+#if defined AK_TOOLKIT_CONSTEXPR_DUAL_STORAGE
+  assert (timetable.entries[2].value().minutes == 120);
+  assert (timetable.entries[3].value().minutes == 120);
+  assert (timetable.entries[4].value().minutes == 1);
+  assert (durations[0].value().count() == 15);
+  assert (durations[2].value().count() == 90);
+
+  table<opt_tod, 6> t = make_timetable(); // the same at run-time
+  assert (!t.entries[0].has_value());
+  assert (t.entries[3].value().minutes == 120);
+#endif
+}
@@ -0,0 +1,292 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_flat_map.hpp"
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <type_traits>
+
+using namespace ak_toolkit;
+
+typedef mark_int<std::uint32_t, ~std::uint32_t(0)> mark_id;
+
+void test_set_has_no_control_bytes()
+{
+  markable_flat_set<mark_id> s;
+  s.reserve(100);
+  typedef markable_ns::detail_::flat_slot<mark_id, void> slot_type;
+  static_assert (sizeof(slot_type) == sizeof(std::uint32_t), "no control bytes");
+
+  assert (s.insert(1));
+  assert (s.insert(2));
+  assert (!s.insert(1));
+  assert (s.size() == 2);
+  assert (s.contains(1));
+  assert (s.contains(2));
+  assert (!s.contains(3));
+
+  int sum = 0;
+  for (std::uint32_t k : s)
+    sum += k;
+  assert (sum == 3);
+
+  assert (s.erase(1) == 1);
+  assert (s.erase(1) == 0);
+  assert (!s.contains(1));
+  assert (s.contains(2));
+}
+
+void test_map_basic()
+{
+  markable_flat_map<mark_id, std::string> m;
+  assert (m.empty());
+  assert (m.find(7) == m.end());
+
+  m[7] = "seven";
+  assert (m.insert(8, "eight").second);
+  assert (!m.insert(8, "EIGHT").second);
+  assert (m.emplace(9, 4, 'x').second);
+
+  assert (m.size() == 3);
+  assert (m.find(7)->second == "seven");
+  assert (m.find(8)->second == "eight");
+  assert (m.find(9)->second == "xxxx");
+  assert ((*m.find(9)).first == 9);
+
+  m[8] += "!";
+  assert (m.find(8)->second == "eight!");
+
+  markable_flat_map<mark_id, std::string> c = m;
+  assert (m.erase(7) == 1);
+  assert (m.find(7) == m.end());
+  assert (c.find(7)->second == "seven");
+  assert (c.size() == 3);
+  assert (m.size() == 2);
+}
+
+// compares against std::map under many inserts and erases, across rehashes
+void test_map_against_reference()
+{
+  markable_flat_map<mark_int<int, -1>, int> m;
+  std::map<int, int> ref;
+  std::uint32_t seed = 1;
+
+  for (int step = 0; step != 20000; ++step)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    const int k = int(seed >> 20) % 3000 * 1024; // weak hash: stresses probing
+    if (seed % 3 == 0)
+    {
+      assert (m.erase(k) == ref.erase(k));
+    }
+    else
+    {
+      m[k] += 1;
+      ref[k] += 1;
+    }
+    assert (m.size() == ref.size());
+  }
+
+  for (std::map<int, int>::const_iterator it = ref.begin(); it != ref.end(); ++it)
+    assert (m.find(it->first)->second == it->second);
+
+  std::size_t visited = 0;
+  for (markable_flat_map<mark_int<int, -1>, int>::const_iterator it = m.begin(); it != m.end(); ++it)
+  {
+    assert (ref.at(it->first) == it->second);
+    ++visited;
+  }
+  assert (visited == ref.size());
+}
+
+// inserting a key that is present does not rehash
+void test_map_present_key_keeps_iterators()
+{
+  markable_flat_map<mark_int<int, -1>, int> m;
+  for (int i = 0; i != 12; ++i)
+    m.insert(i, i);
+  assert (m.bucket_count() == 16);
+  auto it = m.find(3);
+  assert (!m.insert(3, 42).second);
+  assert (m[3] == 3);
+  assert (!m.emplace(11, 0).second);
+  assert (m.bucket_count() == 16);
+  assert (it == m.find(3) && it->second == 3);
+
+  m.insert(12, 12);
+  assert (m.bucket_count() == 32);
+  assert (m[12] == 12 && m.size() == 13);
+}
+
+int live_objects = 0;
+
+struct Counted
+{
+  int v;
+  explicit Counted(int v = 0) : v(v) { ++live_objects; }
+  Counted(const Counted& r) : v(r.v) { ++live_objects; }
+  Counted(Counted&& r) : v(r.v) { ++live_objects; }
+  ~Counted() { --live_objects; }
+};
+
+void test_map_value_lifetime()
+{
+  {
+    markable_flat_map<mark_int<int, 0>, Counted> m;
+    for (int i = 1; i != 200; ++i)
+      m.emplace(i, i);
+    assert (live_objects == 199);
+    for (int i = 1; i != 100; ++i)
+      m.erase(i);
+    assert (live_objects == 100);
+    m.clear();
+    assert (live_objects == 0);
+    m.emplace(5, 5);
+  }
+  assert (live_objects == 0);
+}
+
+int copies_left = -1; // the copy that throws; -1: none
+
+struct ThrowingCopy
+{
+  int v;
+  explicit ThrowingCopy(int v) : v(v) { ++live_objects; }
+  ThrowingCopy(const ThrowingCopy& r) : v(r.v)
+  {
+    if (copies_left >= 0 && copies_left-- == 0)
+      throw 1;
+    ++live_objects;
+  }
+  ThrowingCopy(ThrowingCopy&& r) : ThrowingCopy(static_cast<const ThrowingCopy&>(r)) {} // can throw: not used by rehash
+  ~ThrowingCopy() { --live_objects; }
+};
+
+// a value that throws during rehash leaves the map unchanged
+void test_map_rehash_exception_safety()
+{
+  {
+    markable_flat_map<mark_int<int, -1>, ThrowingCopy> m;
+    for (int i = 0; i != 12; ++i)
+      m.emplace(i, i * 10);
+    assert (m.bucket_count() == 16 && live_objects == 12);
+
+    copies_left = 5;
+    try
+    {
+      m.emplace(12, 120);
+      assert (false);
+    }
+    catch (int) {}
+    assert (m.bucket_count() == 16 && m.size() == 12 && live_objects == 12);
+    for (int i = 0; i != 12; ++i)
+      assert (m.find(i)->second.v == i * 10);
+    assert (m.find(12) == m.end());
+
+    copies_left = -1;
+    m.emplace(12, 120);
+    assert (m.bucket_count() == 32 && live_objects == 13);
+    for (int i = 0; i != 13; ++i)
+      assert (m.find(i)->second.v == i * 10);
+  }
+  assert (live_objects == 0);
+}
+
+int hashes_left = -1; // the call of Hash that throws; -1: none
+
+struct ThrowingHash
+{
+  template <typename M>
+  std::size_t operator()(const M& m) const
+  {
+    if (hashes_left >= 0 && hashes_left-- == 0)
+      throw 2;
+    return hash_by_representation()(m);
+  }
+};
+
+// a Hash that throws during rehash leaves the map unchanged, even if the values have already been moved
+void test_map_rehash_hash_exception_safety()
+{
+  static_assert(std::is_nothrow_move_constructible<std::string>::value, "values must be moved by rehash");
+  markable_flat_map<mark_int<int, -1>, std::string, ThrowingHash> m;
+  for (int i = 0; i != 12; ++i)
+    m.emplace(i, std::string(40, char('a' + i)));
+  assert (m.bucket_count() == 16);
+
+  hashes_left = 7; // one call to find the key, then the seventh key of the rehash
+  try
+  {
+    m.emplace(12, "x");
+    assert (false);
+  }
+  catch (int) {}
+  hashes_left = -1;
+  assert (m.bucket_count() == 16 && m.size() == 12);
+  for (int i = 0; i != 12; ++i)
+    assert (m.find(i)->second == std::string(40, char('a' + i)));
+
+  m.emplace(12, "x");
+  assert (m.bucket_count() == 32 && m.size() == 13);
+  for (int i = 0; i != 12; ++i)
+    assert (m.find(i)->second == std::string(40, char('a' + i)));
+}
+
+struct SeededHash
+{
+  std::uint64_t seed;
+  explicit SeededHash(std::uint64_t s = 0) : seed(s) {}
+  template <typename M>
+  std::size_t operator()(const M& m) const { return std::size_t(hash_by_representation()(m) ^ seed); }
+};
+
+struct TaggedEq
+{
+  int tag;
+  explicit TaggedEq(int t = 0) : tag(t) {}
+  template <typename M>
+  bool operator()(const M& l, const M& r) const { return equal_by_representation()(l, r); }
+};
+
+// copies keep the state of Hash and Eq
+void test_copy_keeps_hash_and_eq()
+{
+  typedef markable_flat_map<mark_id, int, SeededHash, TaggedEq> map_type;
+  map_type m (SeededHash(0x5eed), TaggedEq(7));
+  for (std::uint32_t i = 0; i != 100; ++i)
+    m.emplace(i, int(i));
+
+  map_type c (m);
+  assert (c.hash_function().seed == 0x5eed && c.key_eq().tag == 7);
+  assert (c.size() == 100);
+  for (std::uint32_t i = 0; i != 100; ++i)
+    assert (c.find(i)->second == int(i));
+
+  map_type a;
+  a = m;
+  assert (a.hash_function().seed == 0x5eed && a.key_eq().tag == 7);
+
+  typedef markable_flat_set<mark_id, SeededHash, TaggedEq> set_type;
+  set_type s (SeededHash(0x5eed), TaggedEq(7));
+  s.insert(1);
+  set_type t (s);
+  assert (t.hash_function().seed == 0x5eed && t.key_eq().tag == 7);
+  assert (t.contains(1) && !t.contains(2));
+}
+
+int main()
+{
+  test_set_has_no_control_bytes();
+  test_map_basic();
+  test_map_against_reference();
+  test_map_present_key_keeps_iterators();
+  test_map_value_lifetime();
+  test_map_rehash_exception_safety();
+  test_map_rehash_hash_exception_safety();
+  test_copy_keeps_hash_and_eq();
+}
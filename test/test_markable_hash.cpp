@@ -0,0 +1,197 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_hash.hpp"
+#include "../include/ak_toolkit/markable_flat_map.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace ak_toolkit;
+
+enum class Dir { N, E, S, W };
+
+std::uint32_t next_random(std::uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+const simd_level levels[] = { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 };
+
+// bit by bit, as in the specification of CRC-32C
+std::uint32_t reference_crc32c(const unsigned char* p, std::size_t n)
+{
+  std::uint32_t crc = ~0u;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    crc ^= p[i];
+    for (int k = 0; k != 8; ++k)
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+  }
+  return ~crc;
+}
+
+void test_crc32c()
+{
+  const unsigned char check[] = "123456789";
+  assert (reference_crc32c(check, 9) == 0xE3069283u);
+
+  std::uint32_t seed = 5;
+  for (int i = 0; i != 1000; ++i)
+  {
+    const std::uint64_t b = (std::uint64_t(next_random(seed)) << 40) ^ (std::uint64_t(next_random(seed)) << 16) ^ next_random(seed);
+    unsigned char bytes[8];
+    for (int k = 0; k != 8; ++k)
+      bytes[k] = (unsigned char)(b >> (8 * k));
+    assert (crc32c_hash::hash_bits(b) == reference_crc32c(bytes, 8));
+    assert (markable_ns::detail_::crc32c_update_software(~0u, b) == ~reference_crc32c(bytes, 8));
+  }
+}
+
+void test_mum()
+{
+  // the portable 128-bit product
+  const std::uint64_t a = 0xFEDCBA9876543210ull, b = 0x0123456789ABCDEFull;
+  __extension__ typedef unsigned __int128 uint128;
+  const uint128 p = uint128(a) * b;
+  assert (markable_ns::detail_::mum(a, b) == (std::uint64_t(p) ^ std::uint64_t(p >> 64)));
+  assert (markable_ns::detail_::mum(~0ull, ~0ull) == (1ull ^ 0xFFFFFFFFFFFFFFFEull));
+}
+
+// hash_batch at every level gives the hashes of single markables
+template <typename MP, typename Hash>
+void test_batch(std::vector<typename MP::representation_type> const& v)
+{
+  std::vector<std::uint64_t> expected (v.size());
+  for (std::size_t i = 0; i != v.size(); ++i)
+    expected[i] = Hash()(markable<MP>(with_representation, v[i]));
+
+  for (simd_level level : levels)
+    for (std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(7), std::size_t(9), v.size() })
+    {
+      std::vector<std::uint64_t> out (n + 1, 42);
+      hash_batch<MP>(v.data(), n, out.data(), Hash(), level);
+      assert (std::equal(out.begin(), out.begin() + n, expected.begin()));
+      assert (out[n] == 42);
+    }
+}
+
+template <typename MP>
+void test_batch_all(std::vector<typename MP::representation_type> const& v)
+{
+  test_batch<MP, fibonacci_hash>(v);
+  test_batch<MP, wy_hash>(v);
+  test_batch<MP, crc32c_hash>(v);
+  test_batch<MP, hash_by_representation>(v);
+}
+
+void test_hash_batch()
+{
+  std::uint32_t seed = 9;
+  const std::size_t n = 1000;
+  std::vector<std::int8_t> i8 (n);
+  std::vector<std::uint16_t> u16 (n);
+  std::vector<std::int32_t> i32 (n);
+  std::vector<std::int64_t> i64 (n);
+  std::vector<double> f64 (n);
+  std::vector<int> dirs (n);
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    const std::uint32_t r = next_random(seed);
+    i8[i] = std::int8_t(r);
+    u16[i] = std::uint16_t(r);
+    i32[i] = std::int32_t(r * 2654435761u);
+    i64[i] = std::int64_t((std::uint64_t(r) << 40) ^ next_random(seed)) * (r % 2 ? -1 : 1);
+    f64[i] = r % 5 == 0 ? std::numeric_limits<double>::quiet_NaN() : double(r) / 3;
+    dirs[i] = r % 5 == 0 ? -1 : int(r % 4);
+  }
+
+  test_batch_all<mark_int<std::int8_t, -1>>(i8);
+  test_batch_all<mark_int<std::uint16_t, 0>>(u16);
+  test_batch_all<mark_int<std::int32_t, -1>>(i32);
+  test_batch_all<mark_int<std::int64_t, -1>>(i64);
+  test_batch_all<mark_fp_nan<double>>(f64);
+  test_batch_all<mark_enum<Dir, -1>>(dirs);
+
+  // span and vector overloads
+  markable_vector<mark_int<std::int32_t, -1>> mv (5);
+  mv[1] = markable<mark_int<std::int32_t, -1>>(7);
+  std::uint64_t out[5], out2[5];
+  hash_batch(mv, out);
+  hash_batch(const_markable_span<mark_int<std::int32_t, -1>>(mv), out2, fibonacci_hash());
+  assert (out[1] == wy_hash()(markable<mark_int<std::int32_t, -1>>(7)));
+  assert (out[0] == out[2] && out[0] != out[1]);
+  assert (out2[1] == fibonacci_hash::hash_bits(7));
+}
+
+int popcount64(std::uint64_t x)
+{
+  int ans = 0;
+  for (; x; x &= x - 1)
+    ++ans;
+  return ans;
+}
+
+// sequential keys spread over buckets; flipping one bit of the key flips
+// about half of the bits of wy_hash
+void test_distribution()
+{
+  const unsigned buckets = 256;
+  std::vector<unsigned> high (buckets, 0), low (buckets, 0), fib_high (buckets, 0);
+  for (std::uint64_t k = 0; k != 64 * buckets; ++k)
+  {
+    ++high[wy_hash::hash_bits(k) >> 56];
+    ++low[wy_hash::hash_bits(k) & 0xFF];
+    ++fib_high[fibonacci_hash::hash_bits(k) >> 56];
+  }
+  for (unsigned b = 0; b != buckets; ++b)
+  {
+    assert (high[b] > 24 && high[b] < 112);
+    assert (low[b] > 24 && low[b] < 112);
+    assert (fib_high[b] > 56 && fib_high[b] < 72);
+  }
+
+  std::uint32_t seed = 1;
+  long flipped = 0;
+  const int trials = 2000;
+  for (int t = 0; t != trials; ++t)
+  {
+    const std::uint64_t k = (std::uint64_t(next_random(seed)) << 32) ^ next_random(seed);
+    flipped += popcount64(wy_hash::hash_bits(k) ^ wy_hash::hash_bits(k ^ (1ull << (t % 64))));
+  }
+  assert (flipped > 30 * trials && flipped < 34 * trials);
+}
+
+void test_as_table_hash()
+{
+  typedef mark_int<int, -1> MP;
+  markable_flat_set<MP, wy_hash> s;
+  markable_flat_map<MP, int, crc32c_hash> m;
+  for (int i = 0; i != 1000; ++i)
+  {
+    s.insert(i * 64);
+    m.insert(i * 64, i);
+  }
+  for (int i = 0; i != 1000; ++i)
+  {
+    assert (s.contains(i * 64));
+    assert (m[i * 64] == i);
+    assert (!s.contains(i * 64 + 1));
+  }
+}
+
+int main()
+{
+  test_crc32c();
+  test_mum();
+  test_hash_batch();
+  test_distribution();
+  test_as_table_hash();
+}
@@ -0,0 +1,220 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_hash_join.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace ak_toolkit;
+
+enum class Dir { N, E, S, W };
+
+std::uint32_t next_random(std::uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+typedef mark_int<int, -1> mp_int;
+typedef std::uint32_t group_id;
+
+std::vector<int> random_keys(std::size_t n, std::uint32_t range, std::uint32_t seed)
+{
+  std::vector<int> v (n);
+  for (int& k : v)
+    k = next_random(seed) % 7 == 0 ? -1 : int(next_random(seed) % range);
+  return v;
+}
+
+// groups against a std::map from keys to ids of first occurrence
+template <typename OP>
+void test_group_by_ints(std::size_t n, std::uint32_t range)
+{
+  const std::vector<int> keys = random_keys(n, range, 17);
+  markable_hash_group_by<mp_int, OP> groups;
+  std::vector<group_id> ids (n);
+  // in two parts, to check that groups persist between calls
+  const_markable_span<mp_int, OP> all (keys.data(), n);
+  groups.group(all.subspan(0, n / 3), ids.data());
+  groups.group(all.subspan(n / 3, n - n / 3), ids.data() + n / 3);
+
+  std::map<int, group_id> expected;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    const auto it = expected.insert(std::make_pair(keys[i], group_id(expected.size()))).first;
+    assert (ids[i] == it->second);
+  }
+  assert (groups.group_count() == expected.size());
+  for (const auto& e : expected)
+  {
+    assert (groups.keys()[e.second].has_value() == (e.first != -1));
+    assert (groups.key(e.second).representation_value() == e.first);
+  }
+  assert (groups.null_group() == (expected.count(-1) ? expected[-1] : groups.no_group));
+
+  // find does not add groups
+  const std::vector<int> probes = { 0, int(range), int(range) + 1, -1 };
+  group_id found[4];
+  groups.find(const_markable_span<mp_int, OP>(probes.data(), probes.size()), found);
+  assert (found[0] == (expected.count(0) ? expected[0] : groups.no_group));
+  assert (found[1] == groups.no_group);
+  assert (found[2] == groups.no_group);
+  assert (found[3] == groups.null_group());
+  assert (groups.group_count() == expected.size());
+}
+
+void test_group_by_empty()
+{
+  markable_hash_group_by<mp_int> groups;
+  group_id ids[2];
+  const int keys[2] = { 1, -1 };
+  groups.find(const_markable_span<mp_int>(keys, 2), ids);
+  assert (ids[0] == groups.no_group && ids[1] == groups.no_group);
+  groups.group(const_markable_span<mp_int>(keys, 0), ids);
+  assert (groups.group_count() == 0);
+  groups.group(const_markable_span<mp_int>(keys + 1, 1), ids);
+  assert (ids[0] == 0 && groups.null_group() == 0);
+  groups.find(const_markable_span<mp_int>(keys, 2), ids);
+  assert (ids[0] == groups.no_group && ids[1] == 0);
+}
+
+// -0.0 and +0.0 are equal values with different representations; all NaNs
+// are keys without value
+void test_group_by_semantics()
+{
+  typedef mark_fp_nan<double> mp;
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const std::vector<double> keys = { 0.0, -0.0, 1.5, nan, -nan, 1.5, 0.0 };
+  std::vector<group_id> ids (keys.size());
+
+  markable_hash_group_by<mp, order_by_value> by_value;
+  by_value.group(const_markable_span<mp, order_by_value>(keys.data(), keys.size()), ids.data());
+  assert (by_value.group_count() == 3);
+  assert ((ids == std::vector<group_id>{ 0, 0, 1, 2, 2, 1, 0 }));
+  assert (by_value.null_group() == 2);
+  assert (!by_value.key(2).has_value());
+
+  markable_hash_group_by<mp, order_by_representation> by_representation;
+  by_representation.group(const_markable_span<mp, order_by_representation>(keys.data(), keys.size()), ids.data());
+  assert (by_representation.group_count() == 4);
+  assert ((ids == std::vector<group_id>{ 0, 1, 2, 3, 3, 2, 0 }));
+}
+
+void test_group_by_enums()
+{
+  typedef mark_enum<Dir, -1> mp;
+  const std::vector<int> keys = { int(Dir::N), -1, int(Dir::W), int(Dir::N), -1 };
+  std::vector<group_id> ids (keys.size());
+  markable_hash_group_by<mp, order_by_value> groups;
+  groups.group(const_markable_span<mp, order_by_value>(keys.data(), keys.size()), ids.data());
+  assert ((ids == std::vector<group_id>{ 0, 1, 2, 0, 1 }));
+  assert (groups.key(2).value() == Dir::W);
+
+  // any Hash and Eq
+  markable_hash_group_by<mp, order_by_value, hash_by_representation, equal_by_representation> plain;
+  plain.group(const_markable_span<mp, order_by_value>(keys.data(), keys.size()), ids.data());
+  assert ((ids == std::vector<group_id>{ 0, 1, 2, 0, 1 }));
+}
+
+void test_group_aggregates()
+{
+  const std::vector<int> keys = { 1, 2, -1, 1, 2, 1 };
+  const std::vector<int> values = { 10, -1, 5, 20, 7, -1 };
+  std::vector<group_id> ids (keys.size());
+  markable_hash_group_by<mp_int> groups;
+  groups.group(const_markable_span<mp_int>(keys.data(), keys.size()), ids.data());
+
+  std::vector<std::size_t> rows (groups.group_count(), 0);
+  count_group_rows(ids.data(), ids.size(), rows.data());
+  assert ((rows == std::vector<std::size_t>{ 3, 2, 1 }));
+
+  struct sum_count { long sum; int count; };
+  std::vector<sum_count> states (groups.group_count(), sum_count{0, 0});
+  aggregate_group_values(ids.data(), const_markable_span<mp_int>(values.data(), values.size()), states.data(),
+                         [](sum_count& s, int v) { s.sum += v; ++s.count; });
+  assert (states[0].sum == 30 && states[0].count == 2);
+  assert (states[1].sum == 7 && states[1].count == 1);
+  assert (states[2].sum == 5 && states[2].count == 1); // the group of keys without value
+}
+
+void test_join(std::size_t build_n, std::size_t probe_n, std::uint32_t range)
+{
+  const std::vector<int> build = random_keys(build_n, range, 3);
+  const std::vector<int> probe = random_keys(probe_n, range, 4);
+  markable_hash_join<mp_int> join (const_markable_span<mp_int>(build.data(), build.size()));
+
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> expected;
+  for (std::size_t i = 0; i != probe_n; ++i)
+    for (std::size_t j = 0; j != build_n; ++j)
+      if (probe[i] != -1 && probe[i] == build[j])
+        expected.push_back(std::make_pair(std::uint32_t(i), std::uint32_t(j)));
+
+  std::vector<std::uint32_t> probe_rows (1, 99), build_rows (1, 99); // appended to
+  const std::size_t n = join.probe(const_markable_span<mp_int>(probe.data(), probe.size()), probe_rows, build_rows);
+  assert (n == expected.size());
+  assert (probe_rows.size() == n + 1 && probe_rows[0] == 99 && build_rows[0] == 99);
+  for (std::size_t k = 0; k != n; ++k)
+  {
+    assert (probe_rows[k + 1] == expected[k].first);
+    assert (build_rows[k + 1] == expected[k].second);
+  }
+
+  // each vector is appended to at its own end
+  std::vector<std::uint32_t> more_probe_rows, more_build_rows (3, 99);
+  assert (join.probe(const_markable_span<mp_int>(probe.data(), probe.size()), more_probe_rows, more_build_rows) == n);
+  assert (more_probe_rows.size() == n && more_build_rows.size() == n + 3);
+  assert (std::equal(more_probe_rows.begin(), more_probe_rows.end(), probe_rows.begin() + 1));
+  assert (std::equal(more_build_rows.begin() + 3, more_build_rows.end(), build_rows.begin() + 1));
+  assert (more_build_rows[0] == 99 && more_build_rows[2] == 99);
+
+  std::vector<std::uint32_t> counts (probe_n, 42);
+  join.count_matches(const_markable_span<mp_int>(probe.data(), probe.size()), counts.data());
+  for (std::size_t i = 0; i != probe_n; ++i)
+    assert (counts[i] == std::count_if(expected.begin(), expected.end(), [&](const std::pair<std::uint32_t, std::uint32_t>& e) { return e.first == i; }));
+
+  std::size_t with_key = build_n - std::size_t(std::count(build.begin(), build.end(), -1));
+  assert (join.build_size() == with_key);
+}
+
+void test_join_semantics()
+{
+  typedef mark_fp_nan<double> mp;
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const std::vector<double> build = { 0.0, nan, 2.0 };
+  const std::vector<double> probe = { -0.0, nan, 2.0 };
+  std::vector<std::uint32_t> counts (3);
+
+  markable_hash_join<mp, order_by_value> by_value (const_markable_span<mp, order_by_value>(build.data(), build.size()));
+  by_value.count_matches(const_markable_span<mp, order_by_value>(probe.data(), probe.size()), counts.data());
+  assert ((counts == std::vector<std::uint32_t>{ 1, 0, 1 }));
+
+  markable_hash_join<mp, order_by_representation> by_representation (const_markable_span<mp, order_by_representation>(build.data(), build.size()));
+  by_representation.count_matches(const_markable_span<mp, order_by_representation>(probe.data(), probe.size()), counts.data());
+  assert ((counts == std::vector<std::uint32_t>{ 0, 0, 1 }));
+  assert (by_representation.build_size() == 2);
+}
+
+int main()
+{
+  test_group_by_ints<order_none>(10, 5);
+  test_group_by_ints<order_none>(1000, 50);
+  test_group_by_ints<order_by_value>(20000, 3000);
+  test_group_by_ints<order_by_representation>(20000, 1u << 30);
+  test_group_by_empty();
+  test_group_by_semantics();
+  test_group_by_enums();
+  test_group_aggregates();
+  test_join(0, 10, 5);
+  test_join(100, 0, 5);
+  test_join(100, 1000, 30);
+  test_join(2000, 700, 5000);
+  test_join_semantics();
+}
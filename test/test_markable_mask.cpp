@@ -0,0 +1,211 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_mask.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+using namespace ak_toolkit;
+
+const simd_level all_levels[] = { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 };
+
+template <typename MP>
+bool mask_is_correct(const std::vector<markable<MP>>& v, simd_level level)
+{
+  std::vector<std::uint64_t> mask ((v.size() + 63) / 64 + 1, 0xDEADBEEF);
+  compute_value_mask(v.data(), v.size(), mask.data(), level);
+
+  for (std::size_t i = 0; i != v.size(); ++i)
+    if (bool((mask[i / 64] >> (i % 64)) & 1) != v[i].has_value())
+      return false;
+
+  if (v.size() % 64 != 0 && (mask[v.size() / 64] >> (v.size() % 64)) != 0)
+    return false; // trailing bits must be zero
+
+  return mask.back() == 0xDEADBEEF; // no overrun
+}
+
+template <typename T, T Val>
+void test_mark_int_mask()
+{
+  typedef markable<mark_int<T, Val>> opt_t;
+  std::uint32_t seed = 12345;
+
+  for (std::size_t n : {0, 1, 63, 64, 65, 200, 1000})
+  {
+    std::vector<opt_t> v;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      if (seed % 3 == 0)
+        v.push_back(opt_t());
+      else
+        v.push_back(opt_t(T(seed >> 8)));
+    }
+
+    for (simd_level level : all_levels)
+      assert (mask_is_correct(v, level));
+  }
+}
+
+enum class Dir { N, E, S, W };
+
+void test_mark_enum_mask()
+{
+  typedef markable<mark_enum<Dir, -1>> opt_dir;
+  std::vector<opt_dir> v;
+  for (int i = 0; i != 300; ++i)
+    v.push_back(i % 5 == 0 ? opt_dir() : opt_dir(Dir(i % 4)));
+
+  for (simd_level level : all_levels)
+    assert (mask_is_correct(v, level));
+}
+
+void test_mark_fp_nan_mask()
+{
+  typedef markable<mark_fp_nan<double>> opt_double;
+  static_assert (std::is_same<markable_ns::detail_::kernel_tag<mark_fp_nan<double>>::type, markable_ns::detail_::nan_kernel_tag>::value, "not the NaN kernel");
+  std::vector<opt_double> v;
+  for (int i = 0; i != 130; ++i)
+    v.push_back(i % 7 == 0 ? opt_double() : opt_double(i * 0.5));
+
+  for (simd_level level : all_levels)
+    assert (mask_is_correct(v, level));
+}
+
+// policies without SIMD kernels: every level falls back to MP::is_marked_value
+void test_generic_policy_mask()
+{
+  typedef mark_value_init<int> mp_init;
+  typedef mark_int_range<int, -3, -1> mp_range;
+  static_assert (std::is_same<markable_ns::detail_::kernel_tag<mp_init>::type, markable_ns::detail_::generic_kernel_tag>::value, "not the generic path");
+  static_assert (std::is_same<markable_ns::detail_::kernel_tag<mp_range>::type, markable_ns::detail_::generic_kernel_tag>::value, "not the generic path");
+
+  std::vector<markable<mp_init>> v;
+  std::vector<markable<mp_range>> w;
+  for (int i = 0; i != 130; ++i)
+  {
+    v.push_back(markable<mp_init>(i % 7 == 0 ? 0 : i));
+    w.push_back(markable<mp_range>(with_representation, i % 5 - 3));
+  }
+
+  for (simd_level level : all_levels)
+  {
+    assert (mask_is_correct(v, level));
+    assert (mask_is_correct(w, level));
+  }
+}
+
+void test_markable_vector_mask()
+{
+  typedef markable<mark_int<int, 0>> opt_int;
+  markable_vector<mark_int<int, 0>> v (70);
+  v[3] = opt_int(3);
+  v[69] = opt_int(69);
+
+  std::uint64_t mask[2];
+  compute_value_mask(v, mask);
+  assert (mask[0] == std::uint64_t(1) << 3);
+  assert (mask[1] == std::uint64_t(1) << 5);
+}
+
+// converts to values and a bitmap and back at every level
+template <typename MP>
+void test_values_and_mask_round_trip(const std::vector<typename MP::representation_type>& reps,
+                                     const typename MP::representation_type& fill)
+{
+  typedef typename MP::representation_type rep_t;
+  const std::size_t n = reps.size();
+
+  for (simd_level level : all_levels)
+  {
+    std::vector<rep_t> values (n);
+    std::vector<std::uint64_t> mask ((n + 63) / 64 + 1, 0xDEADBEEF);
+    to_values_and_mask<MP>(reps.data(), n, values.data(), mask.data(), fill, level);
+    assert (mask.back() == 0xDEADBEEF);
+
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const bool bit = (mask[i / 64] >> (i % 64)) & 1;
+      assert (bit == !MP::is_marked_value(reps[i]));
+      assert (std::memcmp(&values[i], bit ? &reps[i] : &fill, sizeof(rep_t)) == 0);
+    }
+
+    std::vector<rep_t> back (n);
+    from_values_and_mask<MP>(values.data(), mask.data(), n, back.data(), level);
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      assert (MP::is_marked_value(back[i]) == MP::is_marked_value(reps[i]));
+      if (!MP::is_marked_value(reps[i]))
+        assert (back[i] == reps[i]);
+    }
+
+    from_values_and_mask<MP>(values.data(), mask.data(), n, values.data(), level); // in place
+    for (std::size_t i = 0; i != n; ++i)
+      assert (MP::is_marked_value(values[i]) == MP::is_marked_value(reps[i]));
+  }
+}
+
+template <typename MP, typename F>
+void test_values_and_mask(F make_value, const typename MP::representation_type& fill)
+{
+  for (std::size_t n : {0, 1, 63, 64, 65, 200, 1000})
+  {
+    std::vector<typename MP::representation_type> reps;
+    for (std::size_t i = 0; i != n; ++i)
+      reps.push_back(i % 3 == 1 || i % 64 == 63 ? MP::marked_value() : make_value(i));
+    test_values_and_mask_round_trip<MP>(reps, fill);
+  }
+}
+
+void test_values_and_mask_policies()
+{
+  test_values_and_mask<mark_int<std::int8_t, -1>>([](std::size_t i) { return std::int8_t(i % 100); }, 0);
+  test_values_and_mask<mark_int<std::uint16_t, 7>>([](std::size_t i) { return std::uint16_t(i * 3 + 8); }, 0);
+  test_values_and_mask<mark_int<std::int32_t, -1>>([](std::size_t i) { return std::int32_t(i * 7); }, 42);
+  test_values_and_mask<mark_int<std::int64_t, -1>>([](std::size_t i) { return std::int64_t(i) << 33; }, 0);
+  test_values_and_mask<mark_fp_nan<float>>([](std::size_t i) { return float(i) * 0.5f; }, 0.0f);
+  test_values_and_mask<mark_fp_nan<double>>([](std::size_t i) { return double(i) * 0.25; }, -1.0);
+  test_values_and_mask<mark_enum<Dir, -1>>([](std::size_t i) { return int(i % 4); }, 0);
+  test_values_and_mask<mark_bool>([](std::size_t i) { return char(i % 2); }, char(0));
+}
+
+void test_values_and_mask_spans()
+{
+  typedef mark_int<int, -1> mark_id;
+  int buffer[] = { 1, -1, 3 };
+  int values[3];
+  std::uint64_t mask[1];
+  to_values_and_mask(const_markable_span<mark_id>(buffer, 3), values, mask);
+  assert (mask[0] == 5);
+  assert (values[1] == 0);
+
+  int out[3];
+  from_values_and_mask(values, mask, markable_span<mark_id>(out, 3));
+  assert (out[0] == 1 && out[1] == -1 && out[2] == 3);
+}
+
+int main()
+{
+  test_mark_int_mask<std::int8_t, -1>();
+  test_mark_int_mask<std::uint8_t, 0>();
+  test_mark_int_mask<std::int16_t, -1>();
+  test_mark_int_mask<std::uint16_t, 7>();
+  test_mark_int_mask<std::int32_t, -1>();
+  test_mark_int_mask<std::uint32_t, 0>();
+  test_mark_int_mask<std::int64_t, std::numeric_limits<std::int64_t>::min()>();
+  test_mark_int_mask<std::uint64_t, ~std::uint64_t(0)>();
+  test_mark_int_mask<bool, false>();
+  test_mark_enum_mask();
+  test_mark_fp_nan_mask();
+  test_generic_policy_mask();
+  test_markable_vector_mask();
+  test_values_and_mask_policies();
+  test_values_and_mask_spans();
+}
@@ -0,0 +1,245 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_parallel.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace ak_toolkit;
+
+std::uint32_t next_random(std::uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+const unsigned thread_counts[] = { 1, 2, 3, 8 };
+const std::size_t sizes[] = { 0, 1, 63, 64, 1000, 4097, 20000 };
+
+void test_each_chunk_once()
+{
+  for (unsigned t : thread_counts)
+  {
+    markable_thread_pool pool (t);
+    assert (pool.thread_count() == t);
+    for (std::size_t chunks : { 0, 1, 2, 7, 1000 })
+    {
+      std::vector<std::atomic<int>> calls (chunks);
+      for (std::atomic<int>& c : calls)
+        c = 0;
+      pool.for_each_chunk(chunks, [&](std::size_t i) { ++calls[i]; });
+      for (std::atomic<int>& c : calls)
+        assert (c == 1);
+    }
+  }
+}
+
+void test_exception()
+{
+  for (unsigned t : thread_counts)
+  {
+    markable_thread_pool pool (t);
+    std::atomic<int> after (0);
+    try {
+      pool.for_each_chunk(100, [&](std::size_t i) {
+        if (i == 3)
+          throw std::runtime_error("chunk 3");
+      });
+      assert (false);
+    }
+    catch (const std::runtime_error&) {}
+
+    // the pool remains usable
+    pool.for_each_chunk(100, [&](std::size_t) { ++after; });
+    assert (after == 100);
+  }
+}
+
+void test_chunk_elements()
+{
+  markable_thread_pool pool (1, 4096);
+  assert (pool.chunk_bytes() == 4096);
+  assert (pool.chunk_elements<std::int32_t>() == 1024);
+  assert (pool.chunk_elements<double>() == 512);
+  markable_thread_pool tiny (1, 1);
+  assert (tiny.chunk_elements<double>() == 64);
+}
+
+template <typename T>
+bool same_summary(const int_summary<T>& l, const int_summary<T>& r)
+{
+  return l.count == r.count && l.sum == r.sum && l.overflow == r.overflow && l.min == r.min && l.max == r.max;
+}
+
+template <typename T>
+bool same_summary(const fp_summary<T>& l, const fp_summary<T>& r)
+{
+  return l.count == r.count && std::memcmp(&l.sum, &r.sum, sizeof(T)) == 0 && l.min == r.min && l.max == r.max;
+}
+
+void test_int_summarize()
+{
+  typedef mark_int<std::int32_t, -1> MP;
+  std::uint32_t seed = 7;
+  for (std::size_t n : sizes)
+  {
+    std::vector<std::int32_t> v (n);
+    for (std::int32_t& e : v)
+      e = next_random(seed) % 5 == 0 ? -1 : std::int32_t(next_random(seed));
+
+    const int_summary<std::int32_t> expected = summarize<MP>(v.data(), n);
+    for (unsigned t : thread_counts)
+    {
+      markable_thread_pool pool (t, 256);
+      assert (same_summary(parallel_summarize<MP>(pool, v.data(), n), expected));
+    }
+  }
+
+  // overflow is detected on the total, not on chunks
+  typedef mark_int<std::int64_t, 0> MP64;
+  std::vector<std::int64_t> big (2000, std::numeric_limits<std::int64_t>::max() / 1000);
+  markable_thread_pool pool (3, 256);
+  assert (parallel_summarize<MP64>(pool, big.data(), 1000).overflow == false);
+  assert (parallel_summarize<MP64>(pool, big.data(), 2000).overflow == true);
+  for (std::size_t i = 1000; i != 2000; ++i)
+    big[i] = -big[i];
+  assert (parallel_summarize<MP64>(pool, big.data(), 2000).overflow == false);
+  assert (parallel_summarize<MP64>(pool, big.data(), 2000).sum == 0);
+}
+
+void test_fp_summarize()
+{
+  typedef mark_fp_nan<double> MP;
+  std::uint32_t seed = 11;
+  for (std::size_t n : sizes)
+  {
+    std::vector<double> v (n);
+    for (double& e : v)
+      e = next_random(seed) % 5 == 0 ? std::numeric_limits<double>::quiet_NaN() : double(next_random(seed) % 1000) / 7.0;
+
+    for (summation m : { summation::simple, summation::pairwise, summation::kahan })
+    {
+      markable_thread_pool one (1, 512);
+      const fp_summary<double> expected = parallel_summarize<MP>(one, v.data(), n, m);
+      assert (expected.count == summarize<MP>(v.data(), n).count);
+      for (unsigned t : thread_counts)
+      {
+        markable_thread_pool pool (t, 512);
+        assert (same_summary(parallel_summarize<MP>(pool, v.data(), n, m), expected));
+      }
+    }
+
+    // sums of integers are exact, so equal to the serial ones
+    for (double& e : v)
+      if (e == e)
+        e = double(int(e));
+    markable_thread_pool pool (3, 512);
+    const fp_summary<double> serial = summarize<MP>(v.data(), n);
+    const fp_summary<double> parallel = parallel_summarize<MP>(pool, v.data(), n);
+    assert (parallel.count == serial.count);
+    assert (parallel.sum == serial.sum);
+    if (n != 0)
+    {
+      assert (parallel.min == serial.min);
+      assert (parallel.max == serial.max);
+    }
+  }
+
+  // the sums of the 16 chunks fit, and so does that of the first 15
+  std::vector<double> big (1024, std::numeric_limits<double>::max() / (15.5 * 64));
+  for (summation m : { summation::simple, summation::pairwise, summation::kahan })
+    for (unsigned t : thread_counts)
+    {
+      markable_thread_pool pool (t, 512);
+      assert (parallel_summarize<MP>(pool, big.data(), big.size(), m).sum == std::numeric_limits<double>::infinity());
+    }
+}
+
+// any policy whose storage is the representation, with or without simd kernels
+void test_generic_policies()
+{
+  typedef mark_int<std::int16_t, -1> MP;
+  typedef mark_fp_nan<long double> LP;
+  std::uint32_t seed = 3;
+  for (std::size_t n : sizes)
+  {
+    std::vector<std::int16_t> v (n);
+    std::vector<long double> w (n);
+    std::size_t count = 0;
+    for (std::size_t i = 0; i != n; ++i)
+    {
+      const bool has = next_random(seed) % 3 != 0;
+      v[i] = has ? std::int16_t(next_random(seed) % 1000) : std::int16_t(-1);
+      w[i] = has ? (long double)(v[i]) : std::numeric_limits<long double>::quiet_NaN();
+      count += has;
+    }
+
+    for (unsigned t : thread_counts)
+    {
+      markable_thread_pool pool (t, 128);
+      assert (parallel_count_values<MP>(pool, v.data(), n) == count);
+      assert (parallel_count_values<LP>(pool, w.data(), n) == count);
+
+      std::vector<std::int16_t> dense (n, 0);
+      assert (parallel_compact_values<MP>(pool, v.data(), n, dense.data()) == count);
+      std::vector<long double> wdense (n, 0);
+      assert (parallel_compact_values<LP>(pool, w.data(), n, wdense.data()) == count);
+      for (std::size_t i = 0, j = 0; i != n; ++i)
+        if (v[i] != -1)
+        {
+          assert (dense[j] == v[i]);
+          assert (wdense[j] == w[i]);
+          ++j;
+        }
+    }
+  }
+}
+
+void test_fill_and_transform()
+{
+  typedef markable<mark_int<int, -1>> opt_int;
+  typedef markable<mark_fp_nan<double>> opt_double;
+  for (std::size_t n : sizes)
+    for (unsigned t : thread_counts)
+    {
+      markable_thread_pool pool (t, 256);
+      markable_vector<mark_int<int, -1>> v (n);
+      parallel_fill(pool, markable_span<mark_int<int, -1>>(v), opt_int(5));
+      for (std::size_t i = 0; i != n; ++i)
+        assert (v[i].has_value() && v[i].value() == 5);
+      for (std::size_t i = 0; i < n; i += 3)
+        v[i] = opt_int();
+
+      markable_vector<mark_fp_nan<double>> out (n);
+      parallel_transform(pool, const_markable_span<mark_int<int, -1>>(v), markable_span<mark_fp_nan<double>>(out),
+                         [](markable_cref<mark_int<int, -1>> r) { return r.has_value() ? opt_double(r.value() / 2.0) : opt_double(); });
+      for (std::size_t i = 0; i != n; ++i)
+      {
+        assert (out[i].has_value() == (i % 3 != 0));
+        if (i % 3 != 0)
+          assert (out[i].value() == 2.5);
+      }
+
+      parallel_fill(pool, markable_span<mark_int<int, -1>>(v), opt_int());
+      assert (parallel_count_values(pool, const_markable_span<mark_int<int, -1>>(v)) == 0);
+    }
+}
+
+int main()
+{
+  test_each_chunk_once();
+  test_exception();
+  test_chunk_elements();
+  test_int_summarize();
+  test_fp_summarize();
+  test_generic_policies();
+  test_fill_and_transform();
+}
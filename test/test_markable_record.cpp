@@ -0,0 +1,125 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_record.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+using namespace ak_toolkit;
+
+// int, double, bool and short have marked values; float and std::uint16_t use presence bits
+typedef markable_record<mark_int<int, -1>, mark_bool, float, mark_fp_nan<double>, std::uint16_t, mark_int<short, -1>> row;
+
+void test_layout()
+{
+  static_assert (row::field_count() == 6, "wrong field count");
+  static_assert (row::presence_bit_count() == 2, "wrong bit count");
+
+  // double, int, float, uint16_t, short, bool, presence bits
+  static_assert (row::offset_of<3>() == 0, "wrong offset");
+  static_assert (row::offset_of<0>() == 8, "wrong offset");
+  static_assert (row::offset_of<2>() == 12, "wrong offset");
+  static_assert (row::offset_of<4>() == 16, "wrong offset");
+  static_assert (row::offset_of<5>() == 18, "wrong offset");
+  static_assert (row::offset_of<1>() == 20, "wrong offset");
+  static_assert (sizeof(row) == 24, "padding not removed");
+  static_assert (std::is_trivially_copyable<row>::value, "not trivially copyable");
+
+  static_assert (std::is_same<row::reference<0>, markable_ref<mark_int<int, -1>>>::value, "wrong reference type");
+  static_assert (std::is_same<row::reference<2>, markable_bit_ref<float>>::value, "wrong reference type");
+}
+
+void test_default_no_values()
+{
+  row r;
+  assert (!r.get<0>().has_value());
+  assert (!r.get<1>().has_value());
+  assert (!r.get<2>().has_value());
+  assert (!r.get<3>().has_value());
+  assert (!r.get<4>().has_value());
+  assert (!r.get<5>().has_value());
+  assert (r.get<0>().representation_value() == -1);
+}
+
+void test_assign()
+{
+  row r;
+  r.get<0>().assign(10);
+  r.get<1>().assign(true);
+  r.get<2>().assign(2.5f);
+  r.get<3>().assign(0.25);
+  r.get<4>().assign(7);
+
+  assert (r.get<0>().value() == 10);
+  assert (r.get<1>().value() == true);
+  assert (r.get<2>().value() == 2.5f);
+  assert (r.get<3>().value() == 0.25);
+  assert (r.get<4>().value() == 7);
+  assert (!r.get<5>().has_value());
+
+  // fields do not overlap
+  r.get<2>().assign_marked();
+  assert (!r.get<2>().has_value());
+  assert (r.get<4>().value() == 7);
+  assert (r.get<0>().value() == 10);
+
+  r.get<0>() = markable<mark_int<int, -1>>();
+  assert (!r.get<0>().has_value());
+
+  markable<mark_fp_nan<double>> d = r.get<3>();
+  assert (d.value() == 0.25);
+}
+
+void test_copy()
+{
+  row r;
+  r.get<2>().assign(1.5f);
+  r.get<5>().assign(3);
+
+  const row c = r;
+  assert (c.get<2>().value() == 1.5f);
+  assert (c.get<5>().value() == 3);
+  assert (!c.get<4>().has_value());
+
+  row s;
+  s.get<2>() = r.get<2>();
+  assert (s.get<2>().value() == 1.5f);
+
+  row m;
+  std::memcpy(static_cast<void*>(&m), &r, sizeof(row));
+  assert (m.get<2>().value() == 1.5f);
+  assert (m.get<5>().value() == 3);
+}
+
+// more than 8 presence bits occupy more than one byte
+typedef markable_record<char, char, char, char, char, char, char, char, char, mark_int<int, -1>> wide;
+
+void test_many_bits()
+{
+  static_assert (wide::presence_bit_count() == 9, "wrong bit count");
+  static_assert (sizeof(wide) == 16, "wrong size");
+
+  wide w;
+  w.get<8>().assign('x');
+  assert (w.get<8>().value() == 'x');
+  assert (!w.get<0>().has_value());
+  w.get<0>().assign('a');
+  assert (w.get<0>().value() == 'a');
+  assert (w.get<8>().value() == 'x');
+  assert (!w.get<7>().has_value());
+  assert (!w.get<9>().has_value());
+}
+
+int main()
+{
+  test_layout();
+  test_default_no_values();
+  test_assign();
+  test_copy();
+  test_many_bits();
+}
@@ -0,0 +1,138 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_sort.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace ak_toolkit;
+
+enum class Dir { N, E, S, W };
+
+std::uint32_t next_random(std::uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// the order of order_by_value, with no-value elements moved to the end if required
+template <typename MP>
+struct reference_less
+{
+  null_order nulls;
+
+  bool operator()(const typename MP::representation_type& l, const typename MP::representation_type& r) const
+  {
+    markable<MP, order_by_value> ml (with_representation, l), mr (with_representation, r);
+    if (nulls == null_order::last && ml.has_value() != mr.has_value())
+      return ml.has_value();
+    return ml < mr;
+  }
+};
+
+template <typename MP>
+bool equivalent(const typename MP::representation_type& l, const typename MP::representation_type& r)
+{
+  reference_less<MP> less {null_order::first};
+  return !less(l, r) && !less(r, l);
+}
+
+template <typename MP>
+void check_sorts(std::vector<typename MP::representation_type> column)
+{
+  typedef typename MP::representation_type Rep;
+  for (null_order nulls : { null_order::first, null_order::last })
+  {
+    std::vector<Rep> expected = column;
+    std::stable_sort(expected.begin(), expected.end(), reference_less<MP>{nulls});
+
+    std::vector<Rep> stable = column;
+    stable_radix_sort<MP>(stable.data(), stable.size(), nulls);
+    assert (std::equal(stable.begin(), stable.end(), expected.begin(), [](const Rep& l, const Rep& r) {
+      return std::memcmp(&l, &r, sizeof(Rep)) == 0; // the same representations, NaNs included
+    }));
+
+    std::vector<Rep> unstable = column;
+    radix_sort<MP>(unstable.data(), unstable.size(), nulls);
+    for (std::size_t i = 0; i != column.size(); ++i)
+      assert (equivalent<MP>(unstable[i], expected[i]));
+  }
+}
+
+template <typename MP, typename F>
+std::vector<typename MP::representation_type> random_column(std::size_t n, F make)
+{
+  std::vector<typename MP::representation_type> ans;
+  std::uint32_t seed = 4321;
+  for (std::size_t i = 0; i != n; ++i)
+  {
+    std::uint32_t x = next_random(seed);
+    ans.push_back(x % 5 == 0 ? MP::marked_value() : make(x));
+  }
+  return ans;
+}
+
+template <typename MP, typename F>
+void test_random(F make)
+{
+  for (std::size_t n : { 0, 1, 2, 50, 1000, 20000 })
+    check_sorts<MP>(random_column<MP>(n, make));
+}
+
+void test_integers()
+{
+  // marked value at an end of the range, or in the middle of it
+  test_random<mark_int<int, -1>>([](std::uint32_t x) { return int(x % 2000) - 1000; });
+  test_random<mark_int<int, 7>>([](std::uint32_t x) { return int(x % 20) - 5; });
+  test_random<mark_int<int, std::numeric_limits<int>::min()>>([](std::uint32_t x) { return int(x * 2654435761u); });
+  test_random<mark_int<unsigned, std::numeric_limits<unsigned>::max()>>([](std::uint32_t x) { return x * 2654435761u - 1; });
+  test_random<mark_int<std::int8_t, 0>>([](std::uint32_t x) { return std::int8_t(x % 255 - 127 + (x % 255 >= 127)); });
+  test_random<mark_int<std::int64_t, -1>>([](std::uint32_t x) { return std::int64_t(x) * -123456789ll; });
+  test_random<mark_int<std::uint16_t, 300>>([](std::uint32_t x) { return std::uint16_t(x % 600 == 300 ? 301 : x % 600); });
+}
+
+void test_enum_and_bool()
+{
+  test_random<mark_enum<Dir, -1>>([](std::uint32_t x) { return int(x % 4); });
+  test_random<mark_enum<Dir, 2>>([](std::uint32_t x) { return int(x % 4 == 2 ? 3 : x % 4); });
+  test_random<mark_bool>([](std::uint32_t x) { return char(x % 2); });
+}
+
+void test_floating_point()
+{
+  const double special[] = { 0.0, -0.0, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::denorm_min(), -std::numeric_limits<double>::max(), -std::nan("7") };
+  test_random<mark_fp_nan<double>>([&](std::uint32_t x) { return x % 9 < 7 ? special[x % 9] : double(int(x % 200) - 100) / 8; });
+  test_random<mark_fp_nan<float>>([&](std::uint32_t x) { return x % 9 < 7 ? float(special[x % 9]) : float(int(x % 200) - 100) / 8; });
+}
+
+void test_spans_and_vectors()
+{
+  markable_vector<mark_int<int, -1>, order_by_value> v;
+  for (int i : { 3, -1, 2, 1, -1 })
+    v.push_back(markable<mark_int<int, -1>, order_by_value>(with_representation, i));
+
+  radix_sort(v);
+  assert (!v[0].has_value() && !v[1].has_value());
+  assert (v[2].value() == 1 && v[3].value() == 2 && v[4].value() == 3);
+
+  stable_radix_sort(markable_span<mark_int<int, -1>, order_by_value>(v), null_order::last);
+  assert (v[0].value() == 1 && v[2].value() == 3);
+  assert (!v[3].has_value() && !v[4].has_value());
+}
+
+int main()
+{
+  test_integers();
+  test_enum_and_bool();
+  test_floating_point();
+  test_spans_and_vectors();
+}
@@ -0,0 +1,128 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_aggregate.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#if defined __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace ak_toolkit;
+
+typedef mark_int<int, -1> mark_id;
+
+void test_span_over_buffer()
+{
+  int buffer[] = { 1, -1, 3, -1, 5 };
+  markable_span<mark_id> s (buffer, 5);
+  assert (s.size() == 5);
+  assert (s.size_bytes() == sizeof(buffer));
+  assert (s.has_value(0));
+  assert (!s.has_value(1));
+  assert (s.value(2) == 3);
+  assert (s.representation_value(3) == -1);
+  assert (s.count_values() == 3);
+
+  s[1].assign(2);    // writes through to the buffer
+  s[4].assign_marked();
+  assert (buffer[1] == 2);
+  assert (buffer[4] == -1);
+
+  int sum = 0;
+  for (markable_ref<mark_id> r : s)
+    if (r.has_value())
+      sum += r.value();
+  assert (sum == 6);
+
+  const_markable_span<mark_id> c = s.subspan(1, 3);
+  assert (c.size() == 3);
+  assert (c.value(0) == 2);
+  assert (!c.has_value(2));
+  markable<mark_id> m = c[1];
+  assert (m.value() == 3);
+}
+
+void test_from_bytes_checks()
+{
+  alignas(8) unsigned char raw[4 * sizeof(int) + 1] = {};
+  const_markable_span<mark_id> s = const_markable_span<mark_id>::from_bytes(raw, 4 * sizeof(int));
+  assert (s.size() == 4);
+  assert (s.data() == static_cast<const void*>(raw));
+
+  bool thrown = false;
+  try { const_markable_span<mark_id>::from_bytes(raw + 1, 4 * sizeof(int)); }
+  catch (const std::invalid_argument&) { thrown = true; }
+  assert (thrown); // misaligned
+
+  thrown = false;
+  try { markable_span<mark_id>::from_bytes(raw, 4 * sizeof(int) - 1); }
+  catch (const std::invalid_argument&) { thrown = true; }
+  assert (thrown); // not a whole number of elements
+}
+
+void test_vector_views()
+{
+  markable_vector<mark_fp_nan<double>> v (100);
+  v[3] = markable<mark_fp_nan<double>>(1.5);
+  v[70] = markable<mark_fp_nan<double>>(2.5);
+
+  markable_span<mark_fp_nan<double>> s = v;
+  s[4].assign(4.0);
+  assert (v[4].value() == 4.0);
+
+  const_markable_span<mark_fp_nan<double>> c = v;
+  assert (c.count_values() == 3);
+  assert (summarize(c).sum == 8.0);
+
+  std::uint64_t mask[2];
+  compute_value_mask(c, mask);
+  assert (mask[0] == ((1ull << 3) | (1ull << 4)));
+  assert (mask[1] == (1ull << 6));
+}
+
+#if defined __unix__
+void test_memory_mapped_file()
+{
+  const int n = 10000;
+  std::vector<int> column (n);
+  for (int i = 0; i != n; ++i)
+    column[i] = i % 4 == 0 ? -1 : i;
+
+  char path[] = "/tmp/markable_span_XXXXXX";
+  int fd = mkstemp(path);
+  assert (fd != -1);
+  assert (write(fd, column.data(), n * sizeof(int)) == ssize_t(n * sizeof(int)));
+
+  void* p = mmap(nullptr, n * sizeof(int), PROT_READ, MAP_PRIVATE, fd, 0);
+  assert (p != MAP_FAILED);
+  const_markable_span<mark_id> s = const_markable_span<mark_id>::from_bytes(p, n * sizeof(int));
+  assert (s.size() == std::size_t(n));
+  assert (s.count_values() == std::size_t(n - n / 4));
+  assert (!s.has_value(0));
+  assert (s.value(n - 1) == n - 1);
+
+  munmap(p, n * sizeof(int));
+  close(fd);
+  unlink(path);
+}
+#endif
+
+int main()
+{
+  test_span_over_buffer();
+  test_from_bytes_checks();
+  test_vector_views();
+#if defined __unix__
+  test_memory_mapped_file();
+#endif
+}
@@ -0,0 +1,124 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/markable_vector.hpp"
+#include <cassert>
+#include <algorithm>
+#include <cstdint>
+
+using namespace ak_toolkit;
+
+void test_basic_int_vector()
+{
+  typedef markable<mark_int<std::int64_t, -1>> opt_int;
+  markable_vector<mark_int<std::int64_t, -1>> v;
+  assert (v.empty());
+  assert (v.count_values() == 0);
+
+  v.push_back(opt_int(1));
+  v.push_back_marked();
+  v.push_back(opt_int(3));
+  v.push_back(opt_int());
+  assert (v.size() == 4);
+  assert (v.count_values() == 2);
+
+  assert ( v[0].has_value());
+  assert (!v[1].has_value());
+  assert ( v[2].has_value());
+  assert (!v[3].has_value());
+  assert (v[0].value() == 1);
+  assert (v[2].value() == 3);
+
+  const std::int64_t* raw = v.data();
+  assert (raw[0] == 1);
+  assert (raw[1] == -1);
+  assert (raw[2] == 3);
+  assert (raw[3] == -1);
+
+  v[1] = opt_int(2);
+  v[3].assign(4);
+  v[0].assign_marked();
+  assert (!v[0].has_value());
+  assert (v[1].value() == 2);
+  assert (v[3].value() == 4);
+  assert (v.count_values() == 3);
+
+  opt_int o = v[1];
+  assert (o.has_value());
+  assert (o.value() == 2);
+}
+
+void test_resize_fills_with_marked_value()
+{
+  markable_vector<mark_fp_nan<double>> v (3);
+  assert (v.size() == 3);
+  assert (v.count_values() == 0);
+
+  v.resize(5, markable<mark_fp_nan<double>>(1.5));
+  assert (v.count_values() == 2);
+  assert (v[4].value() == 1.5);
+
+  v.resize(7);
+  assert (v.count_values() == 2);
+  double d = v.data()[6];
+  assert (d != d);
+
+  v.resize(4);
+  assert (v.count_values() == 1);
+}
+
+void test_iteration()
+{
+  typedef markable<mark_bool> opt_bool;
+  markable_vector<mark_bool> v;
+  v.push_back(opt_bool(true));
+  v.push_back(opt_bool());
+  v.push_back(opt_bool(false));
+
+  int values = 0, trues = 0;
+  for (markable_cref<mark_bool> r : static_cast<const markable_vector<mark_bool>&>(v))
+  {
+    if (r.has_value())
+    {
+      ++values;
+      trues += r.value();
+    }
+  }
+  assert (values == 2);
+  assert (trues == 1);
+
+  for (markable_ref<mark_bool> r : v)
+    r.assign(true);
+  assert (v.count_values() == 3);
+  assert (std::count_if(v.cbegin(), v.cend(), [](markable_cref<mark_bool> r) { return r.value(); }) == 3);
+}
+
+enum class Dir { N, E, S, W };
+
+void test_sorting_through_proxies()
+{
+  typedef markable<mark_enum<Dir, -1>, order_by_value> opt_dir;
+  markable_vector<mark_enum<Dir, -1>, order_by_value> v;
+  v.push_back(opt_dir(Dir::W));
+  v.push_back_marked();
+  v.push_back(opt_dir(Dir::N));
+  v.push_back(opt_dir(Dir::S));
+
+  std::sort(v.begin(), v.end(), [](opt_dir const& l, opt_dir const& r) { return l < r; });
+  assert (!v[0].has_value());
+  assert (v[1].value() == Dir::N);
+  assert (v[2].value() == Dir::S);
+  assert (v[3].value() == Dir::W);
+  assert (v.end() - v.begin() == 4);
+}
+
+int main()
+{
+  test_basic_int_vector();
+  test_resize_fills_with_marked_value();
+  test_iteration();
+  test_sorting_through_proxies();
+}
@@ -0,0 +1,117 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/packed_markable_bool_array.hpp"
+#include <cassert>
+
+using namespace ak_toolkit;
+
+typedef markable<mark_bool> opt_bool;
+
+const opt_bool tri[] = { opt_bool(false), opt_bool(true), opt_bool() };
+
+bool same(opt_bool l, opt_bool r) { return l.representation_value() == r.representation_value(); }
+
+opt_bool sql_and(opt_bool a, opt_bool b)
+{
+  if ((a.has_value() && !a.value()) || (b.has_value() && !b.value())) return opt_bool(false);
+  if (a.has_value() && b.has_value()) return opt_bool(true);
+  return opt_bool();
+}
+
+opt_bool sql_or(opt_bool a, opt_bool b)
+{
+  if ((a.has_value() && a.value()) || (b.has_value() && b.value())) return opt_bool(true);
+  if (a.has_value() && b.has_value()) return opt_bool(false);
+  return opt_bool();
+}
+
+opt_bool sql_not(opt_bool a)
+{
+  return a.has_value() ? opt_bool(!a.value()) : opt_bool();
+}
+
+void test_element_access()
+{
+  packed_markable_bool_array a (40);
+  assert (a.size() == 40);
+  assert (a.word_count() == 2);
+  assert (a.count_missing() == 40);
+  assert (!a[0].has_value());
+  assert (!a[39].has_value());
+
+  a[0].assign(true);
+  a[1] = opt_bool(false);
+  a[33].assign(true);
+  a[34] = a[0];
+  assert (a[0].value() == true);
+  assert (a[1].value() == false);
+  assert (a[33].value() == true);
+  assert (a[34].value() == true);
+  assert (a[1].representation_value() == mark_bool::store_value(false));
+
+  opt_bool o = a[0];
+  assert (o.has_value() && o.value());
+
+  a[0].assign_marked();
+  assert (!a[0].has_value());
+
+  assert (a.count_true() == 2);
+  assert (a.count_false() == 1);
+  assert (a.count_missing() == 37);
+}
+
+void test_push_back_and_resize()
+{
+  packed_markable_bool_array a;
+  for (int i = 0; i != 100; ++i)
+    a.push_back(tri[i % 3]);
+  assert (a.size() == 100);
+  assert (a.count_false() == 34);
+  assert (a.count_true() == 33);
+  assert (a.count_missing() == 33);
+  for (int i = 0; i != 100; ++i)
+    assert (same(a[i], tri[i % 3]));
+
+  a.resize(130);
+  assert (a.count_missing() == 63);
+  assert (!a[129].has_value());
+
+  a.resize(10);
+  assert (a.size() == 10);
+  assert (a.count_false() + a.count_true() + a.count_missing() == 10);
+  assert (a.count_false() == 4);
+}
+
+void test_three_valued_logic()
+{
+  // all 9 combinations, repeated across word boundaries
+  packed_markable_bool_array a, b;
+  for (int i = 0; i != 90; ++i)
+  {
+    a.push_back(tri[i % 3]);
+    b.push_back(tri[i / 3 % 3]);
+  }
+
+  packed_markable_bool_array c = a & b, d = a | b, n = ~a;
+  for (int i = 0; i != 90; ++i)
+  {
+    assert (same(c[i], sql_and(tri[i % 3], tri[i / 3 % 3])));
+    assert (same(d[i], sql_or(tri[i % 3], tri[i / 3 % 3])));
+    assert (same(n[i], sql_not(tri[i % 3])));
+  }
+
+  assert (n.count_true() == a.count_false());
+  assert (n.count_false() == a.count_true());
+  assert (n.count_missing() == a.count_missing());
+}
+
+int main()
+{
+  test_element_access();
+  test_push_back_and_resize();
+  test_three_valued_logic();
+}
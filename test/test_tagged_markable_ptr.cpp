@@ -0,0 +1,86 @@
+// Copyright (C) 2015 - 2021, Andrzej Krzemienski.
+//
+// Use, modification, and distribution is subject to the Boost Software
+// License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../include/ak_toolkit/tagged_markable_ptr.hpp"
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+using namespace ak_toolkit;
+
+// a node of a tree: optional parent and sibling, each with a 2-bit color
+struct node
+{
+  int key;
+  tagged_markable_ptr<node, 2> parent;
+  tagged_markable_ptr<node, 2> sibling;
+};
+
+typedef tagged_markable_ptr<node, 2> node_link;
+
+void test_empty()
+{
+  static_assert (sizeof(node_link) == sizeof(node*), "not a single word");
+  static_assert (std::is_trivially_copyable<node_link>::value, "not trivially copyable");
+  static_assert (node_link::max_tag() == 2, "wrong max tag");
+
+  node_link l;
+  assert (!l.has_pointer());
+  assert (!l.has_tag());
+  assert (!l.pointer().has_value());
+  assert (!l.tag().has_value());
+  assert (l.get() == nullptr);
+  assert (l == node_link());
+}
+
+void test_pointer_and_tag()
+{
+  node root {1, node_link(), node_link()};
+  node child {2, node_link(node_link::pointer_type(&root), node_link::tag_type(1)), node_link()};
+
+  assert (child.parent.has_pointer());
+  assert (child.parent.get() == &root);
+  assert (child.parent.pointer().value()->key == 1);
+  assert (child.parent.tag().value() == 1);
+
+  child.parent.set_tag(node_link::tag_type(2));
+  assert (child.parent.get() == &root);
+  assert (child.parent.tag().value() == 2);
+
+  child.parent.set_tag(node_link::tag_type());
+  assert (!child.parent.has_tag());
+  assert (child.parent.get() == &root);
+
+  child.parent.set_tag(node_link::tag_type(0));
+  child.parent.set_pointer(node_link::pointer_type());
+  assert (!child.parent.has_pointer());
+  assert (child.parent.has_tag());
+  assert (child.parent.tag().value() == 0);
+
+  child.sibling.set_pointer(node_link::pointer_type(&root));
+  assert (child.sibling.get() == &root);
+  assert (!child.sibling.has_tag());
+  assert (child.sibling != child.parent);
+}
+
+void test_word()
+{
+  node n {3, node_link(), node_link()};
+  node_link l (node_link::pointer_type(&n), node_link::tag_type(1));
+  assert (l.word() == (reinterpret_cast<std::uintptr_t>(&n) | 1));
+
+  node_link m = node_link::from_word(l.word());
+  assert (m == l);
+  assert (m.get() == &n);
+  assert (m.tag().value() == 1);
+}
+
+int main()
+{
+  test_empty();
+  test_pointer_and_tag();
+  test_word();
+}